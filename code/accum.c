@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+// Long integration accumulators. procspec sums the power of the blocks of
+//  one DMA buffer in float (at most a few dozen blocks) and then folds that
+//  partial sum into the quarter's accumulator here, so the long sum over the
+//  whole integration is kept at the chosen precision:
+//   0 float, 1 double, 2 Kahan compensated float, 3 int64 fixed point
+//  The loops are plain element-wise ones that gcc -O3 vectorizes
+//  With accum_sub(1) each partial sum is also added into a float sum per
+//  quarter that accum_subget() reads out and restarts, for the -subint rows
+
+#define ACCFIX 65536.0    // int64 fixed point: 16 fractional bits
+
+static void *accq[NQMAX];     // sum, float/double/long long by type
+static float *acccq[NQMAX];   // Kahan compensation
+static float *accsq[NQMAX];   // sub-integration sums
+static int acctype, accn, accnq;
+static const char *accnames[] = {"float", "double", "kahan", "int64"};
+
+void accum_init(int n, int nq, int type)
+{
+  int q;
+  size_t sz;
+  accum_free();
+  if (type < 0 || type > 3) type = 1;
+  if (nq > NQMAX) nq = NQMAX;
+  sz = (type == 1 || type == 3) ? 8 : 4;
+  for (q = 0; q < nq; q++) {
+    if (posix_memalign(&accq[q], 64, sz * n) ||
+        (type == 2 && posix_memalign((void **) &acccq[q], 64, sizeof(float) * n))) {
+      printf("cannot allocate accumulator\n");
+      exit(1);
+    }
+  }
+  acctype = type;
+  accn = n;
+  accnq = nq;
+  accum_clear();
+}
+
+void accum_free(void)
+{
+  int q;
+  for (q = 0; q < accnq; q++) {
+    free(accq[q]);
+    free(acccq[q]);
+    free(accsq[q]);
+    accq[q] = NULL;
+    acccq[q] = NULL;
+    accsq[q] = NULL;
+  }
+  accnq = 0;
+}
+
+const char *accum_name(int type)
+{
+  if (type < 0 || type > 3) type = 1;
+  return accnames[type];
+}
+
+void accum_clear(void)
+{
+  int q;
+  for (q = 0; q < accnq; q++) {
+    memset(accq[q], 0, (acctype == 1 || acctype == 3 ? 8 : 4) * accn);
+    if (acctype == 2) memset(acccq[q], 0, sizeof(float) * accn);
+    if (accsq[q]) memset(accsq[q], 0, sizeof(float) * accn);
+  }
+}
+
+// Keep the sub-integration sums too - after accum_init()
+void accum_sub(int on)
+{
+  int q;
+  for (q = 0; q < accnq; q++) {
+    free(accsq[q]);
+    accsq[q] = NULL;
+    if (on && posix_memalign((void **) &accsq[q], 64, sizeof(float) * accn)) {
+      printf("cannot allocate accumulator\n");
+      exit(1);
+    }
+    if (on) memset(accsq[q], 0, sizeof(float) * accn);
+  }
+}
+
+// Add sp[0..n-1] into quarter q and zero sp for the next partial sum
+void accum_add(int q, float *sp, int n)
+{
+  accum_addr(q, sp, 0, n);
+}
+
+// Same for channels i0..i1-1 only
+void accum_addr(int q, float *sp, int i0, int i1)
+{
+  int i;
+  float y, t;
+  float *restrict fs, *restrict fc, *restrict ss;
+  double *restrict ds;
+  long long *restrict ls;
+
+  if (i1 > accn) i1 = accn;
+  if (i0 >= i1) return;
+  switch (acctype) {
+  case 0:
+    fs = (float *) accq[q];
+    for (i = i0; i < i1; i++) fs[i] += sp[i];
+    break;
+  case 1:
+    ds = (double *) accq[q];
+    for (i = i0; i < i1; i++) ds[i] += sp[i];
+    break;
+  case 2:
+    fs = (float *) accq[q];
+    fc = acccq[q];
+    for (i = i0; i < i1; i++) {
+      y = sp[i] - fc[i];
+      t = fs[i] + y;
+      fc[i] = (t - fs[i]) - y;
+      fs[i] = t;
+    }
+    break;
+  case 3:
+    ls = (long long *) accq[q];
+    for (i = i0; i < i1; i++) ls[i] += (long long) (sp[i] * ACCFIX + 0.5);
+    break;
+  }
+  if ((ss = accsq[q]) != NULL)
+    for (i = i0; i < i1; i++) ss[i] += sp[i];
+  memset(sp + i0, 0, sizeof(float) * (i1 - i0));
+}
+
+// Sum of all the quarters into spec[0..n-1]
+void accum_get(double spec[], int n)
+{
+  int i, q;
+  if (n > accn) n = accn;
+  for (i = 0; i < n; i++) spec[i] = 0.0;
+  for (q = 0; q < accnq; q++)
+    switch (acctype) {
+    case 0:
+      for (i = 0; i < n; i++) spec[i] += ((float *) accq[q])[i];
+      break;
+    case 1:
+      for (i = 0; i < n; i++) spec[i] += ((double *) accq[q])[i];
+      break;
+    case 2:
+      for (i = 0; i < n; i++) spec[i] += (double) ((float *) accq[q])[i] - acccq[q][i];
+      break;
+    case 3:
+      for (i = 0; i < n; i++) spec[i] += ((long long *) accq[q])[i] / ACCFIX;
+      break;
+    }
+}
+
+// Sum of the quarters' sub-integration sums for channels i0..i1-1 into
+//  out (if not NULL), restarting them
+void accum_subget(float *out, int i0, int i1)
+{
+  int i, q;
+  float *restrict ss;
+  if (i1 > accn) i1 = accn;
+  if (i0 >= i1 || accnq == 0 || accsq[0] == NULL) return;
+  if (out) memcpy(out + i0, accsq[0] + i0, sizeof(float) * (i1 - i0));
+  memset(accsq[0] + i0, 0, sizeof(float) * (i1 - i0));
+  for (q = 1; q < accnq; q++) {
+    ss = accsq[q];
+    if (out)
+      for (i = i0; i < i1; i++) out[i] += ss[i];
+    memset(ss + i0, 0, sizeof(float) * (i1 - i0));
+  }
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "acqfile.h"
+
+// List a binary spectrum archive: one line per record in the style of the
+//  .acq text headers, and with -v the spectrum values as well
+//  acqcat file.acb [-s secs] [-n count] [-v] [-t]
+//   -s  start at the first record at or after secs (seconds since 1970)
+//   -n  print at most count records
+//   -v  print the values
+//   -t  read every record and report the time taken
+
+int main(int argc, char **argv)
+{
+  acqarch *a;
+  acqrec r;
+  float *spec;
+  int i, j, i0, n, nmax, verbose, timing;
+  double secs, t;
+  struct timespec tic, toc;
+  struct tm *tm;
+  time_t tt;
+
+  if (argc < 2) {
+    printf("usage: acqcat file.acb [-s secs] [-n count] [-v] [-t]\n");
+    return 1;
+  }
+  secs = 0;
+  nmax = 0x7fffffff;
+  verbose = timing = 0;
+  for (i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) secs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc) nmax = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-v")) verbose = 1;
+    else if (!strcmp(argv[i], "-t")) timing = 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &tic);
+  if ((a = acq_open(argv[1])) == NULL) {
+    printf("cannot read %s\n", argv[1]);
+    return 1;
+  }
+  spec = NULL;
+  n = 0;
+
+  if (timing) {
+    for (i = 0; i < acq_nrec(a); i++) {
+      j = acq_read(a, i, &r, NULL, 0);
+      if (j > n) {
+        free(spec);
+        spec = (float *) malloc(sizeof(float) * j);
+        n = j;
+      }
+      if (acq_read(a, i, &r, spec, n) < 0) break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &toc);
+    t = (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1e9;
+    printf("%d records read in %8.3f ms\n", i, t * 1e3);
+  }
+
+  i0 = acq_find(a, secs);
+  for (i = i0; i < acq_nrec(a) && i - i0 < nmax; i++) {
+    j = acq_read(a, i, &r, NULL, 0);
+    if (j < 0) break;
+    if (verbose && j > n) {
+      free(spec);
+      spec = (float *) malloc(sizeof(float) * j);
+      n = j;
+    }
+    if (verbose && acq_read(a, i, &r, spec, n) < 0) break;
+    tt = (time_t) r.secs;
+    tm = gmtime(&tt);
+    printf("%4d:%03d:%02d:%02d:%02d %1d %8.3f %8.6f %8.3f adcmax %8.5f adcmin %8.5f temp %2.0f C nblk %d nspec %d %s\n",
+           tm->tm_year + 1900, tm->tm_yday + 1, tm->tm_hour, tm->tm_min, tm->tm_sec,
+           r.swpos, r.fstart, r.fstep, r.fstop, r.adcmax, r.adcmin, r.temp, r.numblk, r.nspec,
+           r.fmt == ACQF16 ? "f16" : "f32");
+    if (verbose) {
+      for (j = 0; j < r.nspec; j++) printf(" %9.5f", spec[j]);
+      printf("\n");
+    }
+  }
+  free(spec);
+  acq_close(a);
+  return 0;
+}
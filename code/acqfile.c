@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+#include "acqfile.h"
+#include "compress.h"
+
+// Binary archive writer. The .acb and .idx files are kept open and a new
+//  pair is started at the first switch position of a new day, as with the
+//  text .acq files. Each record is flushed as soon as it is written.
+//  Runs on the writer thread: d is the writer's copy of d1 for the record,
+//  whose file fields (filname, foutstatus, rday) carry over between calls.
+//  With -comp the spectrum values are stored as one compress.c frame and
+//  the codec is recorded in spare[0] of the record header
+
+static FILE *acqf, *acqx;
+static double acqraw, acqpacked, acqsecs;
+
+// float to IEEE half, round to nearest even, no denormal output
+static uint16_t acq_half(float f)
+{
+  union { float f; uint32_t u; } v;
+  uint32_t s, e, m;
+  v.f = f;
+  s = (v.u >> 16) & 0x8000;
+  e = (v.u >> 23) & 0xff;
+  m = v.u & 0x7fffff;
+  if (e == 0xff) return s | 0x7c00 | (m ? 0x200 : 0);    // inf, nan
+  if (e < 113) return s;                                 // too small
+  if (e > 142) return s | 0x7c00;                        // too big
+  e -= 112;
+  m += 0xfff + ((m >> 13) & 1);
+  if (m & 0x800000) {
+    m = 0;
+    if (++e == 31) return s | 0x7c00;
+  }
+  return s | (e << 10) | (m >> 13);
+}
+
+static void acq_closefiles(void)
+{
+  if (acqf) fclose(acqf);
+  if (acqx) fclose(acqx);
+  acqf = acqx = NULL;
+}
+
+static int acq_openfiles(const char *fname)
+{
+  char name[96], *p;
+  acqhdr h;
+  acq_closefiles();
+  if ((acqf = fopen(fname, "ab")) == NULL) return -1;
+  if (ftell(acqf) == 0) {
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, ACQMAGIC, 8);
+    h.version = ACQVERSION;
+    h.hdrsize = sizeof(acqhdr);
+    h.recsize = sizeof(acqrec);
+    h.idxsize = sizeof(acqidx);
+    strcpy(h.desc, "pxspec");
+    fwrite(&h, sizeof(h), 1, acqf);
+  }
+  strcpy(name, fname);
+  if ((p = strrchr(name, '.'))) strcpy(p, ".idx");
+  if ((acqx = fopen(name, "ab")) == NULL) {
+    acq_closefiles();
+    return -1;
+  }
+  return 0;
+}
+
+void acqwrite(d1type *d, const double data[], int num, int swpos)
+{
+  int yr, da, hr, mn, sc, i, nb;
+  acqrec r;
+  acqidx x;
+  static void *buf, *zbuf;
+  static int bufn;
+  struct timespec tic, toc;
+
+  toyrday(d->secs, &yr, &da, &hr, &mn, &sc);
+  if (d->foutstatus == 1 && da != d->rday && swpos == 0) d->foutstatus = 0;
+  if (d->foutstatus != 1 || acqf == NULL) {
+    d->rday = da;
+    sprintf(d->filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acb", yr, da, hr);
+    if (acq_openfiles(d->filname)) {
+      d->foutstatus = -99;
+      printf("cannot write %s\n", d->filname);
+      return;
+    }
+    d->foutstatus = 1;
+  }
+
+  if (num > bufn) {
+    free(buf);
+    free(zbuf);
+    buf = malloc(sizeof(float) * num);
+    zbuf = malloc(cz_bound(sizeof(float) * num));
+    bufn = num;
+  }
+  memset(&r, 0, sizeof(r));
+  r.magic = ACQRECMAGIC;
+  r.fmt = d->afmt == 2 ? ACQF16 : ACQF32;
+  nb = num * (r.fmt == ACQF16 ? 2 : 4);
+  r.swpos = swpos;
+  r.nspec = num;
+  r.numblk = d->numblk;
+  r.maxindex = d->maxindex;
+  r.novfl = d->novfl;
+  r.secs = d->secs;
+  r.fstart = d->fstart;
+  r.fstep = d->fstep;
+  r.fstop = d->fstop;
+  r.fres = d->fres;
+  r.mfreq = d->mfreq;
+  r.adcmax = d->adcmax;
+  r.adcmin = d->adcmin;
+  r.temp = d->temp;
+  r.dropped = d->dropped;
+  if (r.fmt == ACQF16)
+    for (i = 0; i < num; i++) ((uint16_t *) buf)[i] = acq_half(data[i]);
+  else
+    for (i = 0; i < num; i++) ((float *) buf)[i] = data[i];
+  if (d->comp) {
+    clock_gettime(CLOCK_MONOTONIC, &tic);
+    r.spare[0] = d->comp;
+    acqraw += nb;
+    nb = cz_encode(d->comp, r.fmt == ACQF16 ? 2 : 4, buf, nb, zbuf);
+    acqpacked += nb;
+    clock_gettime(CLOCK_MONOTONIC, &toc);
+    acqsecs += (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1e9;
+  }
+  r.size = sizeof(r) + nb;
+
+  x.secs = r.secs;
+  x.offset = ftell(acqf);
+  x.swpos = swpos;
+  x.size = r.size;
+  if (fwrite(&r, sizeof(r), 1, acqf) != 1 ||
+      fwrite(d->comp ? zbuf : buf, nb, 1, acqf) != 1 || fflush(acqf)) {
+    printf("cannot write %s\n", d->filname);
+    acq_closefiles();
+    d->foutstatus = -99;
+    return;
+  }
+  fwrite(&x, sizeof(x), 1, acqx);
+  fflush(acqx);
+}
+
+void acqclose(void)
+{
+  if (acqpacked > 0)
+    printf("archive compression ratio %5.2f at %6.1f MB/s\n", acqraw / acqpacked, acqraw / acqsecs / 1e6);
+  acq_closefiles();
+}
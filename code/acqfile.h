@@ -0,0 +1,61 @@
+/* Binary spectrum archive, written by acqfile.c and read with acqread.c
+ *
+ * file.acb   file header, then one record per spectrum:
+ *            acqrec header followed by nspec values, float32 or float16
+ * file.idx   one acqidx entry per record, appended after the record is
+ *            complete. If it is missing or short the reader rebuilds it
+ *            by walking the record headers
+ *
+ * All fields are little endian and the structs have no padding */
+#include <stdio.h>
+#include <stdint.h>
+
+#define ACQMAGIC "ACQSPEC1"
+#define ACQRECMAGIC 0x43455053    // "SPEC"
+#define ACQVERSION 1
+#define ACQF32 1
+#define ACQF16 2
+
+typedef struct
+{
+ char magic[8];       // ACQMAGIC
+ uint32_t version;
+ uint32_t hdrsize;    // sizeof(acqhdr)
+ uint32_t recsize;    // sizeof(acqrec)
+ uint32_t idxsize;    // sizeof(acqidx)
+ char desc[40];       // free text, the program that wrote it
+} acqhdr;
+
+typedef struct
+{
+ uint32_t magic;      // ACQRECMAGIC
+ uint32_t size;       // bytes in the record including this header
+ int32_t swpos, nspec, fmt, numblk, maxindex, novfl;
+ double secs, fstart, fstep, fstop, fres, mfreq;
+ double adcmax, adcmin, temp, dropped;
+ int32_t spare[4];
+} acqrec;
+
+typedef struct
+{
+ double secs;
+ int64_t offset;      // of the acqrec in the .acb file
+ int32_t swpos;
+ uint32_t size;
+} acqidx;
+
+typedef struct
+{
+ FILE *file;
+ int nrec;
+ acqidx *idx;
+ acqhdr hdr;
+ void *buf;
+ int bufsiz;
+} acqarch;
+
+acqarch *acq_open (const char *);
+void acq_close (acqarch *);
+int acq_nrec (acqarch *);
+int acq_find (acqarch *, double);
+int acq_read (acqarch *, int, acqrec *, float *, int);
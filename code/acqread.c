@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "acqfile.h"
+#include "compress.h"
+
+// Reader for the binary spectrum archive. acq_open() loads the .idx file,
+//  or rebuilds the index from the record headers when the .idx is missing
+//  or does not cover the whole .acb, after which any record can be read
+//  with one seek. Compressed records (spare[0] set) are decoded whole
+
+static float acq_float(uint16_t h)
+{
+  union { float f; uint32_t u; } v;
+  uint32_t s, e, m;
+  s = (uint32_t) (h & 0x8000) << 16;
+  e = (h >> 10) & 0x1f;
+  m = h & 0x3ff;
+  if (e == 0) {
+    if (m == 0) v.u = s;
+    else {    // denormal
+      e = 113;
+      while (!(m & 0x400)) { m <<= 1; e--; }
+      v.u = s | (e << 23) | ((m & 0x3ff) << 13);
+    }
+  }
+  else if (e == 31) v.u = s | 0x7f800000 | (m << 13);
+  else v.u = s | ((e + 112) << 23) | (m << 13);
+  return v.f;
+}
+
+static int acq_addidx(acqarch *a, int *nalloc, const acqidx *x)
+{
+  acqidx *p;
+  if (a->nrec == *nalloc) {
+    *nalloc = *nalloc ? 2 * *nalloc : 1024;
+    if ((p = (acqidx *) realloc(a->idx, sizeof(acqidx) * *nalloc)) == NULL) return -1;
+    a->idx = p;
+  }
+  a->idx[a->nrec++] = *x;
+  return 0;
+}
+
+acqarch *acq_open(const char *name)
+{
+  acqarch *a;
+  FILE *fx;
+  char xname[256], *p;
+  acqrec r;
+  acqidx x;
+  long end, off;
+  int nalloc;
+
+  if ((a = (acqarch *) calloc(1, sizeof(acqarch))) == NULL) return NULL;
+  if ((a->file = fopen(name, "rb")) == NULL ||
+      fread(&a->hdr, sizeof(acqhdr), 1, a->file) != 1 ||
+      memcmp(a->hdr.magic, ACQMAGIC, 8) || a->hdr.recsize != sizeof(acqrec)) {
+    acq_close(a);
+    return NULL;
+  }
+  fseek(a->file, 0, SEEK_END);
+  end = ftell(a->file);
+
+  // index file, as far as it goes
+  nalloc = 0;
+  off = a->hdr.hdrsize;
+  snprintf(xname, sizeof(xname), "%s", name);
+  if ((p = strrchr(xname, '.'))) strcpy(p, ".idx");
+  if ((fx = fopen(xname, "rb"))) {
+    fseek(fx, 0, SEEK_END);
+    nalloc = ftell(fx) / sizeof(acqidx);
+    fseek(fx, 0, SEEK_SET);
+    a->idx = (acqidx *) malloc(sizeof(acqidx) * (nalloc ? nalloc : 1));
+    a->nrec = fread(a->idx, sizeof(acqidx), nalloc, fx);
+    fclose(fx);
+    while (a->nrec > 0 && a->idx[a->nrec - 1].offset + a->idx[a->nrec - 1].size > end) a->nrec--;
+    if (a->nrec > 0) off = a->idx[a->nrec - 1].offset + a->idx[a->nrec - 1].size;
+  }
+
+  // records after the end of the index
+  fseek(a->file, off, SEEK_SET);
+  while (off + (long) sizeof(r) <= end && fread(&r, sizeof(r), 1, a->file) == 1) {
+    if (r.magic != ACQRECMAGIC || r.size < sizeof(r) || off + (long) r.size > end) break;
+    x.secs = r.secs;
+    x.offset = off;
+    x.swpos = r.swpos;
+    x.size = r.size;
+    if (acq_addidx(a, &nalloc, &x)) break;
+    off += r.size;
+    fseek(a->file, off, SEEK_SET);
+  }
+  return a;
+}
+
+void acq_close(acqarch *a)
+{
+  if (a == NULL) return;
+  if (a->file) fclose(a->file);
+  free(a->idx);
+  free(a->buf);
+  free(a);
+}
+
+int acq_nrec(acqarch *a)
+{
+  return a->nrec;
+}
+
+// first record at or after secs
+int acq_find(acqarch *a, double secs)
+{
+  int lo, hi, m;
+  lo = 0;
+  hi = a->nrec;
+  while (lo < hi) {
+    m = (lo + hi) / 2;
+    if (a->idx[m].secs < secs) lo = m + 1;
+    else hi = m;
+  }
+  return lo;
+}
+
+// Read record i: the header into r and up to n values into spec as float.
+//  Returns the number of values in the record or -1
+int acq_read(acqarch *a, int i, acqrec *r, float *spec, int n)
+{
+  int j, nb, es, zn;
+  void *raw;
+  if (i < 0 || i >= a->nrec) return -1;
+  if (fseek(a->file, a->idx[i].offset, SEEK_SET) ||
+      fread(r, sizeof(acqrec), 1, a->file) != 1 || r->magic != ACQRECMAGIC) return -1;
+  if (spec == NULL || n <= 0) return r->nspec;
+  if (n > r->nspec) n = r->nspec;
+  if (r->spare[0]) {
+    es = r->fmt == ACQF16 ? 2 : 4;
+    zn = r->size - sizeof(acqrec);
+    nb = zn + r->nspec * es;
+    if (r->fmt != ACQF16 && r->fmt != ACQF32) return -1;
+    if (nb > a->bufsiz) {
+      free(a->buf);
+      if ((a->buf = malloc(nb)) == NULL) { a->bufsiz = 0; return -1; }
+      a->bufsiz = nb;
+    }
+    raw = (char *) a->buf + zn;
+    if (fread(a->buf, 1, zn, a->file) != (size_t) zn ||
+        cz_decode(a->buf, zn, raw, r->nspec * es) != (size_t) r->nspec * es) return -1;
+    for (j = 0; j < n; j++)
+      spec[j] = es == 2 ? acq_float(((uint16_t *) raw)[j]) : ((float *) raw)[j];
+    return r->nspec;
+  }
+  if (r->fmt == ACQF32) {
+    if (fread(spec, sizeof(float), n, a->file) != (size_t) n) return -1;
+    return r->nspec;
+  }
+  if (r->fmt != ACQF16) return -1;
+  nb = n * sizeof(uint16_t);
+  if (nb > a->bufsiz) {
+    free(a->buf);
+    if ((a->buf = malloc(nb)) == NULL) { a->bufsiz = 0; return -1; }
+    a->bufsiz = nb;
+  }
+  if (fread(a->buf, sizeof(uint16_t), n, a->file) != (size_t) n) return -1;
+  for (j = 0; j < n; j++) spec[j] = acq_float(((uint16_t *) a->buf)[j]);
+  return r->nspec;
+}
@@ -0,0 +1,542 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fftw3.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+#include "compress.h"
+
+// Processing benchmarks run with -bench instead of an acquisition.
+//  -bench 1 runs all of them, -bench n > 1 only number n:
+//   2  packed complex FFT against the batched real input FFT
+//   3  window and convert of 16-bit samples, scalar loop against winconv
+//   4  per block cost of the polyphase filter bank against the plain FFT
+//   5  float, double, Kahan and int64 accumulators, speed and precision
+//   6  dual channel: split then window against winconv2, and the whole
+//      auto and cross spectrum path against the 200 MS/s per channel rate
+//   7  compression codecs on ADC samples and on spectra: ratio, encode
+//      and decode rate, round trip check and the threaded stream
+//   8  RFI flagging at nspec 32768: cost over the plain power sum, and
+//      what it flags in noise with intermittent, CW and broadband RFI
+//   9  -subint rows at nspec 32768: cost of the sub-integration sums and
+//      the row fold over the single spectrum path, and that the rows add
+//      up to the long integration
+
+void fft_init(int, int, fftwf_plan *);
+void fft_free(int, fftwf_plan *);
+void cfft(fftwf_plan *);
+void cfft_power(const float *, int, float *);
+void rfft_init(int, int, int);
+void rfft_free(int);
+void rfft(int, int);
+void rfft_power(int, int, float *);
+void rfft_cross(int, int, float *);
+extern float *reamin[],*reamout[];
+extern fftwf_complex *rfout[];
+extern float *rfin[];
+extern d1type d1;
+
+static unsigned int benchseed = 1;
+
+double benchclock(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// uniform noise -0.5 to 0.5
+float benchnoise(void)
+{
+  benchseed = benchseed * 1103515245 + 12345;
+  return ((benchseed >> 8) & 0xffff) / 65536.0 - 0.5;
+}
+
+// Windowed noise plus a tone through both FFT paths. The spectra must
+//  agree to float rounding since the r2c power is scaled to the packed one
+static void fftbench(void)
+{
+  int nspec, n, nblk, niter, it, b, j;
+  double t, tp, tr, max, dmax;
+  float *data, *spa, *spb;
+  fftwf_plan p;
+
+  nblk = 16;
+  for (nspec = 8192; nspec <= 65536; nspec *= 2) {
+    n = 2 * nspec;
+    niter = 4 * 65536 / nspec;
+    data = (float *) malloc(sizeof(float) * n * nblk);
+    spa = (float *) calloc(nspec, sizeof(float));
+    spb = (float *) calloc(nspec, sizeof(float));
+    for (j = 0; j < n * nblk; j++)
+      data[j] = 0.5 * benchnoise() + 0.1 * cos(0.3 * j);
+    fft_init(n, 0, &p);
+    rfft_init(n, RBATCH, 0);
+
+    t = benchclock();
+    for (it = 0; it < niter; it++)
+      for (b = 0; b < nblk; b += 2) {
+        for (j = 0; j < n; j++) {
+          reamin[0][2*j] = data[b*n + j];
+          reamin[0][2*j+1] = data[(b+1)*n + j];
+        }
+        cfft(&p);
+        cfft_power(reamout[0], n, spa);
+      }
+    tp = (benchclock() - t) / (niter * nblk);
+
+    t = benchclock();
+    for (it = 0; it < niter; it++)
+      for (b = 0; b < nblk; b += RBATCH) {
+        memcpy(rfin[0], data + b*n, sizeof(float) * n * RBATCH);
+        rfft(0, RBATCH);
+        rfft_power(0, RBATCH, spb);
+      }
+    tr = (benchclock() - t) / (niter * nblk);
+
+    max = dmax = 0;
+    for (j = 0; j < nspec; j++) if (spa[j] > max) max = spa[j];
+    for (j = 0; j < nspec; j++) if (fabs(spa[j] - spb[j]) > dmax) dmax = fabs(spa[j] - spb[j]);
+    printf("fft nspec %6d packed %8.3f ms/blk r2c %8.3f ms/blk speedup %5.2f maxdiff %8.2e\n",
+           nspec, tp * 1e3, tr * 1e3, tp / tr, dmax / max);
+
+    fft_free(0, &p);
+    rfft_free(0);
+    free(data); free(spa); free(spb);
+  }
+}
+
+// The procspec quarter 0 loop as it was, against the dispatched kernel
+static void winbench(void)
+{
+  int n, niter, it, j, maxi, simd;
+  unsigned short *wave;
+  const float *win;
+  float *out, rre, max, min, mm[2];
+  double t, ts, tv;
+
+  n = 65536;
+  niter = 2000;
+  wave = (unsigned short *) malloc(sizeof(unsigned short) * n);
+  win = window_get(d1.wtype, n, 0.5/32768.0);
+  out = (float *) malloc(sizeof(float) * n);
+  for (j = 0; j < n; j++) wave[j] = 32768 + (int)(20000.0 * benchnoise());
+
+  max = -1e30; min = 1e30; maxi = 0;
+  t = benchclock();
+  for (it = 0; it < niter; it++)
+    for (j = 0; j < n; j++) {
+      rre = (wave[j]-32768)*win[j];
+      if (rre > max) {max = rre; maxi = j;}
+      if (rre < min) min = rre;
+      out[j] = rre;
+    }
+  ts = (benchclock() - t) / ((double) niter * n);
+  printf("winconv scalar loop    %8.1f Msamples/s max %9.6f %d min %9.6f\n", 1e-6 / ts, max, maxi, min);
+
+  for (simd = 0; simd <= 2; simd++) {
+    winconv_init(simd);
+    if (simd && !strcmp(winconv_name(), "scalar")) continue;
+    mm[0] = -1e30; mm[1] = 1e30;
+    t = benchclock();
+    for (it = 0; it < niter; it++) winconv(wave, win, out, n, mm);
+    tv = (benchclock() - t) / ((double) niter * n);
+    printf("winconv %-6s kernel  %8.1f Msamples/s max %9.6f min %9.6f speedup %5.2f\n",
+           winconv_name(), 1e-6 / tv, mm[0], mm[1], ts / tv);
+  }
+  winconv_init(d1.simd);
+  free(wave); free(out);
+}
+
+// A tone half way between two channels: the leakage is its power seen 40
+//  channels away. The tone is periodic in the test buffer, so the history
+//  taken from the end of the buffer joins on to its start
+static void pfbbench(void)
+{
+  int nspec, n, nblk, niter, it, b, j, ntap, k0, k1;
+  double t, tw, tp, f;
+  unsigned short *wave;
+  float *sp;
+  const float *win;
+
+  nspec = 32768;
+  n = 2 * nspec;
+  nblk = 16;
+  niter = 8;
+  k1 = nspec / 4;
+  k0 = k1 - 40;
+  f = (k1 + 0.5) / n;
+  wave = (unsigned short *) malloc(sizeof(unsigned short) * n * nblk);
+  sp = (float *) calloc(nspec, sizeof(float));
+  for (j = 0; j < n * nblk; j++)
+    wave[j] = 32768 + (int) floor(16000.0 * cos(2.0 * M_PI * f * j) + 0.5 + benchnoise());
+  win = window_get(d1.wtype, n, 0.5/32768.0);
+  tw = 0;
+  for (ntap = 0; ntap <= 8; ntap = ntap ? 2 * ntap : 2) {
+    rfft_init(n, RBATCH, 0);
+    if (ntap) {
+      pfb_init(n, ntap);
+      pfb_save(wave, n * nblk);
+    }
+    for (j = 0; j < nspec; j++) sp[j] = 0;
+    t = benchclock();
+    for (it = 0; it < niter; it++)
+      for (b = 0; b < nblk; b += RBATCH) {
+        for (j = 0; j < RBATCH; j++) {
+          if (ntap) pfb_fir(wave, (b + j) * n, rfin[0] + j * n);
+          else winconv(wave + (b + j) * n, win, rfin[0] + j * n, n, NULL);
+        }
+        rfft(0, RBATCH);
+        rfft_power(0, RBATCH, sp);
+      }
+    tp = (benchclock() - t) / (niter * nblk);
+    if (ntap == 0) tw = tp;
+    printf("pfb nspec %6d taps %d %8.3f ms/blk cost %5.2f x fft leakage at 40 ch %6.1f dB\n",
+           nspec, ntap, tp * 1e3, tp / tw, 10.0 * log10(sp[k0] / sp[k1]));
+    if (ntap) pfb_free();
+    rfft_free(0);
+  }
+  window_free();
+  free(wave); free(sp);
+}
+
+// Partial sums of 16 blocks of noise-like power around 1000 folded in as
+//  procspec does once per DMA buffer, for the equivalent of 100000 blocks.
+//  The error is against a long double sum of the same partial sums
+static void accbench(void)
+{
+  int n, nadd, it, i, type;
+  float *sp, *p;
+  double *spec, t, ta, err, maxerr;
+  long double *ref;
+
+  n = 32768;
+  nadd = 100000 / 16;
+  p = (float *) malloc(sizeof(float) * n * 16);
+  sp = (float *) malloc(sizeof(float) * n);
+  spec = (double *) malloc(sizeof(double) * n);
+  ref = (long double *) calloc(n, sizeof(long double));
+  for (i = 0; i < n * 16; i++) p[i] = 16.0 * (1000.0 + 300.0 * benchnoise());
+  for (it = 0; it < nadd; it++)
+    for (i = 0; i < n; i++) ref[i] += p[(it & 15) * n + i];
+  for (type = 0; type <= 3; type++) {
+    accum_init(n, 1, type);
+    ta = 0;
+    for (it = 0; it < nadd; it++) {
+      memcpy(sp, p + (it & 15) * n, sizeof(float) * n);
+      t = benchclock();
+      accum_add(0, sp, n);
+      ta += benchclock() - t;
+    }
+    accum_get(spec, n);
+    maxerr = 0;
+    for (i = 0; i < n; i++) {
+      err = fabs((double) ((spec[i] - ref[i]) / ref[i]));
+      if (err > maxerr) maxerr = err;
+    }
+    printf("accum %-6s %6.3f ns/bin %8.3f us/add max rel error %8.2e\n",
+           accum_name(type), ta * 1e9 / ((double) nadd * n), ta * 1e6 / nadd, maxerr);
+    accum_free();
+  }
+  free(p); free(sp); free(spec); free(ref);
+}
+
+// The split is done the way DeInterleaveDataPX14 leaves the data, into two
+//  sample buffers, each then windowed on its own
+static void dualbench(void)
+{
+  int nspec, n, nblk, niter, it, b, j;
+  unsigned short *wave, *cha, *chb;
+  float *sp, *a, *c;
+  const float *win;
+  double t, ts, tf, tp, dmax;
+
+  nspec = 32768;
+  n = 2 * nspec;
+  nblk = 16;
+  niter = 20;
+  wave = (unsigned short *) malloc(sizeof(unsigned short) * 2 * n * nblk);
+  cha = (unsigned short *) malloc(sizeof(unsigned short) * n);
+  chb = (unsigned short *) malloc(sizeof(unsigned short) * n);
+  a = (float *) malloc(sizeof(float) * 2 * n);
+  c = (float *) malloc(sizeof(float) * 2 * n);
+  sp = (float *) calloc(4 * nspec, sizeof(float));
+  for (j = 0; j < n * nblk; j++) {
+    wave[2*j] = 32768 + (int)(8000.0 * benchnoise() + 4000.0 * cos(0.3 * j));
+    wave[2*j+1] = 32768 + (int)(8000.0 * benchnoise() + 4000.0 * cos(0.3 * j + 1.0));
+  }
+  win = window_get(d1.wtype, n, 0.5/32768.0);
+
+  t = benchclock();
+  for (it = 0; it < niter; it++)
+    for (b = 0; b < nblk; b++) {
+      for (j = 0; j < n; j++) {
+        cha[j] = wave[2*(b*n + j)];
+        chb[j] = wave[2*(b*n + j) + 1];
+      }
+      winconv(cha, win, a, n, NULL);
+      winconv(chb, win, a + n, n, NULL);
+    }
+  ts = (benchclock() - t) / ((double) niter * nblk * n);
+
+  t = benchclock();
+  for (it = 0; it < niter; it++)
+    for (b = 0; b < nblk; b++) winconv2(wave + 2 * b * n, win, c, c + n, n);
+  tf = (benchclock() - t) / ((double) niter * nblk * n);
+  dmax = 0;
+  for (j = 0; j < 2 * n; j++) if (fabs(a[j] - c[j]) > dmax) dmax = fabs(a[j] - c[j]);
+  printf("dual split %8.1f MS/s per channel winconv2 %s %8.1f MS/s speedup %5.2f maxdiff %8.2e\n",
+         1e-6 / ts, winconv_name(), 1e-6 / tf, ts / tf, dmax);
+
+  rfft_init(n, RBATCH, 0);
+  t = benchclock();
+  for (b = 0; b < nblk; b += RBATCH / 2) {
+    for (j = 0; j < RBATCH / 2; j++)
+      winconv2(wave + 2 * (b + j) * n, win, rfin[0] + 2 * j * n, rfin[0] + (2 * j + 1) * n, n);
+    rfft(0, RBATCH);
+    rfft_cross(0, RBATCH, sp);
+  }
+  tp = (benchclock() - t) / ((double) nblk * n);
+  printf("dual nspec %6d auto and cross %8.1f MS/s per channel on one core, %4.1f cores for 200 MS/s\n",
+         nspec, 1e-6 / tp, 200e6 * tp);
+  rfft_free(0);
+  free(wave); free(cha); free(chb); free(a); free(c); free(sp);
+}
+
+// One codec on one buffer: ratio and MB/s each way, and whether the
+//  decoded data matches
+static void czone(const char *what, int codec, int es, const void *in, size_t n, void *z, void *out)
+{
+  int it, niter;
+  size_t zn, dn;
+  double t, te, td;
+
+  niter = 10;
+  zn = dn = 0;
+  t = benchclock();
+  for (it = 0; it < niter; it++) zn = cz_encode(codec, es, in, n, z);
+  te = (benchclock() - t) / niter;
+  memset(out, 0, n);
+  t = benchclock();
+  for (it = 0; it < niter; it++) dn = cz_decode(z, zn, out, n);
+  td = (benchclock() - t) / niter;
+  printf("%-8s %-8s ratio %5.2f encode %7.1f MB/s decode %7.1f MB/s %s\n", what, cz_name(codec),
+         (double) n / zn, n / te / 1e6, n / td / 1e6, dn == n && !memcmp(in, out, n) ? "ok" : "MISMATCH");
+}
+
+// ADC samples are 14 bits in the top of each 16-bit word, noise of a few
+//  hundred counts as seen with the antenna. The spectra are float32 power
+//  spectra with a smooth bandpass, as written to the .acb archive
+static void czbench(void)
+{
+  int n, j, codec;
+  unsigned short *wave;
+  float *sp;
+  void *z, *out;
+  double t;
+  czstream *s;
+  FILE *f;
+
+  n = 1 << 22;
+  wave = (unsigned short *) malloc(sizeof(unsigned short) * n);
+  sp = (float *) malloc(sizeof(float) * n / 2);
+  z = malloc(cz_bound(sizeof(float) * n / 2) > cz_bound(2 * n) ? cz_bound(sizeof(float) * n / 2) : cz_bound(2 * n));
+  out = malloc(sizeof(unsigned short) * n);
+  for (j = 0; j < n; j++)
+    wave[j] = (32768 + (int)(4 * 300.0 * (benchnoise() + benchnoise() + benchnoise())
+                             + 4 * 200.0 * cos(0.3 * j))) & 0xfffc;
+  for (j = 0; j < n / 2; j++)
+    sp[j] = 1e3 * (1.0 + 0.5 * sin(M_PI * j / (n / 2))) * (1.0 + 0.002 * benchnoise());
+
+  for (codec = CZ_LZ; codec <= CZ_DELTA; codec++)
+    czone("adc", codec, 2, wave, 2 * n, z, out);
+  for (codec = CZ_LZ; codec <= CZ_SHUF; codec++)
+    czone("spectrum", codec, 4, sp, 2 * n, z, out);
+
+  // stream: 64 kB blocks to a scratch file with room for all of them in
+  //  the queue, timed to the end of the last write
+  if ((f = tmpfile()) == NULL) return;
+  s = cz_open(f, CZ_DELTA, 2, n / 32768);
+  t = benchclock();
+  for (j = 0; j < n; j += 32768) cz_write(s, wave + j, 65536);
+  cz_close(s);
+  printf("stream %s %7.1f MB/s through the queue\n", cz_name(CZ_DELTA), 2.0 * n / (benchclock() - t) / 1e6);
+  fclose(f);
+
+  // a saturated RFI trigger alternating +-32767, the 17-bit worst case of
+  //  the delta coding and float spectra asked for CZ_DELTA must all come
+  //  back whole from a cz_bound() buffer, the last two stored as none
+  for (j = 0; j < n; j++) wave[j] = (j & 1) ? 32767 : (unsigned short) -32767;
+  czone("adc sat", CZ_DELTA, 2, wave, 2 * n, z, out);
+  for (j = 0; j < n; j++) wave[j] = (j & 1) ? 0xffff : 0;
+  czone("adc 17b", CZ_DELTA, 2, wave, 2 * n, z, out);
+  czone("spectrum", CZ_DELTA, 4, sp, 2 * n, z, out);
+  free(wave); free(sp); free(z); free(out);
+}
+
+// uniform 0 to 1 exclusive from splitmix64 - the LCG of benchnoise() is
+//  correlated at the power of 2 lags between blocks, which shows up in
+//  the kurtosis
+static unsigned long long benchux;
+
+static double benchuni(void)
+{
+  unsigned long long z;
+  z = (benchux += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return ((z >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// Complex Gaussian FFT outputs with a sloped bandpass, 32 blocks per DMA
+//  buffer for 40 buffers - a 1280 block integration - written straight
+//  into rfout. Channel 1000 has a burst 10 times the noise in one block of
+//  each buffer, channel 2000 a CW tone and buffer 20 a broadband burst.
+//  Timed are only the power sums and the folds, with and without -rfi
+static void rfibench(void)
+{
+  int nspec, nbuf, nper, buf, b, bb, i, e, nflag, nall, nbad;
+  float *sp, *rsp[1];
+  fftwf_complex *o;
+  double *spec, *spec0, t, tp, tr, g, r, ph;
+  const unsigned char *mask;
+
+  nspec = 32768;
+  nbuf = 40;
+  nper = 32;
+  if (d1.rfi <= 0) d1.rfi = 5.0;
+  sp = (float *) calloc(nspec, sizeof(float));
+  spec = (double *) malloc(sizeof(double) * nspec);
+  spec0 = (double *) malloc(sizeof(double) * nspec);
+  rfft_init(2 * nspec, RBATCH, 0);
+  rsp[0] = sp;
+  tp = tr = 0;
+  for (i = 0; i < 2; i++) {
+    benchux = 1;
+    accum_init(nspec, 1, 1);
+    if (i) rfi_init(nspec, 1, rsp, nper);
+    for (buf = 0; buf < nbuf; buf++) {
+      for (b = 0; b < nper; b += RBATCH) {
+        for (bb = 0; bb < RBATCH; bb++) {
+          o = rfout[0] + bb * (nspec + 1);
+          for (e = 0; e < nspec; e++) {
+            g = sqrt(-2.0 * log(benchuni())) * (1.0 + (double) e / nspec);
+            ph = 2.0 * M_PI * benchuni();
+            o[e][0] = g * cos(ph);
+            o[e][1] = g * sin(ph);
+          }
+          if (b + bb == buf % nper) { o[1000][0] *= 10.0; o[1000][1] *= 10.0; }
+          o[2000][0] = 8.0; o[2000][1] = 0.0;
+          if (buf == 20 && b + bb == 5)
+            for (e = 0; e < nspec; e++) { o[e][0] *= 3.0; o[e][1] *= 3.0; }
+        }
+        t = benchclock();
+        if (i) rfi_power(0, RBATCH, sp);
+        else rfft_power(0, RBATCH, sp);
+        if (i) tr += benchclock() - t;
+        else tp += benchclock() - t;
+      }
+      t = benchclock();
+      if (i) {
+        rfi_fold(0);
+        rfi_buffer();
+        tr += benchclock() - t;
+      }
+      else {
+        accum_add(0, sp, nspec);
+        tp += benchclock() - t;
+      }
+    }
+    accum_get(i ? spec : spec0, nspec);
+    if (i) rfi_end(spec, nspec, nbuf * nper);
+    accum_free();
+  }
+  mask = rfi_mask();
+  nflag = nall = 0;
+  for (i = 0; i < nspec; i++) {
+    nflag += mask[i] > 0;
+    nall += mask[i] == 255;
+  }
+  // clean channels against the plain sum, which has the burst buffer in
+  r = nbad = 0;
+  for (i = 10; i < nspec; i++)
+    if (i != 1000 && i != 2000 && !mask[i]) {
+      r += spec[i] / spec0[i];
+      nbad++;
+    }
+  printf("rfi nspec %d %6.1f us/block plain %6.1f us/block flagged, overhead %5.1f%% of a core at 400 MS/s\n",
+         nspec, tp * 1e6 / (nbuf * nper), tr * 1e6 / (nbuf * nper), 100.0 * (tr - tp) / (nbuf * nper) / (2.0 * nspec / 400e6));
+  printf("rfi mask ch1000 %d ch2000 %d (of 255), %d channels with flags, %d throughout, clean/plain %8.5f (expect %8.5f)\n",
+         mask[1000], mask[2000], nflag, nall, r / nbad, 1280.0 / (1280.0 + 8.0));
+  rfi_free();
+  rfft_free(0);
+  free(sp); free(spec); free(spec0);
+}
+
+static void subbench(void)
+{
+  int nspec, nq, nbuf, nper, nsub, buf, q, i, r;
+  float *p, *sp, *row;
+  double *spec, *rows, t, tp, ts, err, maxerr;
+
+  nspec = 32768;
+  nq = 4;
+  nbuf = 200;
+  nper = 32;    // blocks per DMA buffer
+  nsub = 4;     // buffers per row
+  p = (float *) malloc(sizeof(float) * nspec * 16);
+  sp = (float *) malloc(sizeof(float) * nspec);
+  row = (float *) malloc(sizeof(float) * nspec);
+  spec = (double *) malloc(sizeof(double) * nspec);
+  rows = (double *) calloc(nspec, sizeof(double));
+  for (i = 0; i < nspec * 16; i++) p[i] = nper / nq * (1000.0 + 300.0 * benchnoise());
+  tp = ts = 0;
+  for (r = 0; r < 2; r++) {
+    accum_init(nspec, nq, 1);
+    if (r) accum_sub(1);
+    for (buf = 0; buf < nbuf; buf++) {
+      for (q = 0; q < nq; q++) {
+        memcpy(sp, p + ((buf * nq + q) & 15) * nspec, sizeof(float) * nspec);
+        t = benchclock();
+        accum_add(q, sp, nspec);
+        if (r) ts += benchclock() - t;
+        else tp += benchclock() - t;
+      }
+      if (r && (buf % nsub == nsub - 1 || buf == nbuf - 1)) {
+        t = benchclock();
+        accum_subget(row, 0, nspec);
+        ts += benchclock() - t;
+        for (i = 0; i < nspec; i++) rows[i] += row[i];
+      }
+    }
+    accum_get(spec, nspec);
+    accum_free();
+  }
+  maxerr = 0;
+  for (i = 0; i < nspec; i++) {
+    err = fabs(rows[i] / spec[i] - 1.0);
+    if (err > maxerr) maxerr = err;
+  }
+  printf("subint nspec %d %d quarters, row every %d blocks: %6.2f us/block single %6.2f us/block with rows, overhead %5.2f%% of a core at 400 MS/s\n",
+         nspec, nq, nsub * nper, tp * 1e6 / (nbuf * nper), ts * 1e6 / (nbuf * nper),
+         100.0 * (ts - tp) / (nbuf * nper) / (2.0 * nspec / 400e6));
+  printf("subint rows summed against the integration max rel error %8.2e\n", maxerr);
+  free(p); free(sp); free(row); free(spec); free(rows);
+}
+
+int pxbench(int mode)
+{
+  winconv_init(d1.simd);
+  if (mode == 1 || mode == 2) fftbench();
+  if (mode == 1 || mode == 3) winbench();
+  if (mode == 1 || mode == 4) pfbbench();
+  if (mode == 1 || mode == 5) accbench();
+  if (mode == 1 || mode == 6) dualbench();
+  if (mode == 1 || mode == 7) czbench();
+  if (mode == 1 || mode == 8) rfibench();
+  if (mode == 1 || mode == 9) subbench();
+  return 0;
+}
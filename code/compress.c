@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "compress.h"
+
+// Block codecs for the spectrum archive and raw sample captures, and a
+//  compression stream that encodes and writes blocks on its own thread.
+//  CZ_LZ is a small LZ4-like compressor: a 4-byte hash finds matches up
+//  to 64k back and each sequence is a token (literal count, match length),
+//  the literals and a 16-bit offset. CZ_DELTA is for ADC samples: the
+//  difference from the previous sample is zigzag coded and each run of 128
+//  is packed at the bit width of its largest value, so quiet stretches
+//  take only a few bits per sample
+
+#define LZHASH 13
+#define LZMIN 4
+#define DBLK 128
+
+static const char *cznames[] = {"none", "lz", "shuf+lz", "delta"};
+
+const char *cz_name(int codec)
+{
+  if (codec < 0 || codec > 3) return "?";
+  return cznames[codec];
+}
+
+// worst case output of cz_encode for n bytes in
+size_t cz_bound(size_t n)
+{
+  return sizeof(czframe) + n + n / 255 + n / 64 + 32;
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static uint8_t *lz_len(uint8_t *op, size_t n)
+{
+  for (; n >= 255; n -= 255) *op++ = 255;
+  *op++ = (uint8_t) n;
+  return op;
+}
+
+static size_t lz_enc(const uint8_t *in, size_t n, uint8_t *out)
+{
+  uint32_t ht[1 << LZHASH];
+  size_t ip, anchor, ref, ml, lit, step;
+  uint8_t *op, *tok;
+  uint32_t h, seq;
+
+  memset(ht, 0, sizeof(ht));
+  op = out;
+  ip = anchor = 0;
+  while (n >= 16 && ip + LZMIN + 8 < n) {
+    seq = rd32(in + ip);
+    h = (seq * 2654435761u) >> (32 - LZHASH);
+    ref = ht[h];
+    ht[h] = ip;
+    if (ref >= ip || ip - ref > 65535 || rd32(in + ref) != seq) {
+      step = 1 + ((ip - anchor) >> 6);    // skip faster through data with no matches
+      ip += step < 64 ? step : 64;
+      continue;
+    }
+    for (ml = LZMIN; ip + ml < n && in[ref + ml] == in[ip + ml]; ml++) ;
+    lit = ip - anchor;
+    tok = op++;
+    *tok = (lit < 15 ? lit : 15) << 4 | (ml - LZMIN < 15 ? ml - LZMIN : 15);
+    if (lit >= 15) op = lz_len(op, lit - 15);
+    memcpy(op, in + anchor, lit);
+    op += lit;
+    *op++ = (ip - ref) & 0xff;
+    *op++ = (ip - ref) >> 8;
+    if (ml - LZMIN >= 15) op = lz_len(op, ml - LZMIN - 15);
+    ip += ml;
+    anchor = ip;
+  }
+  // last literals
+  lit = n - anchor;
+  tok = op++;
+  *tok = (lit < 15 ? lit : 15) << 4;
+  if (lit >= 15) op = lz_len(op, lit - 15);
+  memcpy(op, in + anchor, lit);
+  op += lit;
+  return op - out;
+}
+
+static size_t lz_dec(const uint8_t *in, size_t zlen, uint8_t *out, size_t cap)
+{
+  const uint8_t *ip, *end;
+  uint8_t *op, *oend;
+  size_t lit, ml, off, k;
+  unsigned t;
+
+  ip = in;
+  end = in + zlen;
+  op = out;
+  oend = out + cap;
+  while (ip < end) {
+    t = *ip++;
+    lit = t >> 4;
+    if (lit == 15)
+      do { if (ip >= end) return 0; k = *ip++; lit += k; } while (k == 255);
+    if (lit > (size_t) (end - ip) || lit > (size_t) (oend - op)) return 0;
+    memcpy(op, ip, lit);
+    op += lit;
+    ip += lit;
+    if (ip >= end) break;
+    if (end - ip < 2) return 0;
+    off = ip[0] | ip[1] << 8;
+    ip += 2;
+    ml = (t & 15) + LZMIN;
+    if ((t & 15) == 15)
+      do { if (ip >= end) return 0; k = *ip++; ml += k; } while (k == 255);
+    if (off == 0 || off > (size_t) (op - out) || ml > (size_t) (oend - op)) return 0;
+    for (k = 0; k < ml; k++) op[k] = op[k - off];    // may overlap
+    op += ml;
+  }
+  return op - out;
+}
+
+// Byte planes, each stored as differences from the previous byte, so the
+//  sign and exponent planes of a smooth spectrum are mostly zero
+static void shuf(const uint8_t *in, size_t n, int es, uint8_t *out)
+{
+  size_t i, cnt;
+  int b;
+  uint8_t prev, c;
+  cnt = n / es;
+  for (b = 0; b < es; b++)
+    for (i = 0, prev = 0; i < cnt; i++) {
+      c = in[i * es + b];
+      out[b * cnt + i] = c - prev;
+      prev = c;
+    }
+  memcpy(out + cnt * es, in + cnt * es, n - cnt * es);
+}
+
+static void unshuf(const uint8_t *in, size_t n, int es, uint8_t *out)
+{
+  size_t i, cnt;
+  int b;
+  uint8_t prev;
+  cnt = n / es;
+  for (b = 0; b < es; b++)
+    for (i = 0, prev = 0; i < cnt; i++) {
+      prev += in[b * cnt + i];
+      out[i * es + b] = prev;
+    }
+  memcpy(out + cnt * es, in + cnt * es, n - cnt * es);
+}
+
+// sh is the number of low bits that are zero in every sample, 2 for the
+//  14-bit PX14 data. A zigzag delta can take 17 bits, so the packed data
+//  can be longer than the samples: the encoder stops and returns cap as
+//  soon as it would write more than cap bytes
+static size_t delta_enc(const uint16_t *in, size_t ns, uint8_t *out, size_t cap, int *sh)
+{
+  uint32_t z[DBLK], mx;
+  uint64_t acc;
+  size_t i, j, m;
+  int prev, d, b, nb, s;
+  uint8_t *op;
+
+  mx = 0;
+  for (i = 0; i < ns; i++) mx |= in[i];
+  for (s = 0; s < 15 && !(mx & (1u << s)); s++) ;
+  *sh = s;
+  op = out;
+  prev = 0;
+  for (i = 0; i < ns; i += DBLK) {
+    m = ns - i < DBLK ? ns - i : DBLK;
+    mx = 0;
+    for (j = 0; j < m; j++) {
+      d = (int) (in[i + j] >> s) - prev;
+      prev = in[i + j] >> s;
+      z[j] = ((uint32_t) d << 1) ^ (uint32_t) (d >> 31);
+      mx |= z[j];
+    }
+    for (b = 0; mx; b++) mx >>= 1;
+    if ((size_t) (op - out) + 1 + (m * b + 7) / 8 > cap) return cap;
+    *op++ = b;
+    acc = 0;
+    nb = 0;
+    for (j = 0; j < m; j++) {
+      acc |= (uint64_t) z[j] << nb;
+      nb += b;
+      while (nb >= 8) {
+        *op++ = acc & 0xff;
+        acc >>= 8;
+        nb -= 8;
+      }
+    }
+    if (nb > 0) *op++ = acc & 0xff;
+  }
+  return op - out;
+}
+
+static size_t delta_dec(const uint8_t *in, size_t zlen, uint16_t *out, size_t ns, int sh)
+{
+  const uint8_t *ip, *end;
+  uint64_t acc;
+  uint32_t z, mask;
+  size_t i, j, m;
+  int prev, b, nb;
+
+  ip = in;
+  end = in + zlen;
+  prev = 0;
+  for (i = 0; i < ns; i += DBLK) {
+    m = ns - i < DBLK ? ns - i : DBLK;
+    if (ip >= end) return 0;
+    b = *ip++;
+    if (b > 17 || (size_t) (end - ip) < (m * b + 7) / 8) return 0;
+    mask = (1u << b) - 1;
+    acc = 0;
+    nb = 0;
+    for (j = 0; j < m; j++) {
+      while (nb < b) {
+        acc |= (uint64_t) *ip++ << nb;
+        nb += 8;
+      }
+      z = acc & mask;
+      acc >>= b;
+      nb -= b;
+      prev += (int) (z >> 1) ^ -(int) (z & 1);
+      out[i + j] = prev << sh;
+    }
+  }
+  return ns * 2;
+}
+
+// Encode n bytes into a frame at out (cz_bound(n) bytes). elsize is the
+//  value size for CZ_SHUF, and must be 2 for CZ_DELTA. Returns the frame
+//  size
+size_t cz_encode(int codec, int elsize, const void *in, size_t n, void *out)
+{
+  czframe *f;
+  uint8_t *z, *tmp;
+  size_t zlen;
+  int sh;
+
+  f = (czframe *) out;
+  sh = 0;
+  z = (uint8_t *) out + sizeof(czframe);
+  zlen = n;
+  if (elsize < 1) elsize = 1;
+  switch (codec) {
+  case CZ_LZ:
+    zlen = lz_enc((const uint8_t *) in, n, z);
+    break;
+  case CZ_SHUF:
+    if ((tmp = (uint8_t *) malloc(n)) == NULL) break;
+    shuf((const uint8_t *) in, n, elsize, tmp);
+    zlen = lz_enc(tmp, n, z);
+    free(tmp);
+    break;
+  case CZ_DELTA:
+    if ((n & 1) || elsize != 2) break;
+    zlen = delta_enc((const uint16_t *) in, n / 2, z, n, &sh);
+    break;
+  }
+  if (codec <= CZ_NONE || codec > CZ_DELTA || zlen >= n) {
+    codec = CZ_NONE;
+    memcpy(z, in, n);
+    zlen = n;
+  }
+  f->magic = CZMAGIC;
+  f->codec = codec;
+  f->elsize = elsize;
+  f->shift = codec == CZ_DELTA ? sh : 0;
+  f->spare = 0;
+  f->rawlen = n;
+  f->zlen = zlen;
+  return sizeof(czframe) + zlen;
+}
+
+// Decode one frame of zlen bytes into out. Returns the raw length, 0 on error
+size_t cz_decode(const void *in, size_t zlen, void *out, size_t cap)
+{
+  const czframe *f;
+  const uint8_t *z;
+  uint8_t *tmp;
+  size_t n;
+
+  f = (const czframe *) in;
+  if (zlen < sizeof(czframe) || f->magic != CZMAGIC || f->zlen > zlen - sizeof(czframe) || f->rawlen > cap)
+    return 0;
+  z = (const uint8_t *) in + sizeof(czframe);
+  n = 0;
+  switch (f->codec) {
+  case CZ_NONE:
+    if (f->zlen != f->rawlen) return 0;
+    memcpy(out, z, f->zlen);
+    n = f->zlen;
+    break;
+  case CZ_LZ:
+    n = lz_dec(z, f->zlen, (uint8_t *) out, f->rawlen);
+    break;
+  case CZ_SHUF:
+    if ((tmp = (uint8_t *) malloc(f->rawlen)) == NULL) return 0;
+    n = lz_dec(z, f->zlen, tmp, f->rawlen);
+    if (n == f->rawlen) unshuf(tmp, n, f->elsize ? f->elsize : 1, (uint8_t *) out);
+    free(tmp);
+    break;
+  case CZ_DELTA:
+    n = delta_dec(z, f->zlen, (uint16_t *) out, f->rawlen / 2, f->shift & 15);
+    break;
+  }
+  return n == f->rawlen ? n : 0;
+}
+
+
+// Compression stream: cz_write() copies a block into a bounded queue and
+//  returns; the stream thread encodes and appends the frames to the file.
+//  A block is dropped, and counted, if the queue is full
+
+struct czstream
+{
+ FILE *file;
+ int codec, elsize, nq, head, tail, n, run;
+ void **q;
+ size_t *qlen;
+ pthread_t thr;
+ pthread_mutex_t lock;
+ pthread_cond_t cond;
+ double raw, packed, secs, dropped;
+};
+
+static void *cz_thread(void *p)
+{
+  czstream *s = (czstream *) p;
+  void *b, *z;
+  size_t n, zn, zcap;
+  struct timespec tic, toc;
+
+  z = NULL;
+  zcap = 0;
+  pthread_mutex_lock(&s->lock);
+  for (;;) {
+    while (s->n == 0 && s->run) pthread_cond_wait(&s->cond, &s->lock);
+    if (s->n == 0) break;
+    b = s->q[s->tail];
+    n = s->qlen[s->tail];
+    s->tail = (s->tail + 1) % s->nq;
+    s->n--;
+    pthread_mutex_unlock(&s->lock);
+    if (cz_bound(n) > zcap) {
+      free(z);
+      zcap = cz_bound(n);
+      z = malloc(zcap);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &tic);
+    zn = cz_encode(s->codec, s->elsize, b, n, z);
+    clock_gettime(CLOCK_MONOTONIC, &toc);
+    fwrite(z, 1, zn, s->file);
+    free(b);
+    pthread_mutex_lock(&s->lock);
+    s->raw += n;
+    s->packed += zn;
+    s->secs += (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1e9;
+  }
+  pthread_mutex_unlock(&s->lock);
+  free(z);
+  return NULL;
+}
+
+czstream *cz_open(FILE *file, int codec, int elsize, int nq)
+{
+  czstream *s;
+  if ((s = (czstream *) calloc(1, sizeof(czstream))) == NULL) return NULL;
+  s->file = file;
+  s->codec = codec;
+  s->elsize = elsize;
+  s->nq = nq > 0 ? nq : 8;
+  s->q = (void **) calloc(s->nq, sizeof(void *));
+  s->qlen = (size_t *) calloc(s->nq, sizeof(size_t));
+  s->run = 1;
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  if (pthread_create(&s->thr, NULL, cz_thread, s)) {
+    printf("cannot start compression thread\n");
+    free(s->q); free(s->qlen); free(s);
+    return NULL;
+  }
+  return s;
+}
+
+int cz_write(czstream *s, const void *buf, size_t len)
+{
+  void *b;
+  pthread_mutex_lock(&s->lock);
+  if (s->n == s->nq) {
+    s->dropped += len;
+    pthread_mutex_unlock(&s->lock);
+    return -1;
+  }
+  pthread_mutex_unlock(&s->lock);
+  if ((b = malloc(len)) == NULL) return -1;
+  memcpy(b, buf, len);
+  pthread_mutex_lock(&s->lock);
+  s->q[s->head] = b;
+  s->qlen[s->head] = len;
+  s->head = (s->head + 1) % s->nq;
+  s->n++;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  return 0;
+}
+
+// ratio raw / compressed and encode rate in MB/s
+void cz_stats(czstream *s, double *ratio, double *mbs)
+{
+  pthread_mutex_lock(&s->lock);
+  *ratio = s->packed > 0 ? s->raw / s->packed : 0;
+  *mbs = s->secs > 0 ? s->raw / s->secs / 1e6 : 0;
+  pthread_mutex_unlock(&s->lock);
+}
+
+// Finish the queue, stop the thread and report. The file is not closed
+void cz_close(czstream *s)
+{
+  double ratio, mbs;
+  if (s == NULL) return;
+  pthread_mutex_lock(&s->lock);
+  s->run = 0;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->thr, NULL);
+  cz_stats(s, &ratio, &mbs);
+  printf("compress %s %.0f MB ratio %5.2f at %6.1f MB/s, %.0f MB dropped\n",
+         cz_name(s->codec), s->raw / 1e6, ratio, mbs, s->dropped / 1e6);
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->cond);
+  free(s->q); free(s->qlen); free(s);
+}
@@ -0,0 +1,31 @@
+/* Compression for the archives and raw captures (compress.c)
+ *
+ * Each compressed block is a czframe followed by zlen bytes. A block that
+ * does not get smaller is stored with codec CZ_NONE */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define CZ_NONE 0
+#define CZ_LZ 1       // byte oriented LZ77, LZ4 style sequences
+#define CZ_SHUF 2     // delta coded byte planes of elsize byte values, then CZ_LZ
+#define CZ_DELTA 3    // 16-bit samples: delta, zigzag, bit packed per 128
+#define CZMAGIC 0x315a4343    // "CCZ1"
+
+typedef struct
+{
+ uint32_t magic;
+ uint8_t codec, elsize, shift, spare;    // shift: CZ_DELTA zero low bits
+ uint32_t rawlen, zlen;
+} czframe;
+
+typedef struct czstream czstream;
+
+const char *cz_name (int);
+size_t cz_bound (size_t);
+size_t cz_encode (int, int, const void *, size_t, void *);
+size_t cz_decode (const void *, size_t, void *, size_t);
+czstream *cz_open (FILE *, int, int, int);
+int cz_write (czstream *, const void *, size_t);
+void cz_close (czstream *);
+void cz_stats (czstream *, double *, double *);
@@ -1,13 +1,8 @@
 /* globals */
 #include <gtk/gtk.h>
-extern float avspec[];
-extern float win0[],win1[];
-extern float win2[],win3[];
 //extern double reamin0[],reamin1[],reamout0[],reamout1[];
 //extern float reamin0[],reamin1[],reamout0[],reamout1[];
 //extern float reamin2[],reamin3[],reamout2[],reamout3[];
-extern float spec0[],spec1[];
-extern float spec2[],spec3[];
 extern GdkPixmap *pixmap;
 extern GdkFont *fixed_font;
 extern GtkWidget *table;
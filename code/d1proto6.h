@@ -8,7 +8,7 @@ double readclock (void);
 void plotspec (int);
 void plotp (double);
 int disp(void);
-gint Repaint (double);
+gint Repaint (const d1type *, const float *);
 void cleararea (void);
 void quit (void);
 void vquit (void);
@@ -20,6 +20,77 @@ void button_exit_clicked (void);
 gint button_press_event (GtkWidget *,GdkEventButton *);
 
 void clearpaint (void);
+int pool_init (int);
+void pool_free (void);
+void pool_submit (void (*)(int), int);
+void pool_wait (void);
+void pool_stats (int);
+int pxbench (int);
+const float *window_get (int, int, double);
+const char *window_name (int);
+void window_free (void);
+void pfb_init (int, int);
+void pfb_free (void);
+void pfb_save (const unsigned short *, int);
+void pfb_reset (void);
+int pfb_fir (const unsigned short *, int, float *);
+void accum_init (int, int, int);
+void accum_free (void);
+const char *accum_name (int);
+void accum_clear (void);
+void accum_add (int, float *, int);
+void accum_addr (int, float *, int, int);
+void accum_get (double *, int);
+void accum_sub (int);
+void accum_subget (float *, int, int);
+void winconv_init (int);
+const char *winconv_name (void);
+void winconv (const unsigned short *, const float *, float *, int, float *);
+void winconv2 (const unsigned short *, const float *, float *, float *, int);
+void xspfile (const d1type *, const double *, int);
+void acqwrite (d1type *, const double *, int, int);
+void acqclose (void);
+int writer_init (void);
+int writer_submit (void (*)(void *), const void *, size_t, int);
+void writer_flush (void);
+void writer_free (void);
+int writer_pending (void);
+int statseg_init (const char *, int, int, char **, int, int, int);
+void statseg_free (void);
+void statseg_spec (const d1type *, const double *, int);
+void statseg_cycle (int, double);
+int rawcap_init (int);
+int rawcap_keep (const unsigned short *);
+const unsigned short *rawcap_done (void);
+void rawcap_flush (void);
+void rawcap_free (void);
+void rfi_init (int, int, float **, int);
+void rfi_free (void);
+void rfi_clear (void);
+void rfi_power (int, int, float *);
+void rfi_fold (int);
+void rfi_buffer (void);
+void rfi_end (double *, int, int);
+const unsigned char *rfi_mask (void);
+void rfifile (const d1type *, const unsigned char *, int);
+int disp_init (int *, char ***, int);
+void disp_free (void);
+void disp_post (const d1type *, const double *, int);
+void disp_file (const char *);
+void parport (int);
+void sw_init (int);
+int sw_nblock (int, int);
+void sw_set (int);
+void sw_queue (int);
+void sw_end (void);
+double sw_valid (void);
+int http_init (int, const char *, const char *);
+void http_free (void);
+void http_row (double, int, const float *, int);
+void subint_init (int, int);
+void subint_free (void);
+void subint_clear (void);
+void subint_buffer (int, int);
 void vclearpaint (void);
 
 
@@ -1,6 +1,12 @@
+#define NQMAX 16    // most procspec quarters
+#define RBATCH 4    // blocks per batched real input FFT
 typedef struct
 {
- double secs,fstart,fstop,fstep,fres,temp,totp,stim,adcmax,adcmin,mfreq;
- int foutstatus,rday,disp,sim,run,printout,mode,maxindex,numblk,nspec,dwin;
+ double secs,fstart,fstop,fstep,fres,temp,totp,stim,adcmax,adcmin,mfreq,dropped,kbeta,rawper,rawrate,rfi,settle;
+ double dwell[3];
+ int foutstatus,rday,disp,sim,run,printout,mode,maxindex,numblk,nspec,dwin,novfl,nquart,rfft,tune,simd,wtype,pfb,accum,dual,afmt,stattxt,comp,rawtrig,rawpre,rawpost,rawcomp,subint,http,nsettle,wdrop;
  char filname[80];
+ char wisdir[80];
+ char statname[80];
+ char httpaddr[80];
 } d1type;
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "d1typ6.h"
+#include "d1glob6.h"
+#include "d1proto6.h"
+
+// Display thread for -disp 1. The acquisition loop only copies each
+//  integrated spectrum into a triple buffer with disp_post(); the thread
+//  owns gtk from then on, picks up the latest spectrum at most DISPHZ times
+//  a second and draws it decimated to the plot width, with the log taken
+//  per pixel column. It runs at SCHED_IDLE so it never takes a core from
+//  the acquisition or the pool workers. Spectra posted faster than it
+//  draws are skipped, never queued
+
+#define DISPHZ 4
+#define DISPNEW 4    // set in dispmid when it holds an unseen spectrum
+
+static float *dispsp[3];
+static d1type dispd[3];
+static volatile int dispmid;    // slot shared between the two sides
+static int dispback, dispfront, dispn, dispon;
+static pthread_t dispthr;
+static char dispfile[80];    // file being written, from the writer thread
+static pthread_mutex_t displock = PTHREAD_MUTEX_INITIALIZER;
+
+static gboolean disptick(gpointer);
+static gboolean dispquit(gpointer);
+
+static void *dispthread(void *arg)
+{
+  (void) arg;
+  disp();
+  g_timeout_add(1000 / DISPHZ, disptick, NULL);
+  gtk_main();
+  pthread_exit(NULL);
+}
+
+// gtk_init() is done here, before the thread, as the mains did it. n is
+//  the number of spectrum channels
+int disp_init(int *argc, char ***argv, int n)
+{
+  int i;
+  struct sched_param sp;
+
+#if !GLIB_CHECK_VERSION(2,32,0)
+  if (!g_thread_supported()) g_thread_init(NULL);
+#endif
+  gtk_init(argc, argv);
+  for (i = 0; i < 3; i++)
+    if ((dispsp[i] = (float *) calloc(n, sizeof(float))) == NULL) {
+      printf("cannot allocate display buffers\n");
+      return -1;
+    }
+  dispn = n;
+  dispback = 0;
+  dispmid = 1;
+  dispfront = 2;
+  if (pthread_create(&dispthr, NULL, dispthread, NULL)) {
+    printf("error creating display thread - no display\n");
+    return -1;
+  }
+  memset(&sp, 0, sizeof(sp));
+  if (pthread_setschedparam(dispthr, SCHED_IDLE, &sp))
+    printf("display thread not at idle priority\n");
+  dispon = 1;
+  return 0;
+}
+
+void disp_free(void)
+{
+  int i;
+  if (!dispon) return;
+  g_idle_add(dispquit, NULL);
+  pthread_join(dispthr, NULL);
+  dispon = 0;
+  for (i = 0; i < 3; i++) {
+    free(dispsp[i]);
+    dispsp[i] = NULL;
+  }
+}
+
+// Acquisition side: hand over spec[0..n-1] from px14run() with the
+//  integration's d1. Never waits
+void disp_post(const d1type *d, const double *spec, int n)
+{
+  int i, old;
+  float *sp;
+
+  if (!dispon) return;
+  if (n > dispn) n = dispn;
+  sp = dispsp[dispback];
+  for (i = 0; i < n; i++) sp[i] = spec[i];
+  dispd[dispback] = *d;
+  dispd[dispback].nspec = n;
+  dispd[dispback].secs = readclock();
+  __sync_synchronize();
+  old = __sync_lock_test_and_set(&dispmid, dispback | DISPNEW);
+  dispback = old & 3;
+}
+
+// Writer side: the output file name changed, for the plot label
+void disp_file(const char *name)
+{
+  pthread_mutex_lock(&displock);
+  strncpy(dispfile, name, sizeof(dispfile) - 1);
+  pthread_mutex_unlock(&displock);
+}
+
+static gboolean disptick(gpointer data)
+{
+  int i, old;
+  d1type *d;
+  float *sp;
+  double totp;
+
+  (void) data;
+  if (!(dispmid & DISPNEW)) return TRUE;
+  old = __sync_lock_test_and_set(&dispmid, dispfront);
+  dispfront = old & 3;
+  d = &dispd[dispfront];
+  sp = dispsp[dispfront];
+  pthread_mutex_lock(&displock);
+  strcpy(d->filname, dispfile);
+  pthread_mutex_unlock(&displock);
+  totp = 0.0;
+  for (i = (int)(80.0*d->nspec/210.0); i < d->nspec; i++) totp += sp[i];
+  d->totp = totp;
+  clearpaint();
+  Repaint(d, sp);
+  return TRUE;
+}
+
+static gboolean dispquit(gpointer data)
+{
+  (void) data;
+  gtk_main_quit();
+  return FALSE;
+}
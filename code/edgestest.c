@@ -8,20 +8,82 @@
 #include <sched.h>
 #include <fcntl.h>
 #include <complex.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lsq.h"
+#include "lnasim.h"
+#include "mcsweep.h"
+#include "lmfit.h"
 #define PI 3.1415926536
+#define SWMAXFIT 100    // most -pfit terms for -sweep
+
+typedef struct
+{
+ int jj, n, open;
+ double fre, spind, gnd, tamb, tcal, cal3;
+ lnapar lna;
+ const double *freqq, *rr_ant, *ii_ant;    // grid and antenna impedance
+ double *tsky, *zr, *zi, *pwr;             // per pass
+} simpass;
+
+typedef struct
+{
+ simpass *p;
+ int np;
+ volatile int next;
+} simjob;
+
+typedef struct
+{
+ simpass p;               // nominal pass, jj and buffers set per sample
+ lsqws *ws;               // factored basis
+ const double *fitfn;
+ int fit;
+ double t150;
+ double *buf;             // 13 x nfreq per thread
+} sweepctx;
+
+typedef struct
+{
+ simpass p[4];            // cal, load, galaxy reference, spectral index derivative
+ int n, fit, nthr;
+ double *buf;             // 10 x n per pass
+ const double *par;
+ double *f, *jac;
+ volatile int next;
+} lmmodel;
+
+typedef struct
+{
+ const simpass *proto;
+ int fit, nfreq, ns;
+ const double *y, *w;
+ double *par, *chi2;      // fit + 3 parameters per spectrum
+ int *it;
+ volatile int next;
+} lmjob;
 
 void plotfspec(int,int,int,double*,double*,double*);
 double sim(double, double, complex double,double,double);
+void runpasses(simpass *, int, int);
+static complex double passin(const simpass *, int, double *, complex double *);
+int sweepsample(const double *, double *, void *, int);
 double balun(complex double,double,double,double);
 double polyfitr(int, int, double*, double*, double *, double *, double *);
+void polyinv(int, int, double*, double*, double *, double *);
 double fitfun(int,int,int,double*);
 void MatrixInvert(int);
 double rmscalc2(int,double *,double*);
 
 int readdata(double *,double *,double *);
+int batchfit(char *, int, int, int, double *, double *, double, double, const simpass *);
+int lmcal(const simpass *, int, const double *, const double *, double *, int, int, double *, double *);
 
 char fname[256]; 
 static double inverr;
+static int lsqmode;   // 0 MatrixInvert, 1 Cholesky, 2 QR
+static int nthr;      // threads for -batch, -sweep and -lm, 0 for one per cpu
+static int lmit;      // -lm: iterations of the nonlinear fit, 0 for none
 
 
 static long double aarr[10000];    // long double needed for accurate matrix inversion
@@ -32,32 +94,58 @@ static double mcalc[65536*20];
 
 int main(int argc, char *argv[])
 { int n,jj,i,pfit,plot;
-  int nt,npp,mpoly,nfreq,open,fit;
-  double delay,spind,freq,phi,tsky,cf,ccf,fstep,cal2,cal3,cal4,a,fre;
-  double fstart,fstop,gnd,frst,frstp,frstep,tamb,tcal,tpeak,t150;
+  int nt,npp,mpoly,nfreq,open,fit,nsim;
+  double spind,freq,cf,ccf,fstep,cal2,cal3,cal4,a,fre;
+  double fstart,fstop,gnd,frst,frstp,frstep,tamb,tcal,tpeak,t150,step;
+  double *simbuf;
+  simpass *pass;
+  lnapar lna;
+  sweepctx sw;
+  int nsweep;
+  unsigned long long seed;
+  static const char *swpar[] = {"cal2","cal3","cal4","tau","lin","cin"};
+  static const char *swres[] = {"rms","t150","spind"};
+  double swnom[6];
+  simpass proto;
+  double lmp[LMMAXP],chi2,secs;
+  struct timespec t0,t1;
   static double freqq[100000],fitfn[200000],data[100000],dataout[100000],wtt[100000],polycfr[100],polycfi[100];
   static double ffreq[100000],ddata[100000],wt[100000];
   static double galdn[100000],tload[100000],cal[100000],fitf[10000];
   static double r4_ant[] = {18,10,6.6,5.7,8.2,15,31,53,67,63.6,52,44,40,36.8,37.3,41,46.5};  // 17.5" ant Balun short Anritsu 23 Oct 10 on radar plate
   static double i4_ant[] = {-123,-88,-61,-40,-19.4,-1.5,15,17,0.7,-10,-13.7,-9.6,-2.9,6.4,17.7,28,43};
   static double rr_ant[100000],ii_ant[100000];
-  complex double Zin,tf;
-  char buf[256];
+  FILE *file;
+  char buf[256],batch[256],sweep[256],swout[256];
 
  plot=2; npp=0; gnd=0; tamb=300.0; tcal = 1000.0;
  open=0; fit=0; cal3 = 0;
  cal2 = -13; cal4 = -10;
  mpoly = 15; inverr = -1e99; 
+ lsqmode = 1; nthr = 0; batch[0] = 0; step = 0;
+ lmit = 0; sweep[0] = 0; nsweep = 1000; seed = 1; strcpy(swout,"sweep.out");
  for(i=0;i<argc;i++){
   sscanf(argv[i], "%79s", buf);
   if (strstr(buf, "-open")) { sscanf(argv[i+1], "%d",&open);}
   if (strstr(buf, "-pfit")) { sscanf(argv[i+1], "%d",&fit);}
+  if (strstr(buf, "-lsq")) { sscanf(argv[i+1], "%d",&lsqmode);}
+  if (strstr(buf, "-nthr")) { sscanf(argv[i+1], "%d",&nthr);}
+  if (strstr(buf, "-step")) { sscanf(argv[i+1], "%lf",&step);}
+  if (strstr(buf, "-batch")) { sscanf(argv[i+1], "%255s",batch);
+     if((file = fopen(batch, "r")) != NULL){ if(fscanf(file, "%255s", fname) == 1) npp = readdata(ffreq,ddata,wt); fclose(file);} }
+  if (strstr(buf, "-lm")) { sscanf(argv[i+1], "%d",&lmit);}
+  if (strstr(buf, "-sweep")) { sscanf(argv[i+1], "%255s",sweep);}
+  if (strstr(buf, "-nsweep")) { sscanf(argv[i+1], "%d",&nsweep);}
+  if (strstr(buf, "-swout")) { sscanf(argv[i+1], "%255s",swout);}
+  if (strstr(buf, "-seed")) { sscanf(argv[i+1], "%llu",&seed);}
   if (strstr(buf, "-f")) {sscanf(argv[i+1], "%s", fname); npp = readdata(ffreq,ddata,wt); }
        }
+  if(lmit && fit+3 > LMMAXP) { printf("-lm needs -pfit %d or less\n",LMMAXP-3); return 0; }
   fstart = 80+10; fstop = 160-10; fre = 150;
   if(npp) {fstart = ffreq[0]; fstop = ffreq[npp-1]; fre = ffreq[npp/2]; }
   fstep = 0.5;
   if(npp) fstep = (fstop-fstart)/npp;
+  else if(step > 0) fstep = step;   // simulated grid only
   printf("npp %d fstep %f\n",npp,fstep);
   nt=nfreq=0;
   n=0;
@@ -86,7 +174,10 @@ int main(int argc, char *argv[])
   printf("rms_imag %5.1f\n",rmscalc2(n,ii_ant,wtt));
   for(i=0;i<pfit;i++) polycfi[i]=bbrr[i];
   t150 = 300.0; spind = -2.5;
-  for(jj=-2;jj<1+fit;jj++){
+  cf = 1.0+cal4*0.01; 
+  ccf = 1.0+cal2*0.01;
+  lna_nominal(&lna); lna.cf = cf; lna.ccf = ccf;
+  // antenna impedance on the grid, the same for every pass
   n=0; 
   for(freq=fstart;freq<=fstop;freq+=fstep){
   rr_ant[n] =  polycfr[0];
@@ -97,42 +188,27 @@ int main(int argc, char *argv[])
                        rr_ant[n] += polycfr[i]*a;
                        ii_ant[n] += polycfi[i]*a;
    }
-
-  Zin = 0;
-  cf = 1.0+cal4*0.01; 
-  ccf = 1.0+cal2*0.01;
-
-  tsky=300.0*pow(freq/150.0,spind -0.12*log(freq/150.0)) + 3.0 + gnd;
-
-  if(jj >= 0) {
-         t150 = 300.0;
-         if(jj==1) tsky = t150*pow(freq/150.0,spind -0.12*log(freq/150.0)) + 3.0 + gnd;   // galaxy reference
-         if(jj==2) tsky = t150*pow(freq/150.0,spind-0.01 -0.12*log(freq/150.0)) + 3.0 + gnd;  // derivative with spectral index
-         Zin = rr_ant[n] + I*ii_ant[n];
-         tsky = balun(Zin,tsky,freq,tamb);
-         tf = (Zin - 50.0)/(Zin + 50.0);
-
-  if(open){
-           tsky = tamb;
-           delay = 15.1e-9;   // end of cable is critical
-           tf = pow(10.0,-0.05*((0.242080*sqrt(freq)+0.000330*freq)*delay*0.983e7*0.84)); // measured 0.94 at 150 MHz
-//           printf("freq %f tf %f\n",freq,creal(tf));
-           phi = -2.0*PI*freq*1e06*delay;
-           tf = tf*(cos(phi)+I*sin(phi));   // LMR-240  3db/100ft 150 MHz
-           if(open==2) tf=1.0;   // open at connector
-           if(open==3) tf=-1.0;  // short at connector
-           if(open==4) {tsky = t150 = 1200; tf=0;}   // for test noise fed into EDGES
-            }
-
-         delay = 1.1e-9+1e-9*cal3;   // cable delay inside LNA box
-         tf = tf*pow(10.0,-0.05*((0.242080*sqrt(freq)+0.000330*freq)*delay*0.983e7*0.84+0.1));  // small added loss for switch and bends
-         phi = -2.0*PI*freq*1e06*delay;
-         tf = tf*(cos(phi)+I*sin(phi));   // LMR-240  3db/100ft 150 MHz
-         Zin = 50.0*(tf+1.0)/(1.0-tf);
-            }
-  if(jj==-1) {  Zin = 50.0;  tsky = tamb; }  // 3-pos sw
-  if(jj==-2) {  Zin = 50.0;  tsky = tamb + tcal;}  // 3-pos 
-  data[n] = sim(freq,tsky/tamb,Zin,cf,ccf);    // simulate LNA
+  freqq[n] = freq;
+  n++;
+  }
+  nfreq = n;
+  nsim = fit < 2 ? fit + 3 : 5;   // from jj = 3 on the passes are only curvature terms
+  pass = (simpass *) calloc(nsim, sizeof(simpass));
+  simbuf = (double *) malloc((size_t) 4 * nsim * nfreq * sizeof(double));
+  if(pass == NULL || simbuf == NULL) { printf("cannot allocate %d passes\n",nsim); return 0; }
+  for(i=0;i<nsim;i++){
+  pass[i].jj = i-2; pass[i].n = nfreq; pass[i].open = open;
+  pass[i].fre = fre; pass[i].spind = spind; pass[i].gnd = gnd; pass[i].tamb = tamb; pass[i].tcal = tcal;
+  pass[i].cal3 = cal3; pass[i].lna = lna;
+  pass[i].freqq = freqq; pass[i].rr_ant = rr_ant; pass[i].ii_ant = ii_ant;
+  pass[i].tsky = simbuf + (size_t) 4*i*nfreq; pass[i].zr = pass[i].tsky + nfreq;
+  pass[i].zi = pass[i].zr + nfreq; pass[i].pwr = pass[i].zi + nfreq;
+  }
+  runpasses(pass,nsim,nthr);
+  for(jj=-2;jj<1+fit;jj++){
+  for(n=0;n<nfreq;n++){
+  freq = freqq[n];
+  if(jj < 3) data[n] = pass[jj+2].pwr[n];    // simulate LNA
   if(jj==-2) cal[n]=data[n];
   if(jj==-1) tload[n]=data[n];
   if(jj==0) galdn[n]=tcal*((data[n]-tload[n])/(cal[n]-tload[n]))+tamb;  // can be used as test data
@@ -140,18 +216,51 @@ int main(int argc, char *argv[])
   if(jj==2) fitfn[n+(jj-1)*nfreq] = fitfn[n]-(tcal*((data[n]-tload[n])/(cal[n]-tload[n]))+tamb); // include spectral index
   if(jj >= 3)  fitfn[n+(jj-1)*nfreq] = pow(freq-fre,jj-1); // first term curvature 
   wtt[n] = 1;
-  freqq[n] = freq;
-  n++;
   }
-  nfreq = n;
   }
+  t150 = open==4 ? 1200 : 300;   // as the sky pass leaves it
+  if(sweep[0]){
+   // the nominal basis fitted to skies seen through varied LNAs
+   if(fit < 2 || fit > SWMAXFIT) { printf("-sweep needs -pfit 2 to %d\n",SWMAXFIT); return 0; }
+   for(i=0;i<nfreq;i++) wtt[i] = 1;
+   sw.p = pass[0]; sw.fitfn = fitfn; sw.fit = fit; sw.t150 = t150;
+   sw.ws = lsq_alloc(nfreq,fit);
+   sw.buf = (double *) malloc((size_t) 13 * nfreq * mc_threads(nthr) * sizeof(double));
+   if(sw.ws == NULL || sw.buf == NULL || lsq_factor(sw.ws,fitfn,wtt)) { printf("sweep: cannot factor basis\n"); return 0; }
+   swnom[0] = cal2; swnom[1] = cal3; swnom[2] = cal4; swnom[3] = lna.tau; swnom[4] = lna.lin; swnom[5] = lna.cin;
+   mc_run(sweep,swpar,swnom,6,swres,3,nsweep,seed,nthr,swout,sweepsample,&sw);
+   lsq_free(sw.ws); free(sw.buf);
+   return 0;
+  }
+  proto = pass[0];   // for -lm, which runs the passes itself
+  free(pass); free(simbuf);
  for(i=0;i<n;i++) data[i] = ddata[i];
+ if(batch[0]){
+   if(fit < 2 || !npp) printf("-batch needs -pfit 2 or more and spectra\n");
+   else batchfit(batch,fit,n,npp,ffreq,fitfn,t150,spind,&proto);
+   return 0;
+ }
  if(fit){
  polyfitr(fit,n,data,mcalc,wt,dataout,fitfn);
  tpeak = bbrr[0]*t150;
  t150=tpeak;
  spind = spind+bbrr[1]*0.01;
  printf("fit t150(K) %4.0f specindex %8.3f rms %8.3f\n",tpeak,spind,rmscalc2(n,data,wt));
+ if(lmit && fit >= 2){
+   // from the linear fit on, cal2, cal3 and cal4 free as well
+   for(i=0;i<fit;i++) lmp[i] = bbrr[i];
+   lmp[fit] = cal2; lmp[fit+1] = cal3; lmp[fit+2] = cal4;
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   i = lmcal(&proto,fit,ddata,wt,lmp,lmit,nthr,&chi2,dataout);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+   for(a=0,jj=0;jj<n;jj++) if(wt[jj] > 0) a += wt[jj];
+   if(i < 0) printf("lm fit failed\n");
+   else printf("lm t150(K) %4.0f specindex %8.3f cal2 %7.3f cal3 %7.4f cal4 %7.3f rms %8.3f it %d %.4f s\n",
+               lmp[0]*(open==4 ? 1200 : 300),spind-bbrr[1]*0.01+lmp[1]*0.01,lmp[fit],lmp[fit+1],lmp[fit+2],
+               a > 0 ? sqrt(chi2/a) : 0,i,secs);
+ }
+ else if(lmit) printf("-lm needs -pfit 2 or more\n");
  for(i=0;i<n;i++) data[i] = dataout[i];
  }
  else  for(i=0;i<n;i++) data[i] = galdn[i];
@@ -159,6 +268,246 @@ int main(int argc, char *argv[])
   return 0;
 }
 
+// One pass of the simulated 3-position switch calibration: jj -2 is the
+//  load with the cal on, -1 the load, 0 the sky and 1, 2 the galaxy
+//  reference and its spectral index derivative. passin() gives the input
+//  at grid point n: tsky as a ratio to ambient and the impedance the LNA
+//  sees, with its derivative on cal3 in dz if that is not NULL
+static complex double passin(const simpass *p, int n, double *tsky, complex double *dz)
+{
+  int jj;
+  double freq,t150,delay,phi,a;
+  complex double Zin,tf;
+
+  jj = p->jj;
+  freq = p->freqq[n];
+  Zin = 0;
+  if(dz) *dz = 0;
+  *tsky=300.0*pow(freq/150.0,p->spind -0.12*log(freq/150.0)) + 3.0 + p->gnd;
+
+  if(jj >= 0) {
+         t150 = 300.0;
+         if(jj==1) *tsky = t150*pow(freq/150.0,p->spind -0.12*log(freq/150.0)) + 3.0 + p->gnd;   // galaxy reference
+         if(jj==2) *tsky = t150*pow(freq/150.0,p->spind-0.01 -0.12*log(freq/150.0)) + 3.0 + p->gnd;  // derivative with spectral index
+         Zin = p->rr_ant[n] + I*p->ii_ant[n];
+         *tsky = balun(Zin,*tsky,freq,p->tamb);
+         tf = (Zin - 50.0)/(Zin + 50.0);
+
+  if(p->open){
+           *tsky = p->tamb;
+           delay = 15.1e-9;   // end of cable is critical
+           tf = pow(10.0,-0.05*((0.242080*sqrt(freq)+0.000330*freq)*delay*0.983e7*0.84)); // measured 0.94 at 150 MHz
+           phi = -2.0*PI*freq*1e06*delay;
+           tf = tf*(cos(phi)+I*sin(phi));   // LMR-240  3db/100ft 150 MHz
+           if(p->open==2) tf=1.0;   // open at connector
+           if(p->open==3) tf=-1.0;  // short at connector
+           if(p->open==4) {*tsky = t150 = 1200; tf=0;}   // for test noise fed into EDGES
+            }
+
+         delay = 1.1e-9+1e-9*p->cal3;   // cable delay inside LNA box
+         a = -0.05*(0.242080*sqrt(freq)+0.000330*freq)*0.983e7*0.84;   // log10 loss per s of delay
+         tf = tf*pow(10.0,a*delay-0.005);  // small added loss for switch and bends
+         phi = -2.0*PI*freq*1e06*delay;
+         tf = tf*(cos(phi)+I*sin(phi));   // LMR-240  3db/100ft 150 MHz
+         Zin = 50.0*(tf+1.0)/(1.0-tf);
+         if(dz) *dz = 100.0/((1.0-tf)*(1.0-tf))*tf*(a*log(10.0) - I*2.0*PI*freq*1e06)*1e-9;
+            }
+  if(jj==-1) {  Zin = 50.0;  *tsky = p->tamb; }  // 3-pos sw
+  if(jj==-2) {  Zin = 50.0;  *tsky = p->tamb + p->tcal;}  // 3-pos 
+  *tsky /= p->tamb;
+  return Zin;
+}
+
+// The passes only meet when they are combined, so runpasses() spreads them
+//  over threads, and each runs the LNA model over the whole grid in one
+//  lna_sim() call
+static void *runpass(void *arg)
+{
+  simjob *job;
+  simpass *p;
+  int n,jj;
+  double tsky;
+  complex double Zin;
+
+  job = (simjob *) arg;
+  while((jj = __sync_fetch_and_add(&job->next, 1)) < job->np){
+  p = &job->p[jj];
+  for(n=0;n<p->n;n++){
+  Zin = passin(p,n,&tsky,NULL);
+  p->tsky[n] = tsky;
+  p->zr[n] = creal(Zin);
+  p->zi[n] = cimag(Zin);
+  }
+  lna_sim(p->n,p->freqq,p->tsky,p->zr,p->zi,&p->lna,p->pwr);
+  }
+  return NULL;
+}
+
+// np passes on nthr threads, one per cpu for 0
+void runpasses(simpass *p, int np, int nthr)
+{
+  simjob job;
+  pthread_t thr[64];
+  int i,nt;
+
+  if(nthr <= 0) nthr = sysconf(_SC_NPROCESSORS_ONLN);
+  if(nthr > np) nthr = np;
+  if(nthr > 64) nthr = 64;
+  job.p = p; job.np = np; job.next = 0;
+  for(nt=0;nt<nthr-1;nt++) if(pthread_create(&thr[nt],NULL,runpass,&job)) break;
+  runpass(&job);
+  for(i=0;i<nt;i++) pthread_join(thr[i],NULL);
+}
+
+// -sweep: one simulated calibration with parameters {cal2,cal3,cal4,tau,
+//  lin,cin}, fitted with the nominal basis. Gives the rms of the fit and
+//  t150 and spectral index as the instrument would report them
+int sweepsample(const double *par, double *res, void *arg, int thr)
+{
+  sweepctx *sw;
+  simpass p[3];
+  simjob job;
+  double *b,*g,c[SWMAXFIT],r,rms;
+  int i,j,n;
+
+  sw = (sweepctx *) arg;
+  n = sw->p.n;
+  b = sw->buf + (size_t) 13*thr*n;
+  for(i=0;i<3;i++){
+  p[i] = sw->p;
+  p[i].jj = i-2; p[i].cal3 = par[1];
+  p[i].lna.ccf = 1.0+par[0]*0.01; p[i].lna.cf = 1.0+par[2]*0.01;
+  p[i].lna.tau = par[3]; p[i].lna.lin = par[4]; p[i].lna.cin = par[5];
+  p[i].tsky = b + (size_t) 4*i*n; p[i].zr = p[i].tsky + n;
+  p[i].zi = p[i].zr + n; p[i].pwr = p[i].zi + n;
+  }
+  job.p = p; job.np = 3; job.next = 0;
+  runpass(&job);   // in this thread, the sweep keeps the others busy
+  g = b + (size_t) 12*n;
+  for(i=0;i<n;i++) g[i] = p[0].tcal*((p[2].pwr[i]-p[1].pwr[i])/(p[0].pwr[i]-p[1].pwr[i]))+p[0].tamb;
+  if(lsq_solve(sw->ws,g,1,c,NULL,1)) return -1;
+  rms = 0;
+  for(i=0;i<n;i++){
+  r = g[i];
+  for(j=0;j<sw->fit;j++) r -= c[j]*sw->fitfn[i+j*n];
+  rms += r*r;
+  }
+  res[0] = sqrt(rms/n);
+  res[1] = c[0]*sw->t150;
+  res[2] = sw->p.spind+c[1]*0.01;
+  return 0;
+}
+
+// -lm: the -pfit model with the receiver free. The parameters are the fit
+//  amplitudes, then cal2, cal3 and cal4; every evaluation runs the cal,
+//  load and both galaxy passes again, and for the Jacobian lna_jac() gives
+//  the LNA derivatives, taken on to cal3 through passin()'s dz. The balun
+//  comes before the cable delay and does not depend on any of the three.
+//  The grid goes in chunks to the threads, which only read the passes
+#define LMCHUNK 64
+
+static void *lmchunk(void *arg)
+{
+  lmmodel *m;
+  const simpass *p;
+  int i,j,k,lo,hi,nn,n,fit;
+  double *b,*dp[4],*pw[4],*dzr[4],*dzi[4],tsky,x,xp,cl,sl,gg[2],dg[2][3],dq[4][3];
+  complex double Zin,dz;
+
+  m = (lmmodel *) arg;
+  n = m->n; fit = m->fit;
+  while((lo = LMCHUNK*__sync_fetch_and_add(&m->next, 1)) < n){
+  hi = lo+LMCHUNK < n ? lo+LMCHUNK : n;
+  nn = hi-lo;
+  for(k=0;k<4;k++){
+  p = &m->p[k];
+  b = m->buf + (size_t) 10*k*n;
+  pw[k] = p->pwr; dp[k] = b+4*n+4*lo; dzr[k] = b+8*n; dzi[k] = b+9*n;
+  for(i=lo;i<hi;i++){
+  Zin = passin(p,i,&tsky,m->jac ? &dz : NULL);
+  p->tsky[i] = tsky; p->zr[i] = creal(Zin); p->zi[i] = cimag(Zin);
+  if(m->jac) { dzr[k][i] = creal(dz); dzi[k][i] = cimag(dz); }
+  }
+  if(m->jac) lna_jac(nn,p->freqq+lo,p->tsky+lo,p->zr+lo,p->zi+lo,&p->lna,p->pwr+lo,dp[k]);
+  else lna_sim(nn,p->freqq+lo,p->tsky+lo,p->zr+lo,p->zi+lo,&p->lna,p->pwr+lo);
+  }
+  for(i=lo;i<hi;i++){
+  cl = pw[0][i]-pw[1][i];
+  for(k=0;k<2;k++) gg[k] = m->p[0].tcal*((pw[k+2][i]-pw[1][i])/cl)+m->p[0].tamb;
+  x = m->p[0].freqq[i]-m->p[0].fre;
+  m->f[i] = m->par[0]*gg[0]+m->par[1]*(gg[0]-gg[1]);
+  for(j=2,xp=x*x;j<fit;j++,xp*=x) m->f[i] += m->par[j]*xp;
+  if(!m->jac) continue;
+  // power of each pass on cal2, cal3, cal4, then the calibrated galaxy passes
+  for(k=0;k<4;k++){
+  j = i-lo;
+  dq[k][0] = dp[k][j+3*nn]*0.01;
+  dq[k][1] = dp[k][j]*dzr[k][i]+dp[k][j+nn]*dzi[k][i];
+  dq[k][2] = dp[k][j+2*nn]*0.01;
+  }
+  for(k=0;k<2;k++){
+  sl = pw[k+2][i]-pw[1][i];
+  for(j=0;j<3;j++) dg[k][j] = m->p[0].tcal*((dq[k+2][j]-dq[1][j])*cl-sl*(dq[0][j]-dq[1][j]))/(cl*cl);
+  }
+  m->jac[i] = gg[0];
+  m->jac[i+n] = gg[0]-gg[1];
+  for(j=2,xp=x*x;j<fit;j++,xp*=x) m->jac[i+(size_t)j*n] = xp;
+  for(j=0;j<3;j++) m->jac[i+(size_t)(fit+j)*n] = m->par[0]*dg[0][j]+m->par[1]*(dg[0][j]-dg[1][j]);
+  }
+  }
+  return NULL;
+}
+
+static int lmeval(const double *par, double *f, double *jac, void *arg)
+{
+  lmmodel *m;
+  simpass *p;
+  pthread_t thr[64];
+  int i,k,nt,nthr;
+  double *b;
+
+  m = (lmmodel *) arg;
+  m->par = par; m->f = f; m->jac = jac; m->next = 0;
+  for(k=0;k<4;k++){
+  p = &m->p[k];
+  b = m->buf + (size_t) 10*k*m->n;
+  p->tsky = b; p->zr = b+m->n; p->zi = b+2*m->n; p->pwr = b+3*m->n;
+  p->lna.ccf = 1.0+par[m->fit]*0.01; p->cal3 = par[m->fit+1]; p->lna.cf = 1.0+par[m->fit+2]*0.01;
+  }
+  nthr = m->nthr;
+  if(nthr > (m->n+LMCHUNK-1)/LMCHUNK) nthr = (m->n+LMCHUNK-1)/LMCHUNK;
+  for(nt=0;nt<nthr-1;nt++) if(pthread_create(&thr[nt],NULL,lmchunk,m)) break;
+  lmchunk(m);
+  for(i=0;i<nt;i++) pthread_join(thr[i],NULL);
+  return 0;
+}
+
+// Fits y with the passes of proto on nthr threads, par holding the fit
+//  amplitudes, cal2, cal3 and cal4 to start from. Returns the iterations
+//  or -1; the model at the fit goes to fout if that is not NULL
+int lmcal(const simpass *proto, int fit, const double *y, const double *w, double *par, int maxit,
+          int nthr, double *chi2, double *fout)
+{
+  lmmodel m;
+  int i,k,it;
+
+  m.n = proto->n; m.fit = fit;
+  m.nthr = nthr;
+  if(m.nthr <= 0) m.nthr = sysconf(_SC_NPROCESSORS_ONLN);
+  if(m.nthr > 64) m.nthr = 64;
+  for(k=0;k<4;k++){
+  m.p[k] = *proto;
+  m.p[k].jj = k < 2 ? k-2 : k-1;
+  }
+  m.buf = (double *) malloc((size_t) 40*m.n*sizeof(double));
+  if(m.buf == NULL) return -1;
+  it = lm_fit(m.n,fit+3,y,w,par,lmeval,&m,maxit,chi2);
+  if(it >= 0 && fout) lmeval(par,fout,NULL,&m);
+  for(i=0;fout && it < 0 && i<m.n;i++) fout[i] = 0;
+  free(m.buf);
+  return it;
+}
+
 double balun(complex double Zin, double tsky, double freq, double tamb)
 { complex double Z1,Z2,Z3,Z0;
   double len,rt;
@@ -179,6 +528,7 @@ double balun(complex double Zin, double tsky, double freq, double tamb)
          return tsky;
 }
 
+// single frequency model, kept as the reference for lna_sim()
 double sim(double freq, double tsky, complex double ZZin,double cf, double ccf)
 { int i;
   double vgain,Nin,Ng,Nf,Ns,No,Nout;
@@ -421,8 +771,242 @@ int readdata(double ffreq[],double ddata[],double wt[])
  return j;
 }
 
+// -lm on the spectra of a batch, one per thread at a time
+static void *lmspec(void *arg)
+{
+    lmjob *job;
+    int k;
+
+    job = (lmjob *) arg;
+    while ((k = __sync_fetch_and_add(&job->next, 1)) < job->ns)
+        job->it[k] = lmcal(job->proto, job->fit, job->y + (size_t) k * job->nfreq,
+                           job->w + (size_t) k * job->nfreq, job->par + (size_t) k * (job->fit + 3),
+                           lmit, 1, job->chi2 + k, NULL);
+    return NULL;
+}
+
+// -batch: fit every spectrum named in the list file, one per line, with
+//  the basis of the first. They must be on its frequencies. Spectra with
+//  the same weights share one factorization and are solved together across
+//  nthr threads, a spectrum weighted like no other is fitted on its own.
+//  With -lm each linear fit is the start of a nonlinear one, the spectra
+//  spread over the threads. Needs fit >= 2 for the spectral index
+int batchfit(char *list, int fit, int nfreq, int npp, double ffreq[], double fitfn[],
+             double t150, double spind, const simpass *proto)
+{
+    char (*names)[256];
+    int i, j, k, kk, ns, ng, nn, ok, nshared, nsing, *grp, nt, nit;
+    pthread_t thr[64];
+    lmjob job;
+    double *y, *w, *yg, *c, *cc, re, b, d, secs;
+    struct timespec t0, t1;
+    static double bfreq[100000], bdata[100000], bwt[100000];
+    FILE *file;
+    lsqws *ws;
+
+    if ((file = fopen(list, "r")) == NULL) {
+        printf("cannot open batch list:%s\n", list);
+        return 0;
+    }
+    ns = 0;
+    names = NULL;
+    while (fscanf(file, "%255s", fname) == 1) {
+        if (ns % 1024 == 0) names = realloc(names, (ns + 1024) * sizeof(*names));
+        strcpy(names[ns++], fname);
+    }
+    fclose(file);
+    y = (double *) calloc((size_t) nfreq * ns, sizeof(double));
+    w = (double *) calloc((size_t) nfreq * ns, sizeof(double));
+    yg = (double *) malloc((size_t) nfreq * ns * sizeof(double));
+    c = (double *) malloc((size_t) fit * ns * sizeof(double));
+    cc = (double *) malloc((size_t) fit * ns * sizeof(double));
+    grp = (int *) malloc((ns + 1) * sizeof(int));
+    ws = lsq_alloc(nfreq, fit);
+    if (names == NULL || y == NULL || w == NULL || yg == NULL || c == NULL || cc == NULL || grp == NULL || ws == NULL) {
+        printf("cannot allocate batch of %d\n", ns);
+        lsq_free(ws);
+        free(names); free(y); free(w); free(yg); free(c); free(cc); free(grp);
+        return 0;
+    }
+    nn = 0;
+    for (k = 0; k < ns; k++) {
+        strcpy(fname, names[k]);
+        ok = readdata(bfreq, bdata, bwt) == npp;
+        for (i = 0; ok && i < npp; i++) if (fabs(bfreq[i] - ffreq[i]) > 1e-6) ok = 0;
+        if (!ok) {
+            printf("%s not on the frequencies of %s - skipped\n", names[k], names[0]);
+            continue;
+        }
+        if (nn != k) strcpy(names[nn], names[k]);
+        for (i = 0; i < npp; i++) {
+            y[i + (size_t) nn * nfreq] = bdata[i];
+            w[i + (size_t) nn * nfreq] = bwt[i];
+        }
+        nn++;
+    }
+    ns = nn;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    // spectra with the same weights form a group, fitted together; -1 for
+    //  not yet grouped, -2 for a singular fit
+    for (k = 0; k < ns; k++) grp[k] = -1;
+    nshared = 0;
+    for (k = 0; k < ns; k++) {
+        if (grp[k] != -1) continue;
+        ng = 0;
+        for (kk = k; kk < ns; kk++) {
+            if (grp[kk] >= 0) continue;
+            for (i = 0; i < nfreq; i++) if (w[i + (size_t) kk * nfreq] != w[i + (size_t) k * nfreq]) break;
+            if (i < nfreq) continue;
+            grp[kk] = k;
+            memcpy(yg + (size_t) ng * nfreq, y + (size_t) kk * nfreq, nfreq * sizeof(double));
+            ng++;
+        }
+        if (ng > 1 && !lsq_factor(ws, fitfn, w + (size_t) k * nfreq)
+         && !lsq_solve(ws, yg, ng, cc, NULL, nthr)) {
+            nn = 0;
+            for (kk = k; kk < ns; kk++)
+                if (grp[kk] == k) memcpy(c + (size_t) kk * fit, cc + (size_t) nn++ * fit, fit * sizeof(double));
+            nshared += ng;
+            continue;
+        }
+        for (kk = k; kk < ns; kk++) {
+            if (grp[kk] != k) continue;
+            if (lsq_chol(ws, fitfn, w + (size_t) kk * nfreq, y + (size_t) kk * nfreq, c + (size_t) kk * fit)
+             && lsq_qr(ws, fitfn, w + (size_t) kk * nfreq, y + (size_t) kk * nfreq, c + (size_t) kk * fit))
+                grp[kk] = -2;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+    // spectra without a fit are left out of the report and the -lm fits
+    nn = nsing = 0;
+    for (k = 0; k < ns; k++) {
+        if (grp[k] == -2) {
+            printf("%s singular fit\n", names[k]);
+            nsing++;
+            continue;
+        }
+        if (nn != k) {
+            strcpy(names[nn], names[k]);
+            memcpy(y + (size_t) nn * nfreq, y + (size_t) k * nfreq, nfreq * sizeof(double));
+            memcpy(w + (size_t) nn * nfreq, w + (size_t) k * nfreq, nfreq * sizeof(double));
+            memcpy(c + (size_t) nn * fit, c + (size_t) k * fit, fit * sizeof(double));
+        }
+        nn++;
+    }
+    ns = nn;
+    // the rms from the residual as rmscalc2() does it
+    for (k = 0; k < ns; k++) {
+        b = d = 0;
+        for (i = 0; i < nfreq; i++) {
+            if (w[i + (size_t) k * nfreq] <= 0) continue;
+            re = y[i + (size_t) k * nfreq];
+            for (j = 0; j < fit; j++) re -= c[j + (size_t) k * fit] * fitfun(j,i,nfreq,fitfn);
+            b += re * re * w[i + (size_t) k * nfreq];
+            d += w[i + (size_t) k * nfreq];
+        }
+        printf("%s t150(K) %4.0f specindex %8.3f rms %8.3f\n", names[k],
+               c[(size_t) k * fit] * t150, spind + c[1 + (size_t) k * fit] * 0.01, d > 0 ? sqrt(b / d) : 0);
+    }
+    printf("batch %d spectra (%d shared, %d singular) %d terms %d points %.3f s %.0f spectra/s\n",
+           ns + nsing, nshared, nsing, fit, nfreq, secs, secs > 0 ? (ns + nsing) / secs : 0);
+    if (lmit && fit >= 2 && ns > 0) {
+        job.proto = proto; job.fit = fit; job.nfreq = nfreq; job.ns = ns;
+        job.y = y; job.w = w; job.next = 0;
+        job.par = (double *) malloc((size_t) (fit + 3) * ns * sizeof(double));
+        job.chi2 = (double *) malloc(ns * sizeof(double));
+        job.it = (int *) malloc(ns * sizeof(int));
+        if (job.par == NULL || job.chi2 == NULL || job.it == NULL) {
+            printf("cannot allocate lm fits of %d\n", ns);
+            free(job.par); free(job.chi2); free(job.it);
+            lsq_free(ws);
+            free(names); free(y); free(w); free(yg); free(c); free(cc); free(grp);
+            return ns;
+        }
+        for (k = 0; k < ns; k++) {
+            memcpy(job.par + (size_t) k * (fit + 3), c + (size_t) k * fit, fit * sizeof(double));
+            job.par[(size_t) k * (fit + 3) + fit] = (proto->lna.ccf - 1.0) * 100.0;
+            job.par[(size_t) k * (fit + 3) + fit + 1] = proto->cal3;
+            job.par[(size_t) k * (fit + 3) + fit + 2] = (proto->lna.cf - 1.0) * 100.0;
+        }
+        nt = nthr <= 0 ? sysconf(_SC_NPROCESSORS_ONLN) : nthr;
+        if (nt > ns) nt = ns;
+        if (nt > 64) nt = 64;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < nt - 1; i++) if (pthread_create(&thr[i], NULL, lmspec, &job)) break;
+        nt = i;
+        lmspec(&job);
+        for (i = 0; i < nt; i++) pthread_join(thr[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+        nit = 0;
+        for (k = 0; k < ns; k++) {
+            if (job.it[k] < 0) {
+                printf("%s lm fit failed\n", names[k]);
+                continue;
+            }
+            nit += job.it[k];
+            d = 0;
+            for (i = 0; i < nfreq; i++) if (w[i + (size_t) k * nfreq] > 0) d += w[i + (size_t) k * nfreq];
+            b = job.par[(size_t) k * (fit + 3)];
+            re = job.par[(size_t) k * (fit + 3) + 1];
+            printf("%s lm t150(K) %4.0f specindex %8.3f cal2 %7.3f cal3 %7.4f cal4 %7.3f rms %8.3f it %d\n",
+                   names[k], b * t150, spind + re * 0.01, job.par[(size_t) k * (fit + 3) + fit],
+                   job.par[(size_t) k * (fit + 3) + fit + 1], job.par[(size_t) k * (fit + 3) + fit + 2],
+                   d > 0 ? sqrt(job.chi2[k] / d) : 0, job.it[k]);
+        }
+        printf("lm %d spectra %d iterations %d threads %.3f s %.1f spectra/s\n",
+               ns, nit, nt + 1, secs, secs > 0 ? ns / secs : 0);
+        free(job.par); free(job.chi2); free(job.it);
+    }
+    lsq_free(ws);
+    free(names); free(y); free(w); free(yg); free(c); free(cc); free(grp);
+    return ns;
+}
+
 double polyfitr(int npoly, int nfreq, double ddata[],double mcalc[], double wtt[], 
                 double dataout[], double fitfn[])
+{
+    int i, j;
+    double re, dd;
+    lsqws *ws;
+
+    if(lsqmode){
+        if ((ws = lsq_alloc(nfreq, npoly)) == NULL) {
+            printf("cannot allocate lsq workspace\n");
+            return 0;
+        }
+        i = lsqmode == 2 ? lsq_qr(ws, fitfn, wtt, ddata, bbrr) : lsq_chol(ws, fitfn, wtt, ddata, bbrr);
+        if(i && lsqmode == 1) {
+            printf("normal matrix not positive definite - using qr\n");
+            i = lsq_qr(ws, fitfn, wtt, ddata, bbrr);
+        }
+        if(i) {
+            printf("singular fit\n");
+            for (j = 0; j < npoly; j++) bbrr[j] = 0;
+        }
+        else printf("lsq %s cond %e chi2 %e\n",lsq_simd(),lsq_cond(ws),lsq_chi2(ws));
+        lsq_free(ws);
+    }
+    else polyinv(npoly,nfreq,ddata,mcalc,wtt,fitfn);
+
+    for (i = 0; i < nfreq; i++) {
+        re = 0.0;
+        for (j = 0; j < npoly; j++) {
+            re += bbrr[j] * fitfun(j,i,nfreq,fitfn);
+        }
+        dd=re;
+        dataout[i] = dd;
+        ddata[i] = ddata[i] - dd + 0.0;
+        if(ddata[i] > 1e99) ddata[i] = 1e99;
+        if(ddata[i] < -1e99) ddata[i] = -1e99;
+         }
+//        printf("ddata %f %f\n", ddata[i], re);
+    return pow(10.0,bbrr[0]);
+}
+
+// normal equations in long double, solved by MatrixInvert() into bbrr
+void polyinv(int npoly, int nfreq, double ddata[],double mcalc[], double wtt[], double fitfn[])
 {
     int i, j, k, kk, m1, m2;
     double re, max, dd;
@@ -492,20 +1076,6 @@ double polyfitr(int npoly, int nfreq, double ddata[],double mcalc[], double wtt[
     }
     printf("maxtrix soln err %e\n",sqrt(max/rrre));
     if(sqrt(max/rrre) > inverr) inverr = sqrt(max/rrre);
-
-    for (i = 0; i < nfreq; i++) {
-        re = 0.0;
-        for (j = 0; j < npoly; j++) {
-            re += bbrr[j] * fitfun(j,i,nfreq,fitfn);
-        }
-        dd=re;
-        dataout[i] = dd;
-        ddata[i] = ddata[i] - dd + 0.0;
-        if(ddata[i] > 1e99) ddata[i] = 1e99;
-        if(ddata[i] < -1e99) ddata[i] = -1e99;
-         }
-//        printf("ddata %f %f\n", ddata[i], re);
-    return pow(10.0,bbrr[0]);
 }
 
 double fitfun(int j, int i, int nfreq, double fitfn[])
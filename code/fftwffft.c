@@ -1,8 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <fftw3.h>
+#include "d1typ6.h"
 // Notes - float is faster intel_ipps is even faster
-extern float *reamin0,*reamin1,*reamin2,*reamin3,*reamout0,*reamout1,*reamout2,*reamout3;
+extern float *reamin[],*reamout[];
+
+// real input FFTs: per quarter a plan for a batch of RBATCH blocks and
+//  one for a single block used for the remainder
+float *rfin[NQMAX];
+fftwf_complex *rfout[NQMAX];
+static fftwf_plan rfp[NQMAX], rfp1[NQMAX];
+static float *rfbase[NQMAX];
+static int rfn[NQMAX], rfhow[NQMAX];
+// planner flags and input offset in floats picked by fft_tune
+static unsigned fftflags = FFTW_ESTIMATE;
+static int fftalign = 0;
+// wisdom file of fft_tune, written by fft_wisdom once the plans exist
+static char wisname[256];
+extern d1type d1;
 
 void fft_init(int n, int m, fftwf_plan *p)
 {
@@ -19,23 +36,9 @@ void fft_init(int n, int m, fftwf_plan *p)
          in =  (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * n);
          out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * n);
 //printf("entering fft_init after malloc %p\n",in);
-     *p = fftwf_plan_dft_1d(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
-if(m==0) {
-     reamin0 = (float *)in;
-     reamout0 = (float *)out;
-     }
-if(m==1) {
-     reamin1 = (float *)in;
-     reamout1 = (float *)out;
-     }
-if(m==2) {
-     reamin2 = (float *)in;
-     reamout2 = (float *)out;
-     }
-if(m==3) {
-     reamin3 = (float *)in;
-     reamout3 = (float *)out;
-     }
+     *p = fftwf_plan_dft_1d(n, in, out, FFTW_FORWARD, fftflags);
+     reamin[m] = (float *)in;
+     reamout[m] = (float *)out;
 // printf(" after malloc %p %p\n",ina,outa);
 
 //         ...
@@ -48,10 +51,7 @@ if(m==3) {
 void fft_free(int m, fftwf_plan *p)
 {
   fftwf_destroy_plan(*p);
-  if(m==0){ fftwf_free((fftwf_complex*)reamin0); fftwf_free((fftwf_complex*)reamout0); }
-  if(m==1){ fftwf_free((fftwf_complex*)reamin1); fftwf_free((fftwf_complex*)reamout1); }
-  if(m==2){ fftwf_free((fftwf_complex*)reamin2); fftwf_free((fftwf_complex*)reamout2); }
-  if(m==3){ fftwf_free((fftwf_complex*)reamin3); fftwf_free((fftwf_complex*)reamout3); }
+  fftwf_free((fftwf_complex*)reamin[m]); fftwf_free((fftwf_complex*)reamout[m]);
 }
 
 
@@ -59,3 +59,247 @@ void cfft(fftwf_plan *p)
  {
      fftwf_execute(*p);
  }
+
+// Unscramble two real blocks packed into one complex FFT and add the
+//  power of both to sp[0..n/2-1]
+void cfft_power(const float *out, int n, float *sp)
+{
+    int i, n2;
+    float rre, aam, rre2, aam2;
+    n2 = n / 2;
+    for (i = 0; i < n2; i++) {
+        if (i >= 1) {
+            rre = out[2*i] + out[2*(n - i)];
+            aam = out[2*i+1] - out[2*(n - i)+1];
+            aam2 = -out[2*i] + out[2*(n - i)];
+            rre2 = out[2*i+1] + out[2*(n - i)+1];
+        } else {
+            rre = out[2*i] + out[0];
+            aam = out[2*i+1] - out[1];
+            aam2 = -out[2*i] + out[0];
+            rre2 = out[2*i+1] + out[1];
+        }
+        sp[i] += rre * rre + aam * aam + rre2 * rre2 + aam2 * aam2;
+    }
+}
+
+void rfft_init(int n, int howmany, int m)
+{
+     rfbase[m] = (float *) fftwf_malloc(sizeof(float) * (n * howmany + 16));
+     rfin[m] = rfbase[m] + fftalign;
+     rfout[m] = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * (n/2 + 1) * howmany);
+     rfp[m] = fftwf_plan_many_dft_r2c(1, &n, howmany, rfin[m], NULL, 1, n,
+                                      rfout[m], NULL, 1, n/2 + 1, fftflags);
+     rfp1[m] = fftwf_plan_dft_r2c_1d(n, rfin[m], rfout[m], fftflags);
+     rfn[m] = n;
+     rfhow[m] = howmany;
+}
+
+void rfft_free(int m)
+{
+  fftwf_destroy_plan(rfp[m]);
+  fftwf_destroy_plan(rfp1[m]);
+  fftwf_free(rfbase[m]); fftwf_free(rfout[m]);
+}
+
+// Transform the first nb blocks of rfin[m] into rfout[m]
+void rfft(int m, int nb)
+{
+  int b, n;
+  n = rfn[m];
+  if (nb == rfhow[m]) fftwf_execute(rfp[m]);
+  else for (b = 0; b < nb; b++)
+    fftwf_execute_dft_r2c(rfp1[m], rfin[m] + b * n, rfout[m] + b * (n/2 + 1));
+}
+
+// Add the power of nb transformed blocks to sp[0..n/2-1]. The factor 4
+//  keeps the scale of the packed complex transform in cfft_power
+void rfft_power(int m, int nb, float *sp)
+{
+  int b, i, n2;
+  const float *o;
+  n2 = rfn[m] / 2;
+  for (b = 0; b < nb; b++) {
+    o = (const float *) (rfout[m] + b * (n2 + 1));
+    for (i = 0; i < n2; i++)
+      sp[i] += 4.0f * (o[2*i] * o[2*i] + o[2*i+1] * o[2*i+1]);
+  }
+}
+
+// rfft_power that also adds the squared power to sq and leaves the total
+//  power of each block in tot[0..nb-1], for the RFI statistics in rfi.c
+void rfft_power2(int m, int nb, float *restrict sp, float *restrict sq, float *tot)
+{
+  int b, i, k, n2;
+  const float *o;
+  float p, t[8];
+  n2 = rfn[m] / 2;
+  for (b = 0; b < nb; b++) {
+    o = (const float *) (rfout[m] + b * (n2 + 1));
+    // eight running totals so the sum does not serialize the loop
+    for (k = 0; k < 8; k++) t[k] = 0.0f;
+    for (i = 0; i + 8 <= n2; i += 8)
+      for (k = 0; k < 8; k++) {
+        p = 4.0f * (o[2*(i+k)] * o[2*(i+k)] + o[2*(i+k)+1] * o[2*(i+k)+1]);
+        sp[i+k] += p;
+        sq[i+k] += p * p;
+        t[k] += p;
+      }
+    for (; i < n2; i++) {
+      p = 4.0f * (o[2*i] * o[2*i] + o[2*i+1] * o[2*i+1]);
+      sp[i] += p;
+      sq[i] += p * p;
+      t[0] += p;
+    }
+    tot[b] = t[0] + t[1] + t[2] + t[3] + t[4] + t[5] + t[6] + t[7];
+  }
+}
+
+// Take block b of the last rfft_power2 back out of sp and sq
+void rfft_unpower(int m, int b, float *restrict sp, float *restrict sq)
+{
+  int i, n2;
+  const float *o;
+  float p;
+  n2 = rfn[m] / 2;
+  o = (const float *) (rfout[m] + b * (n2 + 1));
+  for (i = 0; i < n2; i++) {
+    p = 4.0f * (o[2*i] * o[2*i] + o[2*i+1] * o[2*i+1]);
+    sp[i] -= p;
+    sq[i] -= p * p;
+  }
+}
+
+// Dual channel: the nb blocks of rfin[m] are ch1, ch2 pairs. Adds the two
+//  auto spectra and the cross spectrum ch1 * conj(ch2) to
+//  sp = [ch1 n/2 | ch2 n/2 | re, im n/2], scaled as in rfft_power
+void rfft_cross(int m, int nb, float *sp)
+{
+  int b, i, n2;
+  const float *a, *c;
+  float *sa, *sb, *sx;
+  n2 = rfn[m] / 2;
+  sa = sp;
+  sb = sp + n2;
+  sx = sp + 2 * n2;
+  for (b = 0; b + 1 < nb; b += 2) {
+    a = (const float *) (rfout[m] + b * (n2 + 1));
+    c = (const float *) (rfout[m] + (b + 1) * (n2 + 1));
+    for (i = 0; i < n2; i++) {
+      sa[i] += 4.0f * (a[2*i] * a[2*i] + a[2*i+1] * a[2*i+1]);
+      sb[i] += 4.0f * (c[2*i] * c[2*i] + c[2*i+1] * c[2*i+1]);
+      sx[2*i] += 4.0f * (a[2*i] * c[2*i] + a[2*i+1] * c[2*i+1]);
+      sx[2*i+1] += 4.0f * (a[2*i+1] * c[2*i] - a[2*i] * c[2*i+1]);
+    }
+  }
+}
+
+// hash of the cpu model so wisdom is not reused on a different machine
+static unsigned int cpukey(void)
+{
+  FILE *file;
+  char buf[256];
+  unsigned int h;
+  int i;
+  h = 5381;
+  if ((file = fopen("/proc/cpuinfo", "r")) == NULL) return h;
+  while (fgets(buf, 256, file) != 0)
+    if (strstr(buf, "model name")) {
+      for (i = 0; buf[i]; i++) h = h * 33 + (unsigned char) buf[i];
+      break;
+    }
+  fclose(file);
+  return h;
+}
+
+static double tuneclock(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Pick the FFTW planner flags and input alignment for blocks of n with
+//  nthr quarters. The choice and the FFTW wisdom are kept in d1.wisdir
+//  keyed by n, thread count and cpu so a restart plans from wisdom.
+//  On the first run ESTIMATE, MEASURE and PATIENT plans on aligned and
+//  unaligned input are timed and the fastest is kept
+void fft_tune(int n, int nthr)
+{
+  static const unsigned flags[3] = {FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT};
+  static const char *fname[3] = {"estimate", "measure", "patient"};
+  char tunename[256], buf[256];
+  FILE *file;
+  float *base, *in;
+  fftwf_complex *out;
+  fftwf_plan p;
+  unsigned int f;
+  int i, a, k, nex, best, bestal;
+  double t, tbest, tex;
+
+  sprintf(wisname, "%s/fftw_%08x_n%d_t%d.wis", d1.wisdir, cpukey(), n, nthr);
+  sprintf(tunename, "%s/fftw_%08x_n%d_t%d.tune", d1.wisdir, cpukey(), n, nthr);
+  if (fftwf_import_wisdom_from_filename(wisname) &&
+      (file = fopen(tunename, "r")) != NULL) {
+    k = 0;
+    if (fgets(buf, 256, file) != 0 && sscanf(buf, "%u %d", &f, &a) == 2) {
+      fftflags = f;
+      fftalign = a;
+      k = 1;
+    }
+    fclose(file);
+    if (k) {
+      printf("fft_tune: using wisdom %s\n", wisname);
+      return;
+    }
+  }
+
+  printf("fft_tune: no wisdom for n %d threads %d - timing plans\n", n, nthr);
+  base = (float *) fftwf_malloc(sizeof(float) * (n * RBATCH + 16));
+  out = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * (n/2 + 1) * RBATCH);
+  best = 0; bestal = 0; tbest = 1e99;
+  for (k = 0; k < 3; k++)
+    for (a = 0; a < 2; a++) {
+      in = base + a;
+      f = flags[k] | (a ? FFTW_UNALIGNED : 0);
+      p = fftwf_plan_many_dft_r2c(1, &n, RBATCH, in, NULL, 1, n,
+                                  out, NULL, 1, n/2 + 1, f);
+      if (p == NULL) continue;
+      for (i = 0; i < n * RBATCH; i++) in[i] = (i % 7) - 3.0f;
+      fftwf_execute(p);
+      nex = 0;
+      t = tuneclock();
+      do {
+        fftwf_execute(p);
+        nex++;
+        tex = tuneclock() - t;
+      } while (tex < 0.2);
+      tex /= nex * RBATCH;
+      printf("fft_tune: %-8s %-9s %8.3f ms/blk\n", fname[k], a ? "unaligned" : "aligned", tex * 1e3);
+      if (tex < tbest) { tbest = tex; best = k; bestal = a; }
+      fftwf_destroy_plan(p);
+    }
+  fftwf_free(base);
+  fftwf_free(out);
+  fftflags = flags[best] | (bestal ? FFTW_UNALIGNED : 0);
+  fftalign = bestal;
+  printf("fft_tune: picked %s %s\n", fname[best], bestal ? "unaligned" : "aligned");
+
+  if ((file = fopen(tunename, "w")) == NULL) {
+    printf("cannot write %s\n", tunename);
+    return;
+  }
+  fprintf(file, "%u %d %s %s %e\n", fftflags, fftalign, fname[best],
+          bestal ? "unaligned" : "aligned", tbest);
+  fclose(file);
+}
+
+// Save the wisdom of fft_tune with the plans acquisition uses, so call
+//  after fft_init or rfft_init; a restart then plans them from wisdom
+void fft_wisdom(void)
+{
+  if (wisname[0] == 0) return;
+  if (!fftwf_export_wisdom_to_filename(wisname))
+    printf("cannot write %s\n", wisname);
+  wisname[0] = 0;
+}
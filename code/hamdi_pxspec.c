@@ -14,6 +14,7 @@
 #include <signal.h>
 #include "d1typ6.h"
 #include "d1proto6.h"
+#include "statseg.h"
 #include "stdafx.h"
 #include <fftw3.h>
 
@@ -25,23 +26,21 @@ GdkFont *fixed_font;
 GtkWidget *table;
 GtkWidget *button_exit;
 GtkWidget *drawing_area;
-float avspec[NSIZ];
-float win0[NSIZ*2],win1[NSIZ*2];
-float win2[NSIZ*2],win3[NSIZ*2];
-float spec0[NSIZ],spec1[NSIZ];
-float spec2[NSIZ],spec3[NSIZ];
+float specq[NQMAX][NSIZ];
 int midx, midy;
 HPX14 hBrd;
 px14_sample_t *dma_bufp;
-fftwf_plan p0,p1,p2,p3;
-float *reamin0,*reamin1,*reamin2,*reamin3,*reamout0,*reamout1,*reamout2,*reamout3;
+fftwf_plan pq[NQMAX];
+float *reamin[NQMAX],*reamout[NQMAX];
+extern double *xspec;
 d1type d1;
 
 
-void write_spec(double *,int,int);
-void write_status(double *data, int argc, char **argv, time_t *starttime, int nrun, int nblock, int pport, int run, double duty_cycle);
-void *runspec(void *);
-void px14run(float*,int);
+void write_spec(d1type *,double *,int,int);
+void write_status(d1type *d, double *data, int argc, char **argv, time_t *starttime, int nrun, int nblock, int pport, int run, double duty_cycle);
+void spec_queue(double *,int,int);
+void status_queue(double *data, int argc, char **argv, time_t *starttime, int nrun, int nblock, int pport, int run, double duty_cycle);
+void px14run(double*,int);
 int pxrun(int,px14_sample_t *);
 
 
@@ -64,7 +63,7 @@ void parport(int pdata)
 		if(pdata == 1) i = 2;  // load
 		if(pdata == 2) i = 3;  // load + cal
 		outb(i,DATA); /* Sends  to the Data Port */
-		usleep(100000); // sleep for 0.1 sec
+		// no sleep - the switch scheduler drops the blocks taken while it settles
 	}
 }
 
@@ -179,11 +178,11 @@ int main(int argc, char **argv)
 {
    // Parameter declarations
 	static double data[3*NSIZ];
-	static float spec[NSIZ];
+	static double spec[NSIZ];
 	double max;
 	int i,kk,maxi,run,nspec,nrun,nblock,pport;
 	double av,freq,aa;
-	int swmode,swmnext;
+	int swmode,swmnext,bench;
 	char buf[256];
 	struct sigaction sa;
 	struct timespec tic, toc;
@@ -214,6 +213,33 @@ int main(int argc, char **argv)
 	d1.nspec = 32768;
 	d1.dwin = 1;
 	d1.dwin = 0;
+	d1.nquart = 0;   // 0 - one per core
+	d1.rfft = 1;
+	d1.tune = 1;   // FFTW wisdom and plan autotuning
+	d1.simd = 2;   // 0 scalar, 1 up to avx2, 2 up to avx512
+	d1.wtype = 0;   // 0 blackman-harris 1 hann 2 flat-top 3 kaiser
+	d1.kbeta = 8.6;
+	d1.pfb = 0;     // polyphase filter bank taps, 0 plain windowed FFT
+	d1.accum = 1;   // 0 float 1 double 2 kahan 3 int64
+	d1.dual = 0;    // both inputs interleaved, auto and cross spectra
+	d1.afmt = 1;    // archive: 0 base64 text .acq, 1 float32 .acb, 2 float16 .acb
+	d1.comp = 0;    // .acb compression: 0 none 1 lz 2 shuffle+lz
+	d1.rawper = 0.0;   // raw capture every n seconds, 0 never
+	d1.rawtrig = 0;    // raw capture when a block peaks at n counts, 0 never
+	d1.rawpre = 2;     // DMA blocks kept before the trigger
+	d1.rawpost = 2;    // and taken after it
+	d1.rawrate = 20.0; // MB/s average limit
+	d1.rawcomp = 0;    // 0 none 3 delta
+	d1.rfi = 0.0;      // RFI flagging threshold in sigma, 0 off
+	d1.subint = 0;     // blocks per waterfall row, 0 off
+	d1.http = 0;       // web server port, 0 off
+	d1.settle = 100.0; // switch settling time in ms
+	d1.dwell[0] = d1.dwell[1] = d1.dwell[2] = 1.0;   // relative time at each switch position
+	strcpy(d1.wisdir, "/home/loco/Desktop/DATA");
+	strcpy(d1.statname, STATNAME);   // live status segment
+	strcpy(d1.httpaddr, "127.0.0.1");   // web server address, 0.0.0.0 for all
+	d1.stattxt = 10;   // status text file every n cycles, 0 never
+	bench = 0;
 	d1.run = 1;
 
 	// Parse input arguments to update default values for this instance
@@ -221,7 +247,7 @@ int main(int argc, char **argv)
 	{
 		sscanf(argv[i], "%79s", buf);
 		if (strstr(buf, "-disp")) { sscanf(argv[i+1], "%d",&d1.disp); }
-		if (strstr(buf, "-sim")) { sscanf(argv[i+1], "%d",&d1.sim); }
+		if (strcmp(buf, "-sim") == 0) { sscanf(argv[i+1], "%d",&d1.sim); }
 		if (strstr(buf, "-print")) { sscanf(argv[i+1], "%d",&d1.printout); }
 		if (strstr(buf, "-nrun")) { sscanf(argv[i+1], "%d",&nrun); }
 		if (strstr(buf, "-nblock")) { sscanf(argv[i+1], "%d",&nblock); }
@@ -229,6 +255,39 @@ int main(int argc, char **argv)
 		if (strstr(buf, "-pport")) { sscanf(argv[i+1], "%d",&pport); }
 		if (strstr(buf, "-dwin")) { sscanf(argv[i+1], "%d",&d1.dwin); }
 		if (strstr(buf, "-mfreq")) { sscanf(argv[i+1], "%lf",&d1.mfreq); }
+		if (strstr(buf, "-nquart")) { sscanf(argv[i+1], "%d",&d1.nquart); }
+		if (strstr(buf, "-rfft")) { sscanf(argv[i+1], "%d",&d1.rfft); }
+		if (strstr(buf, "-tune")) { sscanf(argv[i+1], "%d",&d1.tune); }
+		if (strstr(buf, "-wisdir")) { sscanf(argv[i+1], "%79s",d1.wisdir); }
+		if (strstr(buf, "-simd")) { sscanf(argv[i+1], "%d",&d1.simd); }
+		if (strstr(buf, "-wtype")) { sscanf(argv[i+1], "%d",&d1.wtype); }
+		if (strstr(buf, "-kbeta")) { sscanf(argv[i+1], "%lf",&d1.kbeta); }
+		if (strstr(buf, "-pfb")) { sscanf(argv[i+1], "%d",&d1.pfb); }
+		if (strstr(buf, "-accum")) { sscanf(argv[i+1], "%d",&d1.accum); }
+		if (strstr(buf, "-dual")) { sscanf(argv[i+1], "%d",&d1.dual); }
+		if (strstr(buf, "-afmt")) { sscanf(argv[i+1], "%d",&d1.afmt); }
+		if (strcmp(buf, "-comp") == 0) { sscanf(argv[i+1], "%d",&d1.comp); }
+		if (strstr(buf, "-rawper")) { sscanf(argv[i+1], "%lf",&d1.rawper); }
+		if (strstr(buf, "-rawtrig")) { sscanf(argv[i+1], "%d",&d1.rawtrig); }
+		if (strstr(buf, "-rawpre")) { sscanf(argv[i+1], "%d",&d1.rawpre); }
+		if (strstr(buf, "-rawpost")) { sscanf(argv[i+1], "%d",&d1.rawpost); }
+		if (strstr(buf, "-rawrate")) { sscanf(argv[i+1], "%lf",&d1.rawrate); }
+		if (strstr(buf, "-rawcomp")) { sscanf(argv[i+1], "%d",&d1.rawcomp); }
+		if (strstr(buf, "-rfi")) { sscanf(argv[i+1], "%lf",&d1.rfi); }
+		if (strstr(buf, "-subint")) { sscanf(argv[i+1], "%d",&d1.subint); }
+		if (strcmp(buf, "-http") == 0) { sscanf(argv[i+1], "%d",&d1.http); }
+		if (strstr(buf, "-httpaddr")) { sscanf(argv[i+1], "%79s",d1.httpaddr); }
+		if (strstr(buf, "-settle")) { sscanf(argv[i+1], "%lf",&d1.settle); }
+		if (strstr(buf, "-dwell")) { sscanf(argv[i+1], "%lf,%lf,%lf",&d1.dwell[0],&d1.dwell[1],&d1.dwell[2]); }
+		if (strstr(buf, "-statseg")) { sscanf(argv[i+1], "%79s",d1.statname); }
+		if (strstr(buf, "-stattxt")) { sscanf(argv[i+1], "%d",&d1.stattxt); }
+		if (strstr(buf, "-bench")) { sscanf(argv[i+1], "%d",&bench); }
+	}
+
+	// Run the processing benchmarks without the digitizer and exit
+	if (bench)
+	{
+		return pxbench(bench);
 	}
 
 	if (pport)  
@@ -244,12 +303,12 @@ int main(int argc, char **argv)
 		sleep(3);   // allow time for pci bus 
 	}
 
-	if (d1.disp)
+	if (d1.disp && disp_init(&argc, &argv, d1.nspec))
 	{
-		gtk_init(&argc, &argv);
-		disp();
+		d1.disp = 0;
 	}
 
+	if (d1.dual && d1.mfreq > 100.0) d1.mfreq = 100.0;   // 200 MS/s per channel
 	d1.stim = 1e-6/(2.0*d1.mfreq);
 	nspec = d1.nspec;
 	d1.fstart = 0.0; 
@@ -259,11 +318,12 @@ int main(int argc, char **argv)
 	d1.foutstatus = 0;
    run = 1; 
    px14run(spec,-1);   // init
+   writer_init();      // spectra and status are written on their own thread
+   statseg_init(d1.statname, nspec, argc, argv, nrun, nblock, pport);
+   http_init(d1.http, d1.statname, d1.httpaddr);
 
-   if(pport)
-	{
-		parport(0);  // set to antenna 
-	}
+   sw_init(pport);
+   sw_set(0);  // set to antenna 
 
 	// The main running loop
    while(run<=nrun && d1.run)
@@ -289,19 +349,24 @@ int main(int argc, char **argv)
 			d1.adcmin = 1e99;
 			d1.mode = swmode;
 			d1.numblk = 0;
-			px14run(spec, nblock);
-	
+			d1.dropped = 0;
+			d1.novfl = 0;
+			d1.nsettle = 0;
+
 			if (swmode == 2) 
 			{
 				swmnext = 0;
 			} else {
 				swmnext = swmode + 1;
 			}
-        
-			// Set switch for next cycle as it needs acquire to set
-			if(pport) 
+
+			// The switch is set for the next cycle as soon as the last
+			// buffer is in, and the stream keeps going while it settles
+			sw_queue(swmnext);
+			px14run(spec, sw_nblock(swmode, nblock));
+			if (!d1.run && d1.numblk == 0)
 			{
-				parport(swmnext); 
+				break;   // board lost, nothing to write
 			}
         
 			for(kk=0; kk<nspec; kk++) 
@@ -309,30 +374,12 @@ int main(int argc, char **argv)
 				data[swmode*nspec+kk] = spec[kk];
 			}
 	
-			// If the display flag was set at run, then draw the spectrum
-			// to a gtk window on the screen.
+			// If the display flag was set at run, hand the spectrum to the
+			// display thread, which draws it to a gtk window on the screen.
 			if (d1.disp)
 			{
-        		aa = 100.0 / ((double) d1.numblk*nspec*2.0);  // for compatibility with acml FFT 
-				for(kk=0;kk<nspec;kk++) 
-				{
-					avspec[kk]=10.0*log10(aa*spec[kk]+1e-99);
-				}
-
-				d1.totp = 0.0;
-				for(kk=(int)(80.0*nspec/210.0);kk<nspec;kk++) 
-				{
-					d1.totp += spec[kk];
-				}
-
-				d1.secs = readclock();
-				Repaint(d1.mfreq);
-				while (gtk_events_pending()) 
-				{
-					gtk_main_iteration();
-				}
-				clearpaint();
-			} 
+				disp_post(&d1, spec, nspec);
+			}
 
 			max = -1e99;
 			maxi = 0;
@@ -370,21 +417,27 @@ int main(int argc, char **argv)
 			n_samples = (double) d1.numblk * (double) nspec;
 			duty_cycle = 100.0 * n_samples / (d1.mfreq * 1e6) / n_seconds;
 
-			printf("Duty cycle: %5.2f, duration: %5.2f, samples read: %5.2f, numblk: %d\n", 
-				duty_cycle, n_seconds, n_samples, d1.numblk);
+			printf("Duty cycle: %5.2f, duration: %5.2f, samples read: %5.2f, numblk: %d, dropped: %5.0f (%d overflows), settling: %d buffers\n", 
+				duty_cycle, n_seconds, n_samples, d1.numblk, d1.dropped, d1.novfl, d1.nsettle);
 
-         // Write spectrum to output file
-         write_spec(&data[swmode*nspec],nspec,swmode);
+         // Queue the spectrum for the output file
+         spec_queue(&data[swmode*nspec],nspec,swmode);
+         statseg_spec(&d1, &data[swmode*nspec], swmode);
 
 		} // end switch cycle for loop
 
 
-      // Write to the status file
+      // The live status segment is updated in place every cycle; the
+      // status text file is only a low rate export
+      statseg_cycle(run, duty_cycle);
+      if (d1.stattxt > 0 && run % d1.stattxt == 0)
+      {
       clock_gettime(CLOCK_MONOTONIC, &tic);
-      write_status(data, argc, argv, &starttime, nrun, nblock, pport, run, duty_cycle);
+      status_queue(data, argc, argv, &starttime, nrun, nblock, pport, run, duty_cycle);
       clock_gettime(CLOCK_MONOTONIC, &toc);
-      printf("Write status file - duration (seconds): %15f\n", 
-         (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1000000000.0 );
+      printf("Queue status file - duration (seconds): %15f, writer backlog %d\n", 
+         (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1000000000.0, writer_pending() );
+      }
 
       // Increment the loop counter
       run++;
@@ -393,19 +446,156 @@ int main(int argc, char **argv)
 
 	// clean-up PCI
 	px14run(spec,-3);  
+	writer_free();
+	disp_free();
+	acqclose();
+	http_free();
+	statseg_free();
 
 	return 0;
 }
 
 
 
-void write_spec(double data[], int num, int swpos)
+// Output records for the writer thread. Each carries a copy of d1 taken
+// when it was queued; the file fields of d1 (filname, foutstatus, rday)
+// belong to the writer and are kept in d1w between records
+typedef struct
+{
+	d1type d;
+	int num, swpos;
+	double data[];   // dBm values, then ch2 and cross spectrum if dual or the rfi mask bytes
+} specjob;
+
+typedef struct
+{
+	d1type d;
+	int argc, nrun, nblock, pport, run;
+	char **argv;
+	time_t starttime;
+	double duty_cycle;
+	double data[];   // 3 * nspec
+} statusjob;
+
+static d1type d1w;
+
+
+
+static void spec_out(void *p)
+{
+	specjob *j = (specjob *) p;
+
+	strcpy(j->d.filname, d1w.filname);
+	j->d.foutstatus = d1w.foutstatus;
+	j->d.rday = d1w.rday;
+	write_spec(&j->d, j->data, j->num, j->swpos);
+	if (j->d.dual) 
+	{
+		xspfile(&j->d, j->data + j->num, j->swpos);
+	}
+	if (j->d.rfi > 0)
+	{
+		rfifile(&j->d, (unsigned char *) (j->data + j->num), j->swpos);
+	}
+	if (strcmp(d1w.filname, j->d.filname))
+	{
+		disp_file(j->d.filname);
+	}
+	strcpy(d1w.filname, j->d.filname);
+	d1w.foutstatus = j->d.foutstatus;
+	d1w.rday = j->d.rday;
+}
+
+
+
+// Queue a spectrum for output; waits only when the writer queue of NWQ
+// jobs is full
+void spec_queue(double data[], int num, int swpos)
+{
+	static specjob *j;
+	static size_t len;
+	size_t n;
+
+	n = sizeof(specjob) + sizeof(double) * num * (d1.dual ? 4 : 1);
+	if (d1.rfi > 0)
+	{
+		n += num;
+	}
+	if (n > len)
+	{
+		free(j);
+		j = (specjob *) malloc(n);
+		len = n;
+	}
+	d1.secs = readclock();
+	j->d = d1;
+	j->num = num;
+	j->swpos = swpos;
+	memcpy(j->data, data, sizeof(double) * num);
+	if (d1.dual)
+	{
+		memcpy(j->data + num, xspec + num, sizeof(double) * 3 * num);
+	}
+	if (d1.rfi > 0)
+	{
+		memcpy(j->data + num, rfi_mask(), num);
+	}
+	writer_submit(spec_out, j, n, 1);
+}
+
+
+
+static void status_out(void *p)
+{
+	statusjob *j = (statusjob *) p;
+
+	write_status(&j->d, j->data, j->argc, j->argv, &j->starttime, j->nrun, j->nblock, j->pport, j->run, j->duty_cycle);
+}
+
+
+
+void status_queue(double *data, int argc, char **argv, time_t *starttime, int nrun, int nblock, int pport, int run, double duty_cycle)
+{
+	static statusjob *j;
+	static size_t len;
+	size_t n;
+
+	n = sizeof(statusjob) + sizeof(double) * 3 * d1.nspec;
+	if (n > len)
+	{
+		free(j);
+		j = (statusjob *) malloc(n);
+		len = n;
+	}
+	j->d = d1;
+	j->argc = argc;
+	j->argv = argv;
+	j->starttime = *starttime;
+	j->nrun = nrun;
+	j->nblock = nblock;
+	j->pport = pport;
+	j->run = run;
+	j->duty_cycle = duty_cycle;
+	memcpy(j->data, data, sizeof(double) * 3 * d1.nspec);
+	writer_submit(status_out, j, n, 0);
+}
+
+
+
+void write_spec(d1type *d, double data[], int num, int swpos)
 {
 	FILE *file1;
 	int yr, da, hr, mn, sc, i,j,k;
 	char txt[256];
 	char b64[64];
 
+	// Binary archive unless the legacy text format was asked for
+	if (d->afmt)
+	{
+		acqwrite(d, data, num, swpos);
+		return;
+	}
+
 	for (i = 0; i < 26; i++) 
 	{
 		b64[i] = 'A' + i;
@@ -419,50 +609,49 @@ void write_spec(double data[], int num, int swpos)
 
    b64[62] = '+';
    b64[63] = '/';
-   d1.secs = readclock();
 
-   if(d1.foutstatus==0) 
+   if(d->foutstatus==0) 
 	{
-      toyrday (d1.secs, &yr, &da, &hr, &mn, &sc);
-      d1.rday = da;
-      sprintf (d1.filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
+      toyrday (d->secs, &yr, &da, &hr, &mn, &sc);
+      d->rday = da;
+      sprintf (d->filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
    }
 
-	if ((file1 = fopen (d1.filname, "a")) == NULL)
+	if ((file1 = fopen (d->filname, "a")) == NULL)
    {
-	   if ((file1 = fopen (d1.filname, "w")) == NULL)
+	   if ((file1 = fopen (d->filname, "w")) == NULL)
 		{
-			d1.foutstatus = -99;
-			printf ("cannot write %s\n", d1.filname);
+			d->foutstatus = -99;
+			printf ("cannot write %s\n", d->filname);
 			return;
 		}
-   	d1.foutstatus = 1;
+   	d->foutstatus = 1;
    } else {
-   	d1.foutstatus = 1;
+   	d->foutstatus = 1;
 	}
 
-  	if (d1.foutstatus == 1)
+  	if (d->foutstatus == 1)
   	{
-  		toyrday (d1.secs, &yr, &da, &hr, &mn, &sc);
-      if (da != d1.rday && swpos == 0)
+  		toyrday (d->secs, &yr, &da, &hr, &mn, &sc);
+      if (da != d->rday && swpos == 0)
 		{
 	  		fclose (file1);
-	  		d1.foutstatus = 0;
-	  		toyrday (d1.secs, &yr, &da, &hr, &mn, &sc);
-	  		sprintf (d1.filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
-	  		if ((file1 = fopen (d1.filname, "w")) == NULL)
+	  		d->foutstatus = 0;
+	  		toyrday (d->secs, &yr, &da, &hr, &mn, &sc);
+	  		sprintf (d->filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
+	  		if ((file1 = fopen (d->filname, "w")) == NULL)
 	    	{
-	      	d1.foutstatus = -99;
+	      	d->foutstatus = -99;
 	      	return;
 	    	}
-	  		d1.foutstatus = 1;
+	  		d->foutstatus = 1;
 		}
 
 	   fprintf (file1, "# swpos %d resolution %8.3f adcmax %8.5f adcmin %8.5f temp %2.0f C nblk %d nspec %d\n",
-                        swpos,d1.fres,d1.adcmax,d1.adcmin,d1.temp,d1.numblk,d1.nspec);
+                        swpos,d->fres,d->adcmax,d->adcmin,d->temp,d->numblk,d->nspec);
 
 		sprintf (txt, "%4d:%03d:%02d:%02d:%02d %1d %8.3f %8.6f %8.3f %4.1f spectrum ", 
-								yr, da, hr, mn, sc, swpos, d1.fstart, d1.fstep, d1.fstop, d1.adcmax);
+								yr, da, hr, mn, sc, swpos, d->fstart, d->fstep, d->fstop, d->adcmax);
 	   
 		fprintf (file1, "%s", txt);
 
@@ -499,7 +688,7 @@ void write_spec(double data[], int num, int swpos)
 
       if(swpos == 0) 
 		{
-			d1.rday = da;
+			d->rday = da;
 		}
 	}
 }
@@ -507,6 +696,7 @@ void write_spec(double data[], int num, int swpos)
 
 
 void write_status(
+         d1type *d,
          double *data,
          int argc, 
          char **argv, 
@@ -521,18 +711,23 @@ void write_status(
 
    FILE *file;
    char filename[1024];
+   char tmpname[1040];
    char buffer[2048];
    int n;
    time_t currenttime;
    struct tm timeinfo;
-   // also inherits d1 from global context
+   // d is the copy of d1 taken when the status was queued
 
+   // Written to a temporary file that is renamed over the old one, so
+   // readers always see a complete status file
    sprintf(filename, "/home/loco/Desktop/DATA/status_spectrometer.txt");
-   if ((file = fopen(filename, "w")) == NULL)
+   sprintf(tmpname, "%s.tmp", filename);
+   if ((file = fopen(tmpname, "w")) == NULL)
 	{
-		printf ("Cannot write %s\n", d1.filname);
+		printf ("Cannot write %s\n", tmpname);
 		return;
 	}
+   setvbuf(file, NULL, _IOFBF, 1 << 20);
 
    // Print current time
    time(&currenttime);
@@ -561,30 +756,34 @@ void write_status(
    fprintf (file, "Parameter: pport = %d\n", pport);
    fprintf (file, "Parameter: run = %d\n", run);
    fprintf (file, "Parameter: duty_cycle = %6.3f\n", duty_cycle);
-   fprintf (file, "Parameter: d1.mfreq = %6.3f\n", d1.mfreq);
-   fprintf (file, "Parameter: d1.fres = %6.3f\n", d1.fres);
-   fprintf (file, "Parameter: d1.temp = %6.3f\n", d1.temp);
-   fprintf (file, "Parameter: d1.adcmin = %6.3f\n", d1.adcmin);
-   fprintf (file, "Parameter: d1.adcmax = %6.3f\n", d1.adcmax);
-   fprintf (file, "Parameter: d1.numblk = %d\n", d1.numblk);
-   fprintf (file, "Parameter: d1.nspec = %d\n", d1.nspec);
-   fprintf (file, "Parameter: d1.disp = %d\n", d1.disp);
+   fprintf (file, "Parameter: d1.mfreq = %6.3f\n", d->mfreq);
+   fprintf (file, "Parameter: d1.fres = %6.3f\n", d->fres);
+   fprintf (file, "Parameter: d1.temp = %6.3f\n", d->temp);
+   fprintf (file, "Parameter: d1.adcmin = %6.3f\n", d->adcmin);
+   fprintf (file, "Parameter: d1.adcmax = %6.3f\n", d->adcmax);
+   fprintf (file, "Parameter: d1.numblk = %d\n", d->numblk);
+   fprintf (file, "Parameter: d1.dropped = %.0f\n", d->dropped);
+   fprintf (file, "Parameter: d1.nspec = %d\n", d->nspec);
+   fprintf (file, "Parameter: d1.disp = %d\n", d->disp);
    fprintf(file, "\n");
 
    // Print current spectra
    fprintf(file, "Data [freq (MHz), p0, p1, p2]:\n");
-   for (n=0; n<d1.nspec; n++)
+   for (n=0; n<d->nspec; n++)
    {
       fprintf(file, "%8.3f, %8.3f, %8.3f, %8.3f\n", 
-         (double) n * (d1.mfreq / (double) d1.nspec), 
-         data[0*d1.nspec+n], 
-         data[1*d1.nspec+n], 
-         data[2*d1.nspec+n]);
+         (double) n * (d->mfreq / (double) d->nspec), 
+         data[0*d->nspec+n], 
+         data[1*d->nspec+n], 
+         data[2*d->nspec+n]);
    }
    fprintf(file, "\n");
 
-   // That's all.  Close the file
-   fclose(file);
+   // That's all.  Close the file and move it into place
+   if (fclose(file) || rename(tmpname, filename))
+   {
+		printf ("Cannot write %s\n", filename);
+   }
 
 }
 
@@ -0,0 +1,605 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+#include "statseg.h"
+
+// Built in web server for -http port, for watching a remote site with a
+//  browser instead of a remote X session. There is no login, so it listens
+//  on -httpaddr, 127.0.0.1 unless asked, for use through an ssh tunnel. It is a reader of the live status
+//  segment like statcat, so the acquisition loop does nothing for it, and
+//  runs at SCHED_IDLE. The spectra are decimated to HTTPCOL columns of min
+//  and max in 0.01 dBm and pushed over a WebSocket as deltas against what
+//  that client last got, one byte a column for all but big steps. The
+//  waterfall is the max per column of each new antenna spectrum, or of the
+//  -subint rows when those are on. Endpoints:
+//   /            viewer page
+//   /ws          WebSocket: binary spectrum and row frames, JSON status
+//   /status      JSON status
+//   /spec        binary key frames of the latest spectra
+//   /waterfall   binary key frames of the last HTTPNWF rows, oldest first
+//  A frame is u8 type ('S' spectrum, 'W' row), u8 key, u16 ncol, u8 swpos,
+//  3 spare, u32 seq, f64 secs, then ncol int16 (2*ncol, min then max, for
+//  'S'), or for a delta frame an int8 change per value with -128 followed
+//  by the int16 value for a big one. All little endian
+
+#define HTTPCOL 1024    // columns of the decimated spectra
+#define HTTPNWF 256     // waterfall rows kept
+#define HTTPMAXC 8      // clients
+#define HTTPIN 2048     // request buffer
+#define HTTPHZ 10       // status segment polls per second
+#define HTTPHDR 20      // frame header bytes
+#define HTTPOUT (HTTPNWF * (HTTPHDR + 2 * HTTPCOL) + 4096)    // output buffer per client, holds a /waterfall reply
+
+extern d1type d1;
+
+typedef struct
+{
+ int fd, ws, inn, outn, outoff, closing, wfkey;
+ long long skip;    // payload bytes of a data frame still to be thrown away
+ char in[HTTPIN];
+ unsigned char *out;
+ unsigned spseq[STATNSW], wfseq;
+ short spref[STATNSW][2 * HTTPCOL], wfref[HTTPCOL];
+} hclient;
+
+static hclient hc[HTTPMAXC];
+static int hfd = -1, hrun, hnsp;
+static pthread_t hthr;
+static char hstatname[80];
+static statmap *hmap;
+static stathdr hhdr;
+static float *hspec;
+static short hsp[STATNSW][2 * HTTPCOL];
+static double hspsecs[STATNSW];
+static unsigned hspseq[STATNSW];
+static short hwf[HTTPNWF][HTTPCOL];
+static double hwfsecs[HTTPNWF];
+static unsigned hwfn;    // rows so far, the newest is hwfn-1
+static pthread_mutex_t hwflock = PTHREAD_MUTEX_INITIALIZER;
+static double hbytes;
+
+static const char hpage[] =
+"<!DOCTYPE html><html><head><title>pxspec</title></head><body style='font-family:monospace'>\n"
+"<canvas id='sp' width='1024' height='320'></canvas><br>\n"
+"<canvas id='wf' width='1024' height='256'></canvas><pre id='st'></pre>\n"
+"<script>\n"
+"var ref={},sp=[],wf=document.getElementById('wf').getContext('2d'),st={};\n"
+"var col=['#000','#c00','#00c'];\n"
+"function dec(v,n,key,a){var p=20;if(!a||a.length!=n)a=new Int16Array(n);\n"
+" for(var i=0;i<n;i++){if(key){a[i]=v.getInt16(p,true);p+=2;}\n"
+"  else{var d=v.getInt8(p++);if(d==-128){a[i]=v.getInt16(p,true);p+=2;}else a[i]+=d;}}return a;}\n"
+"function drawsp(){var c=document.getElementById('sp').getContext('2d'),lo=1e9,hi=-1e9,s,i,j,n;\n"
+" c.clearRect(0,0,1024,320);\n"
+" for(s=0;s<3;s++)if(sp[s])for(i=0;i<sp[s].length;i++){if(sp[s][i]<-20000)continue;lo=Math.min(lo,sp[s][i]);hi=Math.max(hi,sp[s][i]);}\n"
+" if(hi<=lo)return;\n"
+" for(s=0;s<3;s++){if(!sp[s])continue;n=sp[s].length/2;c.fillStyle=col[s];\n"
+"  for(i=0;i<n;i++){var y0=310-300*(sp[s][n+i]-lo)/(hi-lo),y1=310-300*(sp[s][i]-lo)/(hi-lo);c.fillRect(i*1024/n,y0,1,Math.max(1,y1-y0));}}\n"
+" c.fillStyle='#000';c.fillText((lo/100).toFixed(1)+' to '+(hi/100).toFixed(1)+' dBm',4,12);}\n"
+"function row(a){var n=a.length,im=wf.getImageData(0,0,1024,255),lo=1e9,hi=-1e9,i,k;wf.putImageData(im,0,1);\n"
+" for(i=0;i<n;i++)if(a[i]>-20000){lo=Math.min(lo,a[i]);hi=Math.max(hi,a[i]);}\n"
+" var r=wf.createImageData(1024,1);for(i=0;i<1024;i++){k=Math.floor(i*n/1024);\n"
+"  var g=hi>lo?Math.max(0,Math.min(255,255*(a[k]-lo)/(hi-lo))):0;r.data[4*i]=r.data[4*i+1]=r.data[4*i+2]=g;r.data[4*i+3]=255;}\n"
+" wf.putImageData(r,0,0);}\n"
+"var ws=new WebSocket('ws://'+location.host+'/ws');ws.binaryType='arraybuffer';\n"
+"ws.onmessage=function(e){if(typeof e.data=='string'){document.getElementById('st').textContent=JSON.stringify(JSON.parse(e.data),null,1);return;}\n"
+" var v=new DataView(e.data),t=v.getUint8(0),key=v.getUint8(1),n=v.getUint16(2,true),s=v.getUint8(4);\n"
+" if(t==83){sp[s]=dec(v,2*n,key,sp[s]);drawsp();}else{ref.wf=dec(v,n,key,ref.wf);row(ref.wf);}};\n"
+"ws.onclose=function(){document.getElementById('st').textContent+='\\nconnection closed';};\n"
+"</script></body></html>\n";
+
+static void *httpthread(void *);
+
+// SHA-1 and base64, for the WebSocket handshake only
+static void sha1(const unsigned char *m, int n, unsigned char out[20])
+{
+  unsigned int h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  unsigned int w[80], a, b, c, d, e, f, k, t;
+  unsigned char blk[64];
+  int i, j, nb;
+  long long bits;
+
+  nb = (n + 8) / 64 + 1;
+  bits = (long long) n * 8;
+  for (j = 0; j < nb; j++) {
+    for (i = 0; i < 64; i++) {
+      k = j * 64 + i;
+      if ((int) k < n) blk[i] = m[k];
+      else if ((int) k == n) blk[i] = 0x80;
+      else if (j == nb - 1 && i >= 56) blk[i] = (unsigned char) (bits >> (8 * (63 - i)));
+      else blk[i] = 0;
+    }
+    for (i = 0; i < 16; i++)
+      w[i] = ((unsigned int) blk[4*i] << 24) | (blk[4*i+1] << 16) | (blk[4*i+2] << 8) | blk[4*i+3];
+    for (i = 16; i < 80; i++) {
+      t = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+      w[i] = (t << 1) | (t >> 31);
+    }
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+    for (i = 0; i < 80; i++) {
+      if (i < 20) { f = (b & c) | (~b & d); k = 0x5a827999; }
+      else if (i < 40) { f = b ^ c ^ d; k = 0x6ed9eba1; }
+      else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+      else { f = b ^ c ^ d; k = 0xca62c1d6; }
+      t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+      e = d; d = c; c = (b << 30) | (b >> 2); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+  for (i = 0; i < 20; i++) out[i] = (unsigned char) (h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+static void base64(const unsigned char *in, int n, char *out)
+{
+  static const char t[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  int i;
+  unsigned int v;
+  for (i = 0; i < n; i += 3) {
+    v = in[i] << 16;
+    if (i + 1 < n) v |= in[i+1] << 8;
+    if (i + 2 < n) v |= in[i+2];
+    *out++ = t[(v >> 18) & 63];
+    *out++ = t[(v >> 12) & 63];
+    *out++ = i + 1 < n ? t[(v >> 6) & 63] : '=';
+    *out++ = i + 2 < n ? t[v & 63] : '=';
+  }
+  *out = 0;
+}
+
+// port 0 is off. The server listens on address addr and reads the status
+//  segment statname
+int http_init(int port, const char *statname, const char *addr)
+{
+  struct sockaddr_in a;
+  struct sched_param sp;
+  int one = 1;
+
+  if (port <= 0) return 0;
+  if ((hfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    printf("cannot open http socket\n");
+    return -1;
+  }
+  setsockopt(hfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&a, 0, sizeof(a));
+  a.sin_family = AF_INET;
+  a.sin_port = htons(port);
+  if (inet_pton(AF_INET, addr, &a.sin_addr) != 1) {
+    printf("http address %s not known\n", addr);
+    close(hfd);
+    hfd = -1;
+    return -1;
+  }
+  if (bind(hfd, (struct sockaddr *) &a, sizeof(a)) || listen(hfd, HTTPMAXC)) {
+    printf("cannot listen on http %s port %d\n", addr, port);
+    close(hfd);
+    hfd = -1;
+    return -1;
+  }
+  fcntl(hfd, F_SETFL, O_NONBLOCK);
+  strncpy(hstatname, statname, sizeof(hstatname) - 1);
+  memset(hc, 0, sizeof(hc));
+  hwfn = 0;
+  hrun = 1;
+  if (pthread_create(&hthr, NULL, httpthread, NULL)) {
+    printf("error creating http thread\n");
+    close(hfd);
+    hfd = -1;
+    hrun = 0;
+    return -1;
+  }
+  memset(&sp, 0, sizeof(sp));
+  if (pthread_setschedparam(hthr, SCHED_IDLE, &sp))
+    printf("http thread not at idle priority\n");
+  printf("http server on %s port %d\n", addr, port);
+  return 0;
+}
+
+void http_free(void)
+{
+  if (!hrun) return;
+  hrun = 0;
+  pthread_join(hthr, NULL);
+  printf("http %1.1f MB sent\n", hbytes / 1e6);
+}
+
+// Min and max in 0.01 dBm of each of ncol columns of sp[0..n-1]
+static void decimate(const float *sp, int n, short *lo, short *hi, int ncol)
+{
+  int c, i, i0, i1;
+  float a, b;
+  for (c = 0; c < ncol; c++) {
+    i0 = (int) ((double) c * n / ncol);
+    i1 = (int) ((double) (c + 1) * n / ncol);
+    if (i1 <= i0) i1 = i0 + 1;
+    if (i1 > n) i1 = n;
+    a = b = sp[i0];
+    for (i = i0 + 1; i < i1; i++) {
+      a = sp[i] < a ? sp[i] : a;
+      b = sp[i] > b ? sp[i] : b;
+    }
+    a = a < -327.0f ? -327.0f : (a > 327.0f ? 327.0f : a);
+    b = b < -327.0f ? -327.0f : (b > 327.0f ? 327.0f : b);
+    if (lo) lo[c] = (short) (a * 100.0f);
+    hi[c] = (short) (b * 100.0f);
+  }
+}
+
+// New waterfall row of n dBm values, from the writer thread for -subint
+//  or from the server for each antenna spectrum
+void http_row(double secs, int swpos, const float *row, int n)
+{
+  unsigned r;
+  if (!hrun || swpos != 0 || n <= 0) return;
+  pthread_mutex_lock(&hwflock);
+  r = hwfn % HTTPNWF;
+  decimate(row, n, NULL, hwf[r], n < HTTPCOL ? n : HTTPCOL);
+  hwfsecs[r] = secs;
+  hwfn++;
+  pthread_mutex_unlock(&hwflock);
+}
+
+// Encode a frame into out, key or as changes against ref, which becomes
+//  cur. Returns its length
+static int frame(unsigned char *out, int type, int key, int ncol, int swpos,
+                 unsigned seq, double secs, const short *cur, short *ref, int n)
+{
+  int i, d, p;
+  out[0] = type;
+  out[1] = key;
+  out[2] = ncol & 255;
+  out[3] = ncol >> 8;
+  out[4] = swpos;
+  out[5] = out[6] = out[7] = 0;
+  memcpy(out + 8, &seq, 4);
+  memcpy(out + 12, &secs, 8);
+  p = HTTPHDR;
+  for (i = 0; i < n; i++) {
+    d = cur[i] - (ref ? ref[i] : 0);
+    if (!key && d >= -127 && d <= 127) out[p++] = (unsigned char) d;
+    else {
+      if (!key) out[p++] = 0x80;
+      out[p++] = cur[i] & 255;
+      out[p++] = (cur[i] >> 8) & 255;
+    }
+    if (ref) ref[i] = cur[i];
+  }
+  return p;
+}
+
+// Queue len bytes for client c, as a WebSocket frame of the given opcode
+//  if op > 0. Returns -1 if it does not fit
+static int hsend(hclient *c, int op, const void *buf, int len)
+{
+  unsigned char h[10];
+  int nh;
+  nh = 0;
+  if (op > 0) {
+    h[0] = 0x80 | op;
+    if (len < 126) { h[1] = len; nh = 2; }
+    else if (len < 65536) { h[1] = 126; h[2] = len >> 8; h[3] = len & 255; nh = 4; }
+    else {
+      h[1] = 127;
+      memset(h + 2, 0, 4);
+      h[6] = len >> 24; h[7] = (len >> 16) & 255; h[8] = (len >> 8) & 255; h[9] = len & 255;
+      nh = 10;
+    }
+  }
+  if (c->outoff > 0 && (c->outoff == c->outn || c->outoff > HTTPOUT / 2)) {
+    memmove(c->out, c->out + c->outoff, c->outn - c->outoff);
+    c->outn -= c->outoff;
+    c->outoff = 0;
+  }
+  if (c->outn + nh + len > HTTPOUT) return -1;
+  memcpy(c->out + c->outn, h, nh);
+  memcpy(c->out + c->outn + nh, buf, len);
+  c->outn += nh + len;
+  return 0;
+}
+
+static int status_json(char *buf, int len)
+{
+  stathdr *h = &hhdr;
+  int i, n;
+  n = snprintf(buf, len,
+               "{\"run\":%d,\"nrun\":%d,\"swpos\":%d,\"secs\":%.3f,\"starttime\":%.0f,\"duty_cycle\":%.4f,"
+               "\"nspec\":%d,\"mfreq\":%.3f,\"fres\":%.3f,\"adcmax\":%.5f,\"adcmin\":%.5f,\"temp\":%.1f,"
+               "\"dropped\":%.0f,\"wdrop\":%d,\"rows\":%u,\"sw\":[",
+               h->run, h->nrun, h->swpos, h->secs, h->starttime, h->duty_cycle, h->nspec, h->mfreq,
+               h->fres, h->adcmax, h->adcmin, h->temp, h->dropped, h->wdrop, hwfn);
+  for (i = 0; i < STATNSW && n < len; i++)
+    n += snprintf(buf + n, len - n, "%s{\"secs\":%.3f,\"numblk\":%d,\"novfl\":%d,\"adcmax\":%.5f,\"adcmin\":%.5f}",
+                  i ? "," : "", h->sw[i].secs, h->sw[i].numblk, h->sw[i].novfl, h->sw[i].adcmax, h->sw[i].adcmin);
+  if (n < len) n += snprintf(buf + n, len - n, "],\"cmd\":\"");
+  for (i = 0; h->cmd[i] && n < len - 4; i++)
+    if (h->cmd[i] != '"' && h->cmd[i] != '\\' && h->cmd[i] >= ' ') buf[n++] = h->cmd[i];
+  if (n < len - 3) n += snprintf(buf + n, len - n, "\"}");
+  return n < len ? n : len - 1;
+}
+
+// Reply to a plain http request and close. A body that does not fit
+//  gets a 503 rather than a short reply
+static void hreply(hclient *c, const char *type, const void *body, int len)
+{
+  char h[256];
+  int n;
+  n = sprintf(h, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %d\r\n"
+              "Cache-Control: no-cache\r\nConnection: close\r\n\r\n", type, len);
+  if (hsend(c, 0, h, n) == 0 && hsend(c, 0, body, len)) {
+    c->outn -= n;    // take the header back
+    n = sprintf(h, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    hsend(c, 0, h, n);
+  }
+  c->closing = 1;
+}
+
+static void hrequest(hclient *c)
+{
+  char path[128], key[128], acc[64], *p;
+  unsigned char dig[20], *buf;
+  int n, s, len;
+  unsigned r;
+
+  path[0] = key[0] = 0;
+  sscanf(c->in, "GET %127s", path);
+  if ((p = strcasestr(c->in, "Sec-WebSocket-Key:")) != NULL) sscanf(p + 18, "%127s", key);
+  if (strcmp(path, "/ws") == 0 && key[0]) {
+    strcat(key, "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    sha1((unsigned char *) key, strlen(key), dig);
+    base64(dig, 20, acc);
+    n = sprintf(c->in, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", acc);
+    hsend(c, 0, c->in, n);
+    c->ws = 1;
+    c->inn = 0;
+    c->wfkey = 1;
+    c->wfseq = hwfn > HTTPNWF ? hwfn - HTTPNWF : 0;
+    memset(c->spseq, 0, sizeof(c->spseq));
+    return;
+  }
+  len = HTTPHDR + 2 * 2 * HTTPCOL;
+  if ((buf = (unsigned char *) malloc(len * (HTTPNWF > STATNSW ? HTTPNWF : STATNSW))) == NULL) {
+    c->closing = 1;
+    return;
+  }
+  if (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0)
+    hreply(c, "text/html", hpage, strlen(hpage));
+  else if (strcmp(path, "/status") == 0) {
+    n = status_json((char *) buf, len);
+    hreply(c, "application/json", buf, n);
+  }
+  else if (strcmp(path, "/spec") == 0) {
+    for (s = 0, n = 0; s < STATNSW; s++)
+      if (hspseq[s])
+        n += frame(buf + n, 'S', 1, hnsp, s, hspseq[s], hspsecs[s], hsp[s], NULL, 2 * hnsp);
+    hreply(c, "application/octet-stream", buf, n);
+  }
+  else if (strcmp(path, "/waterfall") == 0) {
+    pthread_mutex_lock(&hwflock);
+    for (r = hwfn > HTTPNWF ? hwfn - HTTPNWF : 0, n = 0; r < hwfn; r++)
+      n += frame(buf + n, 'W', 1, hnsp, 0, r, hwfsecs[r % HTTPNWF], hwf[r % HTTPNWF], NULL, hnsp);
+    pthread_mutex_unlock(&hwflock);
+    hreply(c, "application/octet-stream", buf, n);
+  }
+  else {
+    n = sprintf(c->in, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    hsend(c, 0, c->in, n);
+    c->closing = 1;
+  }
+  free(buf);
+}
+
+// Read the status segment and push whatever is new to the WebSocket clients
+static void hupdate(void)
+{
+  static unsigned lastseq = ~0u;
+  static double lastsecs[STATNSW];
+  static unsigned char *fb;
+  static char js[2048];
+  static int hnspec;    // spectra hspec is sized for
+  unsigned seq, r;
+  int s, i, n, nj;
+  short lo[HTTPCOL];
+  hclient *c;
+
+  if (hmap == NULL && (hmap = stat_open(hstatname)) == NULL) return;
+  if (fb == NULL && (fb = (unsigned char *) malloc(HTTPHDR + 3 * 2 * HTTPCOL)) == NULL) return;
+  // the header first, for the size of the spectra
+  stat_snapshot(hmap, &hhdr, NULL, 0);
+  if (hspec == NULL || hnspec != hhdr.nspec) {
+    free(hspec);
+    hnspec = hhdr.nspec;
+    if ((hspec = (float *) calloc((size_t) STATNSW * hnspec + 1, sizeof(float))) == NULL) {
+      hnspec = 0;
+      return;
+    }
+  }
+  seq = stat_snapshot(hmap, &hhdr, hspec, STATNSW * hnspec);
+  if (hhdr.nspec != hnspec) return;    // resized in between, next poll
+  if (seq == lastseq) nj = 0;
+  else {
+    lastseq = seq;
+    hnsp = hhdr.nspec < HTTPCOL ? hhdr.nspec : HTTPCOL;
+    for (s = 0; s < STATNSW; s++)
+      if (hhdr.sw[s].secs > 0 && hhdr.sw[s].secs != lastsecs[s]) {
+        lastsecs[s] = hhdr.sw[s].secs;
+        decimate(hspec + s * hhdr.nspec, hhdr.nspec, lo, hsp[s] + hnsp, hnsp);
+        memcpy(hsp[s], lo, sizeof(short) * hnsp);
+        hspsecs[s] = hhdr.sw[s].secs;
+        hspseq[s]++;
+        if (s == 0 && hhdr.sw[0].numblk > 0 && !d1.subint) http_row(hspsecs[0], 0, hspec, hhdr.nspec);
+      }
+    nj = status_json(js, sizeof(js));
+  }
+  for (i = 0; i < HTTPMAXC; i++) {
+    c = &hc[i];
+    if (c->fd <= 0 || !c->ws || c->closing) continue;
+    for (s = 0; s < STATNSW; s++)
+      if (hspseq[s] != c->spseq[s]) {
+        n = frame(fb, 'S', !c->spseq[s], hnsp, s, hspseq[s], hspsecs[s], hsp[s], c->spref[s], 2 * hnsp);
+        if (hsend(c, 2, fb, n) == 0) c->spseq[s] = hspseq[s];
+        else c->spseq[s] = 0;    // skipped - the next one is a key frame
+      }
+    pthread_mutex_lock(&hwflock);
+    if (hwfn - c->wfseq > HTTPNWF) c->wfseq = hwfn - HTTPNWF;
+    for (r = c->wfseq; r < hwfn; r++) {
+      n = frame(fb, 'W', c->wfkey, hnsp, 0, r, hwfsecs[r % HTTPNWF], hwf[r % HTTPNWF], c->wfref, hnsp);
+      if (hsend(c, 2, fb, n)) {
+        c->wfkey = 1;
+        break;
+      }
+      c->wfkey = 0;
+    }
+    c->wfseq = r;
+    pthread_mutex_unlock(&hwflock);
+    if (nj > 0) hsend(c, 1, js, nj);
+  }
+}
+
+// WebSocket frames from the browser, in c->in[0..inn-1]. Nothing but
+//  control frames is expected: a close is answered and the connection
+//  closed, a ping gets its pong, and the payload of anything else is
+//  skipped. What is left of an incomplete frame stays in c->in
+static void hframes(hclient *c)
+{
+  unsigned char *p;
+  long long len;
+  int i, k, op, nh;
+
+  p = (unsigned char *) c->in;
+  k = 0;
+  while (!c->closing) {
+    if (c->skip > 0) {
+      i = c->inn - k < c->skip ? c->inn - k : (int) c->skip;
+      k += i;
+      c->skip -= i;
+      if (c->skip > 0) break;
+    }
+    if (c->inn - k < 2) break;
+    op = p[k] & 0x0f;
+    len = p[k+1] & 0x7f;
+    nh = 2;
+    if (len == 126) nh = 4;
+    else if (len == 127) nh = 10;
+    if (p[k+1] & 0x80) nh += 4;
+    if (c->inn - k < nh) break;
+    if (len == 126) len = (p[k+2] << 8) | p[k+3];
+    else if (len == 127)
+      for (len = 0, i = 2; i < 10; i++) len = (len << 8) | p[k+i];
+    if (op < 8) {
+      // data, skipped
+      k += nh;
+      c->skip = len;
+      continue;
+    }
+    if (len > 125) {
+      c->closing = 1;    // not a valid control frame
+      break;
+    }
+    if (c->inn - k < nh + len) break;
+    if (p[k+1] & 0x80)
+      for (i = 0; i < len; i++) p[k+nh+i] ^= p[k+nh-4+(i&3)];
+    if (op == 8) {
+      hsend(c, 8, p + k + nh, len < 2 ? (int) len : 2);    // the status back
+      c->closing = 1;
+    }
+    else if (op == 9) hsend(c, 10, p + k + nh, (int) len);
+    k += nh + (int) len;
+  }
+  if (k > 0) {
+    memmove(c->in, c->in + k, c->inn - k);
+    c->inn -= k;
+  }
+}
+
+static void hdrop(hclient *c)
+{
+  close(c->fd);
+  free(c->out);
+  memset(c, 0, sizeof(*c));
+}
+
+static void *httpthread(void *arg)
+{
+  struct pollfd pf[HTTPMAXC + 1];
+  hclient *c;
+  int i, n, fd;
+
+  (void) arg;
+  while (hrun) {
+    pf[0].fd = hfd;
+    pf[0].events = POLLIN;
+    for (i = 0; i < HTTPMAXC; i++) {
+      c = &hc[i];
+      pf[i+1].fd = c->fd > 0 ? c->fd : -1;
+      pf[i+1].events = POLLIN | (c->outn > c->outoff ? POLLOUT : 0);
+      pf[i+1].revents = 0;
+    }
+    if (poll(pf, HTTPMAXC + 1, 1000 / HTTPHZ) < 0 && errno != EINTR) break;
+    if (pf[0].revents & POLLIN)
+      while ((fd = accept(hfd, NULL, NULL)) >= 0) {
+        for (i = 0; i < HTTPMAXC && hc[i].fd > 0; i++) ;
+        if (i == HTTPMAXC || (hc[i].out = (unsigned char *) malloc(HTTPOUT)) == NULL) {
+          close(fd);
+          continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        hc[i].fd = fd;
+      }
+    for (i = 0; i < HTTPMAXC; i++) {
+      c = &hc[i];
+      if (c->fd <= 0) continue;
+      if (pf[i+1].revents & (POLLIN | POLLHUP | POLLERR)) {
+        n = recv(c->fd, c->in + c->inn, HTTPIN - 1 - c->inn, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN)) {
+          hdrop(c);
+          continue;
+        }
+        if (n > 0 && c->ws) {
+          c->inn += n;
+          hframes(c);
+        }
+        else if (n > 0) {
+          c->inn += n;
+          c->in[c->inn] = 0;
+          if (strstr(c->in, "\r\n\r\n")) hrequest(c);
+          else if (c->inn >= HTTPIN - 1) hdrop(c);
+        }
+      }
+    }
+    hupdate();
+    for (i = 0; i < HTTPMAXC; i++) {
+      c = &hc[i];
+      if (c->fd <= 0) continue;
+      if (c->outn > c->outoff) {
+        n = send(c->fd, c->out + c->outoff, c->outn - c->outoff, MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN) {
+          hdrop(c);
+          continue;
+        }
+        if (n > 0) {
+          c->outoff += n;
+          hbytes += n;
+        }
+      }
+      if (c->closing && c->outoff == c->outn) hdrop(c);
+    }
+  }
+  for (i = 0; i < HTTPMAXC; i++)
+    if (hc[i].fd > 0) hdrop(&hc[i]);
+  close(hfd);
+  hfd = -1;
+  stat_close(hmap);
+  hmap = NULL;
+  pthread_exit(NULL);
+}
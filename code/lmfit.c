@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lmfit.h"
+
+// Marquardt's damped Gauss-Newton: each iteration forms J'WJ and J'Wr once
+//  and tries steps (J'WJ + lambda diag(J'WJ)) dp = J'Wr for rising lambda
+//  until chi2 goes down. The trial steps only need the model values, the
+//  Jacobian is evaluated again only at a step that is taken. The diagonal
+//  scaling makes the damping independent of the units of the parameters,
+//  which for edgestest range from kelvin amplitudes to percent and ns
+
+#define LMLMIN 1e-12
+#define LMLMAX 1e12
+
+// np x np positive definite a into its Cholesky factor, then solve a x = b
+static int lmchol(double *a, int np, double *x, const double *b)
+{
+  int i, j, k;
+  double s;
+
+  for (j = 0; j < np; j++) {
+    s = a[j + j*np];
+    for (k = 0; k < j; k++) s -= a[j + k*np] * a[j + k*np];
+    if (s <= 0.0) return -1;
+    a[j + j*np] = sqrt(s);
+    for (i = j + 1; i < np; i++) {
+      s = a[i + j*np];
+      for (k = 0; k < j; k++) s -= a[i + k*np] * a[j + k*np];
+      a[i + j*np] = s / a[j + j*np];
+    }
+  }
+  for (i = 0; i < np; i++) {
+    s = b[i];
+    for (k = 0; k < i; k++) s -= a[i + k*np] * x[k];
+    x[i] = s / a[i + i*np];
+  }
+  for (i = np - 1; i >= 0; i--) {
+    s = x[i];
+    for (k = i + 1; k < np; k++) s -= a[k + i*np] * x[k];
+    x[i] = s / a[i + i*np];
+  }
+  return 0;
+}
+
+static double lmchi2(int m, const double *y, const double *w, const double *f)
+{
+  int i;
+  double r, chi2;
+  chi2 = 0.0;
+  for (i = 0; i < m; i++) {
+    if (w && w[i] <= 0.0) continue;
+    r = y[i] - f[i];
+    chi2 += (w ? w[i] : 1.0) * r * r;
+  }
+  return chi2;
+}
+
+// Fits p in place from its starting values, at most maxit iterations.
+//  Returns the iterations taken, or -1 if the model fails at the start;
+//  chi2 if not NULL gets the weighted sum of squared residuals
+int lm_fit(int m, int np, const double *y, const double *w, double *p, lmfn fn, void *ctx,
+           int maxit, double *chi2)
+{
+  int i, j, k, it, ok;
+  double *f, *ft, *jac, *wr, *a, *ad, *g, *dp, *pt;
+  double c2, c2t, lambda, s, d;
+
+  if (np < 1 || np > LMMAXP) return -1;
+  f = (double *) malloc(((size_t) m * (np + 3) + 5 * np + 2 * np * np) * sizeof(double));
+  if (f == NULL) return -1;
+  ft = f + m;
+  wr = ft + m;
+  jac = wr + m;
+  a = jac + (size_t) m * np;
+  ad = a + np * np;
+  g = ad + np * np;
+  dp = g + np;
+  pt = dp + np;
+  if (fn(p, f, jac, ctx)) {
+    free(f);
+    return -1;
+  }
+  c2 = lmchi2(m, y, w, f);
+  lambda = 1e-3;
+  for (it = 0; it < maxit; it++) {
+    // J'WJ and J'Wr
+    for (i = 0; i < m; i++) wr[i] = (w && w[i] <= 0.0) ? 0.0 : (w ? w[i] : 1.0);
+    for (j = 0; j < np; j++) {
+      for (k = 0; k <= j; k++) {
+        s = 0.0;
+        for (i = 0; i < m; i++) s += wr[i] * jac[i + (size_t) j*m] * jac[i + (size_t) k*m];
+        a[j + k*np] = a[k + j*np] = s;
+      }
+      s = 0.0;
+      for (i = 0; i < m; i++) s += wr[i] * jac[i + (size_t) j*m] * (y[i] - f[i]);
+      g[j] = s;
+    }
+    ok = 0;
+    while (lambda <= LMLMAX) {
+      memcpy(ad, a, np * np * sizeof(double));
+      for (j = 0; j < np; j++) {
+        d = a[j + j*np];
+        ad[j + j*np] = d + lambda * (d > 0.0 ? d : 1e-30);
+      }
+      if (lmchol(ad, np, dp, g) == 0) {
+        for (j = 0; j < np; j++) pt[j] = p[j] + dp[j];
+        if (fn(pt, ft, NULL, ctx) == 0 && (c2t = lmchi2(m, y, w, ft)) <= c2) {
+          ok = 1;
+          break;
+        }
+      }
+      lambda *= 10.0;
+    }
+    if (!ok) break;          // no step lowers chi2: at the minimum
+    memcpy(p, pt, np * sizeof(double));
+    lambda = fmax(lambda * 0.1, LMLMIN);
+    d = 0.0;
+    for (j = 0; j < np; j++) d = fmax(d, fabs(dp[j]) / (fabs(p[j]) + 1e-10));
+    if (c2 - c2t <= 1e-12 * c2 || d < 1e-10) {
+      c2 = c2t;
+      memcpy(f, ft, m * sizeof(double));
+      it++;
+      break;
+    }
+    c2 = c2t;
+    if (fn(p, f, jac, ctx)) break;
+  }
+  if (chi2) *chi2 = c2;
+  free(f);
+  return it;
+}
@@ -0,0 +1,13 @@
+/* Levenberg-Marquardt nonlinear least squares (lmfit.c)
+ *
+ * Fits y[i] ~ f_i(p) over i = 0..m-1 with weights w[i] by adjusting the np
+ * parameters p. The model fills f[m] for the parameters it is given and,
+ * when jac is not NULL, the derivatives jac[i + j*m] = df_i/dp_j, by column
+ * as in lsq.c. A weight <= 0 leaves the point out, and w may be NULL for
+ * all 1. The model returns 0, or -1 for parameters it cannot evaluate */
+
+#define LMMAXP 128    // most parameters
+
+typedef int (*lmfn)(const double *, double *, double *, void *);
+
+int lm_fit (int, int, const double *, const double *, double *, lmfn, void *, int, double *);
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "lnasim.h"
+
+// sim() from edgestest.c as a structure of arrays kernel. The nodal matrix
+//  of memo 62 does not depend on which noise source drives the circuit, so
+//  only the first row of its inverse is needed, once per frequency, and
+//  every source is a fixed combination of it. The output power is then a
+//  sum of |source|^2 |transfer|^2 terms, with no square roots. The complex
+//  arithmetic is written out on re, im pairs so the loop over frequency
+//  vectorizes, built per cpu as in winconv.c; only the HEMT delay term
+//  sin(w tau) is done point by point ahead of it
+
+#if defined(__x86_64__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define LNA_SIMD
+#endif
+
+#define PI 3.1415926536
+
+typedef struct
+{
+ double r, i;
+} cv;
+
+#define INL static inline __attribute__((always_inline))
+
+INL cv cvset(double r, double i) { cv c; c.r = r; c.i = i; return c; }
+INL cv cvadd(cv a, cv b) { return cvset(a.r + b.r, a.i + b.i); }
+INL cv cvsub(cv a, cv b) { return cvset(a.r - b.r, a.i - b.i); }
+INL cv cvscl(cv a, double s) { return cvset(a.r * s, a.i * s); }
+INL cv cvmul(cv a, cv b) { return cvset(a.r * b.r - a.i * b.i, a.r * b.i + a.i * b.r); }
+INL double cvnorm(cv a) { return a.r * a.r + a.i * a.i; }
+INL cv cvrcp(cv a) { double d = 1.0 / cvnorm(a); return cvset(a.r * d, -a.i * d); }
+INL cv cvdiv(cv a, cv b) { return cvmul(a, cvrcp(b)); }
+
+// pwr[k] holds sin(w tau) on the way in
+INL void lnabody(int n, const double *freq, const double *tsky, const double *zr, const double *zi,
+                 const lnapar *lp, double *pwr)
+{
+  int k;
+  double w, c, L, cout, cg, Lin, Cin, rin, rinc, zout, rg, nin;
+  cv Rs, Ro, yi, g, Rf, Z1, Z2, Z3, Zin0, Zin, Rfz, q, p;
+  cv a00, a01, a02, a10, a12, a20, a21, a22, d, aa00, aa01, aa02, t;
+
+  c = 0.65e-12*lp->ccf;  // gate drain capacitance
+  L = 0.4e-9;        // HEMT source inductance
+  cout = 1.2e-12;
+  cg = 1.12e-12;
+  zout = 30.0 + 50.0;
+  rg = 2.5;
+  Lin = lp->lin;
+  Cin = lp->cin;
+  rin = 1.0;
+  rinc = 1.0;
+  for (k = 0; k < n; k++) {
+    w = freq[k]*1e6*2.0*PI;
+    Rs = cvset(0.5, w*L);
+    Ro = cvrcp(cvset(1.0/150.0, w*cout));
+    yi = cvset(0.0, w*cg);                  // 1/y
+    g = cvset(0.41*lp->cf, -pwr[k]);
+    Rf = cvrcp(cvset(1.0/1200.0, w*c));
+    Z3 = cvset(rin, w*Lin);
+    Z1 = cvrcp(cvadd(cvrcp(Z3), cvset(0.0, w*1.8e-12)));
+    Z2 = cvset(rinc, -1.0/(w*Cin));
+    Zin0 = cvset(zr[k], zi[k]);
+    Zin = cvadd(cvrcp(cvadd(cvrcp(Zin0), cvrcp(Z1))), Z2);
+    Zin = cvrcp(cvadd(cvrcp(Zin), cvrcp(Z3)));
+    Rfz = cvrcp(cvadd(Rf, Zin));            // 1/(Rf+Zin)
+    q = cvmul(Rf, yi);                      // Rf/y
+
+    a00 = cvrcp(Ro);
+    a01 = cvsub(cvset(-1.0, 0.0), cvmul(Rs, a00));
+    a02 = cvadd(g, yi);
+    a10 = cvsub(cvset(-1.0/zout, 0.0), Rfz);
+    a12 = cvscl(cvmul(q, Rfz), -1.0);
+    a20 = cvsub(cvset(1.0, 0.0), cvmul(Rf, Rfz));
+    a21 = cvscl(Rs, -1.0);
+    a22 = cvsub(cvadd(cvsub(cvset(-1.0, 0.0), cvmul(q, cvmul(Rf, Rfz))), q), cvscl(yi, rg));
+    d = cvadd(cvadd(cvmul(a10, cvmul(a21, a02)), cvmul(a20, cvmul(a01, a12))), cvmul(a20, a02));
+    d = cvsub(d, cvadd(cvadd(cvmul(a00, a22), cvmul(a10, cvmul(a01, a22))), cvmul(a21, cvmul(a12, a00))));
+    // first row of the inverse, a11 = -1
+    d = cvrcp(d);
+    aa00 = cvmul(cvsub(cvscl(a22, -1.0), cvmul(a21, a12)), d);
+    aa01 = cvmul(cvsub(cvmul(a21, a02), cvmul(a01, a22)), d);
+    aa02 = cvmul(cvadd(cvmul(a01, a12), a02), d);
+
+    // the four input circuit sources: sky, diodes, coupling cap, inductor
+    p = cvmul(Z3, cvdiv(Z1, cvadd(cvadd(Z1, Z2), Z3)));
+    p = cvdiv(p, cvadd(Zin0, cvrcp(cvadd(cvrcp(Z1), cvrcp(cvadd(Z2, Z3))))));
+    nin = 4.0*tsky[k]*Zin0.r*cvnorm(p);
+    p = cvmul(Z3, cvdiv(Zin0, cvadd(cvadd(Zin0, Z2), Z3)));
+    p = cvdiv(p, cvadd(Z1, cvrcp(cvadd(cvrcp(Zin0), cvrcp(cvadd(Z2, Z3))))));
+    nin += 4.0*Z1.r*cvnorm(p);
+    q = cvrcp(cvadd(cvrcp(Zin0), cvrcp(Z1)));
+    p = cvrcp(cvadd(cvadd(Z2, Z3), q));
+    nin += 4.0*Z2.r*cvnorm(cvmul(Z3, p));
+    nin += 4.0*Z3.r*cvnorm(cvmul(cvadd(Z2, q), p));
+    // a unit source at the input drives b = (0, -1, -Rf)/(Rf+Zin)
+    t = cvscl(cvmul(cvadd(aa01, cvmul(aa02, Rf)), Rfz), -1.0);
+    pwr[k] = nin*cvnorm(t);
+    pwr[k] += 4.0*rg*cvnorm(aa02);                                           // gate
+    pwr[k] += 4.0*Rf.r*cvnorm(cvadd(t, aa02));                               // feedback
+    pwr[k] += 4.0*Rs.r*cvnorm(cvadd(cvmul(aa00, a00), aa02));                // source
+    pwr[k] += 4.0*Ro.r*cvnorm(cvmul(aa00, a00));                             // drain
+    pwr[k] += 4.0*zout*cvnorm(aa01)/(zout*zout);                             // output
+  }
+}
+
+// Forward mode for lna_jac(): a value with its derivatives on zr, zi, cf
+//  and ccf, carried through the same circuit as lnabody(). Parts of the
+//  circuit that none of the four reach stay plain cv
+#define LNAD 4
+
+typedef struct
+{
+ cv v, d[LNAD];
+} dcv;
+
+typedef struct
+{
+ double v, d[LNAD];
+} dre;
+
+INL dcv dcon(cv a) { dcv x; int j; x.v = a; for (j = 0; j < LNAD; j++) x.d[j] = cvset(0.0, 0.0); return x; }
+INL dcv dadd(dcv a, dcv b) { int j; a.v = cvadd(a.v, b.v); for (j = 0; j < LNAD; j++) a.d[j] = cvadd(a.d[j], b.d[j]); return a; }
+INL dcv dsub(dcv a, dcv b) { int j; a.v = cvsub(a.v, b.v); for (j = 0; j < LNAD; j++) a.d[j] = cvsub(a.d[j], b.d[j]); return a; }
+INL dcv daddc(dcv a, cv b) { a.v = cvadd(a.v, b); return a; }
+INL dcv dscl(dcv a, double s) { int j; a.v = cvscl(a.v, s); for (j = 0; j < LNAD; j++) a.d[j] = cvscl(a.d[j], s); return a; }
+INL dcv dmulc(dcv a, cv b) { int j; a.v = cvmul(a.v, b); for (j = 0; j < LNAD; j++) a.d[j] = cvmul(a.d[j], b); return a; }
+INL dcv dmul(dcv a, dcv b)
+{
+  dcv x;
+  int j;
+  x.v = cvmul(a.v, b.v);
+  for (j = 0; j < LNAD; j++) x.d[j] = cvadd(cvmul(a.d[j], b.v), cvmul(a.v, b.d[j]));
+  return x;
+}
+INL dcv drcp(dcv a)
+{
+  dcv x;
+  cv t;
+  int j;
+  x.v = cvrcp(a.v);
+  t = cvscl(cvmul(x.v, x.v), -1.0);
+  for (j = 0; j < LNAD; j++) x.d[j] = cvmul(a.d[j], t);
+  return x;
+}
+INL dcv ddiv(dcv a, dcv b) { return dmul(a, drcp(b)); }
+INL dre dnorm(dcv a)
+{
+  dre x;
+  int j;
+  x.v = cvnorm(a.v);
+  for (j = 0; j < LNAD; j++) x.d[j] = 2.0 * (a.v.r * a.d[j].r + a.v.i * a.d[j].i);
+  return x;
+}
+INL dre dreal(dcv a) { dre x; int j; x.v = a.v.r; for (j = 0; j < LNAD; j++) x.d[j] = a.d[j].r; return x; }
+INL dre dradd(dre a, dre b) { int j; a.v += b.v; for (j = 0; j < LNAD; j++) a.d[j] += b.d[j]; return a; }
+INL dre drscl(dre a, double s) { int j; a.v *= s; for (j = 0; j < LNAD; j++) a.d[j] *= s; return a; }
+INL dre drmul(dre a, dre b)
+{
+  dre x;
+  int j;
+  x.v = a.v * b.v;
+  for (j = 0; j < LNAD; j++) x.d[j] = a.d[j] * b.v + a.v * b.d[j];
+  return x;
+}
+
+// lnabody() on dcv, dpwr[k + j*n] for the LNAD derivatives
+INL void lnajbody(int n, const double *freq, const double *tsky, const double *zr, const double *zi,
+                  const lnapar *lp, double *pwr, double *dpwr)
+{
+  int j, k;
+  double w, c, L, cout, cg, Lin, Cin, rin, rinc, zout, rg;
+  cv Rs, Ro, yi, Z1, Z2, Z3, Z23, a00, a01, a21;
+  dcv g, Rf, Zin0, Zin, Rfz, q, p, a02, a10, a12, a20, a22, d, aa00, aa01, aa02, t;
+  dre nin, P;
+
+  c = 0.65e-12*lp->ccf;
+  L = 0.4e-9;
+  cout = 1.2e-12;
+  cg = 1.12e-12;
+  zout = 30.0 + 50.0;
+  rg = 2.5;
+  Lin = lp->lin;
+  Cin = lp->cin;
+  rin = 1.0;
+  rinc = 1.0;
+  for (k = 0; k < n; k++) {
+    w = freq[k]*1e6*2.0*PI;
+    Rs = cvset(0.5, w*L);
+    Ro = cvrcp(cvset(1.0/150.0, w*cout));
+    yi = cvset(0.0, w*cg);
+    g = dcon(cvset(0.41*lp->cf, -pwr[k]));
+    g.d[2] = cvset(0.41, 0.0);
+    Rf = dcon(cvset(1.0/1200.0, w*c));
+    Rf.d[3] = cvset(0.0, w*0.65e-12);
+    Rf = drcp(Rf);
+    Z3 = cvset(rin, w*Lin);
+    Z1 = cvrcp(cvadd(cvrcp(Z3), cvset(0.0, w*1.8e-12)));
+    Z2 = cvset(rinc, -1.0/(w*Cin));
+    Z23 = cvadd(Z2, Z3);
+    Zin0 = dcon(cvset(zr[k], zi[k]));
+    Zin0.d[0] = cvset(1.0, 0.0);
+    Zin0.d[1] = cvset(0.0, 1.0);
+    Zin = daddc(drcp(daddc(drcp(Zin0), cvrcp(Z1))), Z2);
+    Zin = drcp(daddc(drcp(Zin), cvrcp(Z3)));
+    Rfz = drcp(dadd(Rf, Zin));
+    q = dmulc(Rf, yi);
+
+    a00 = cvrcp(Ro);
+    a01 = cvsub(cvset(-1.0, 0.0), cvmul(Rs, a00));
+    a02 = daddc(g, yi);
+    a10 = dscl(daddc(Rfz, cvset(1.0/zout, 0.0)), -1.0);
+    a12 = dscl(dmul(q, Rfz), -1.0);
+    a20 = daddc(dscl(dmul(Rf, Rfz), -1.0), cvset(1.0, 0.0));
+    a21 = cvscl(Rs, -1.0);
+    a22 = daddc(dsub(q, dmul(q, dmul(Rf, Rfz))), cvsub(cvset(-1.0, 0.0), cvscl(yi, rg)));
+    d = dadd(dadd(dmul(a10, dmulc(a02, a21)), dmul(a20, dmulc(a12, a01))), dmul(a20, a02));
+    d = dsub(d, dadd(dadd(dmulc(a22, a00), dmul(a10, dmulc(a22, a01))), dmulc(dmulc(a12, a00), a21)));
+    d = drcp(d);
+    aa00 = dmul(dsub(dscl(a22, -1.0), dmulc(a12, a21)), d);
+    aa01 = dmul(dsub(dmulc(a02, a21), dmulc(a22, a01)), d);
+    aa02 = dmul(dadd(dmulc(a12, a01), a02), d);
+
+    p = dmulc(drcp(daddc(Zin0, cvrcp(cvadd(cvrcp(Z1), cvrcp(Z23))))),
+              cvmul(Z3, cvdiv(Z1, cvadd(Z1, Z23))));
+    nin = drscl(drmul(dreal(Zin0), dnorm(p)), 4.0*tsky[k]);
+    p = dmulc(ddiv(Zin0, daddc(Zin0, Z23)), Z3);
+    p = ddiv(p, daddc(drcp(daddc(drcp(Zin0), cvrcp(Z23))), Z1));
+    nin = dradd(nin, drscl(dnorm(p), 4.0*Z1.r));
+    q = drcp(daddc(drcp(Zin0), cvrcp(Z1)));
+    p = drcp(daddc(q, Z23));
+    nin = dradd(nin, drscl(dnorm(dmulc(p, Z3)), 4.0*Z2.r));
+    nin = dradd(nin, drscl(dnorm(dmul(daddc(q, Z2), p)), 4.0*Z3.r));
+    t = dscl(dmul(dadd(aa01, dmul(aa02, Rf)), Rfz), -1.0);
+    P = drmul(nin, dnorm(t));
+    P = dradd(P, drscl(dnorm(aa02), 4.0*rg));
+    P = dradd(P, drscl(drmul(dreal(Rf), dnorm(dadd(t, aa02))), 4.0));
+    P = dradd(P, drscl(dnorm(dadd(dmulc(aa00, a00), aa02)), 4.0*Rs.r));
+    P = dradd(P, drscl(dnorm(dmulc(aa00, a00)), 4.0*Ro.r));
+    P = dradd(P, drscl(dnorm(aa01), 4.0/zout));
+    pwr[k] = P.v;
+    for (j = 0; j < LNAD; j++) dpwr[k + j*n] = P.d[j];
+  }
+}
+
+static void lna_scalar(int n, const double *freq, const double *tsky, const double *zr,
+                       const double *zi, const lnapar *lp, double *pwr)
+{
+  lnabody(n, freq, tsky, zr, zi, lp, pwr);
+}
+
+static void lnaj_scalar(int n, const double *freq, const double *tsky, const double *zr,
+                        const double *zi, const lnapar *lp, double *pwr, double *dpwr)
+{
+  lnajbody(n, freq, tsky, zr, zi, lp, pwr, dpwr);
+}
+
+#ifdef LNA_SIMD
+__attribute__((target("avx2,fma")))
+static void lna_avx2(int n, const double *freq, const double *tsky, const double *zr,
+                     const double *zi, const lnapar *lp, double *pwr)
+{
+  lnabody(n, freq, tsky, zr, zi, lp, pwr);
+}
+
+__attribute__((target("avx512f")))
+static void lna_avx512(int n, const double *freq, const double *tsky, const double *zr,
+                       const double *zi, const lnapar *lp, double *pwr)
+{
+  lnabody(n, freq, tsky, zr, zi, lp, pwr);
+}
+
+__attribute__((target("avx2,fma")))
+static void lnaj_avx2(int n, const double *freq, const double *tsky, const double *zr,
+                      const double *zi, const lnapar *lp, double *pwr, double *dpwr)
+{
+  lnajbody(n, freq, tsky, zr, zi, lp, pwr, dpwr);
+}
+
+__attribute__((target("avx512f")))
+static void lnaj_avx512(int n, const double *freq, const double *tsky, const double *zr,
+                        const double *zi, const lnapar *lp, double *pwr, double *dpwr)
+{
+  lnajbody(n, freq, tsky, zr, zi, lp, pwr, dpwr);
+}
+#endif
+
+typedef void (*lnakern)(int, const double *, const double *, const double *, const double *,
+                        const lnapar *, double *);
+
+static lnakern lnasel(const char **name)
+{
+  lnakern f;
+  f = lna_scalar;
+  *name = "scalar";
+#ifdef LNA_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    f = lna_avx2;
+    *name = "avx2";
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    f = lna_avx512;
+    *name = "avx512";
+  }
+#endif
+  return f;
+}
+
+const char *lna_simd(void)
+{
+  const char *name;
+  lnasel(&name);
+  return name;
+}
+
+void lna_nominal(lnapar *lp)
+{
+  lp->cf = lp->ccf = 1.0;
+  lp->tau = 12.0e-12;
+  lp->lin = 270e-9;   // 270 nH on input may be increased in future
+  lp->cin = 100e-12;  // 100 pf coupling may be increased in future
+}
+
+// pwr[k] for n points, arbitrary scale as in sim()
+void lna_sim(int n, const double *freq, const double *tsky, const double *zr, const double *zi,
+             const lnapar *lp, double *pwr)
+{
+  int k;
+  const char *name;
+  for (k = 0; k < n; k++) pwr[k] = sin(freq[k]*1e6*2.0*PI*lp->tau);    // HEMT delay
+  lnasel(&name)(n, freq, tsky, zr, zi, lp, pwr);
+}
+
+typedef void (*lnajkern)(int, const double *, const double *, const double *, const double *,
+                         const lnapar *, double *, double *);
+
+static lnajkern lnajsel(void)
+{
+  lnajkern f;
+  f = lnaj_scalar;
+#ifdef LNA_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) f = lnaj_avx2;
+  if (__builtin_cpu_supports("avx512f")) f = lnaj_avx512;
+#endif
+  return f;
+}
+
+// lna_sim() and its derivatives on zr, zi, cf and ccf in dpwr[k + j*n]
+void lna_jac(int n, const double *freq, const double *tsky, const double *zr, const double *zi,
+             const lnapar *lp, double *pwr, double *dpwr)
+{
+  int k;
+  for (k = 0; k < n; k++) pwr[k] = sin(freq[k]*1e6*2.0*PI*lp->tau);
+  lnajsel()(n, freq, tsky, zr, zi, lp, pwr, dpwr);
+}
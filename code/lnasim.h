@@ -0,0 +1,21 @@
+/* LNA noise model over a frequency grid (lnasim.c)
+ *
+ * lna_sim() gives edgestest's sim() for every point of a grid in one call:
+ * freq in MHz, tsky as a ratio to ambient, source impedance zr + j zi.
+ * lna_nominal() fills in the component values sim() has built in.
+ * lna_jac() gives the same with the derivatives on zr, zi, cf and ccf, in
+ * that order, by column in dpwr[k + j*n] */
+
+typedef struct
+{
+ double cf, ccf;    // scale factors on the transconductance, gate drain cap
+ double tau;        // HEMT delay s
+ double lin, cin;   // input inductor H, coupling cap F
+} lnapar;
+
+void lna_nominal (lnapar *);
+void lna_sim (int, const double *, const double *, const double *, const double *,
+              const lnapar *, double *);
+void lna_jac (int, const double *, const double *, const double *, const double *,
+              const lnapar *, double *, double *);
+const char *lna_simd (void);
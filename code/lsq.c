@@ -0,0 +1,612 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lsq.h"
+
+// Weighted least squares for edgestest's fits, in place of the normal
+//  equations built term by term and inverted by bordering in long double.
+//  lsq_chol() forms the normal matrix a block of LSQROWS points at a time,
+//  4x4 terms per kernel call so each loaded point is used 4 times, with y
+//  carried as one more column so F'Wy and y'Wy come out of the same pass.
+//  The matrix is scaled to a unit diagonal and factored by a blocked
+//  Cholesky. lsq_qr() is for bases too ill conditioned for that: it folds
+//  each block of sqrt(w) scaled points into a triangular R with Householder
+//  reflections, never forming F'WF. Both return -1 for a singular fit
+
+#if defined(__x86_64__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define LSQ_SIMD
+#include <immintrin.h>
+#endif
+
+#define LSQROWS 256    // points per block, the panels stay in L2
+#define LSQNB 32       // Cholesky block
+#define LSQQR 128      // points per block for qr, packed by column
+#define LSQNY 64       // spectra per group in lsq_solve()
+#define LSQMAXTHR 64
+
+typedef void (*lsqtile)(const double *, const double *, int, double *, int);
+typedef void (*lsqfold)(double *, int, double *, int, int);
+
+struct lsqws
+{
+ int m, n, np;          // np: n terms + y, rounded up to 4
+ double *pa, *pw;       // LSQROWS x np panels, by column: f, w*f
+ double *g;             // np x np normal matrix, or R and Q'y for qr
+ double *s;             // equilibration
+ double *wt;            // LSQROWS weights of the block
+ double chi2, cond;
+ const double *f, *w;   // basis and weights of lsq_factor()
+ int fact;
+ lsqtile tile;
+ lsqfold fold;
+};
+
+// always inline so the folds below get them built for their own cpu
+static inline __attribute__((always_inline)) double dot(const double *a, const double *b, int n)
+{
+  int i, k;
+  double t[8];
+  // eight running totals so the sum does not serialize the loop
+  for (k = 0; k < 8; k++) t[k] = 0.0;
+  for (i = 0; i + 8 <= n; i += 8)
+    for (k = 0; k < 8; k++) t[k] += a[i+k] * b[i+k];
+  for (; i < n; i++) t[0] += a[i] * b[i];
+  return t[0] + t[1] + t[2] + t[3] + t[4] + t[5] + t[6] + t[7];
+}
+
+static inline __attribute__((always_inline)) void axpy(double *y, double a, const double *x, int n)
+{
+  int i;
+  for (i = 0; i < n; i++) y[i] += a * x[i];
+}
+
+// the same for the four columns a[l*n + i]
+static inline __attribute__((always_inline)) void dot4(const double *x, const double *a, int n, double *s)
+{
+  int i, k;
+  double t0[8], t1[8], t2[8], t3[8];
+  for (k = 0; k < 8; k++) t0[k] = t1[k] = t2[k] = t3[k] = 0.0;
+  for (i = 0; i + 8 <= n; i += 8)
+    for (k = 0; k < 8; k++) {
+      t0[k] += x[i+k] * a[i+k];
+      t1[k] += x[i+k] * a[n+i+k];
+      t2[k] += x[i+k] * a[2*n+i+k];
+      t3[k] += x[i+k] * a[3*n+i+k];
+    }
+  for (; i < n; i++) {
+    t0[0] += x[i] * a[i];
+    t1[0] += x[i] * a[n+i];
+    t2[0] += x[i] * a[2*n+i];
+    t3[0] += x[i] * a[3*n+i];
+  }
+  for (k = 1; k < 8; k++) {
+    t0[0] += t0[k];
+    t1[0] += t1[k];
+    t2[0] += t2[k];
+    t3[0] += t3[k];
+  }
+  s[0] = t0[0]; s[1] = t1[0]; s[2] = t2[0]; s[3] = t3[0];
+}
+
+static inline __attribute__((always_inline)) void axpy4(double *y, const double *s, const double *x, int n)
+{
+  int i;
+  for (i = 0; i < n; i++) {
+    y[i] += s[0] * x[i];
+    y[n+i] += s[1] * x[i];
+    y[2*n+i] += s[2] * x[i];
+    y[3*n+i] += s[3] * x[i];
+  }
+}
+
+// g[j*ldg + k] += sum over i < r of a[j*LSQROWS + i] * b[k*LSQROWS + i]
+//  for j, k = 0..3. r is a multiple of 8
+static void tile_scalar(const double *a, const double *b, int r, double *g, int ldg)
+{
+  int i, j, k;
+  double s[4][4];
+  for (j = 0; j < 4; j++)
+    for (k = 0; k < 4; k++) s[j][k] = 0.0;
+  for (i = 0; i < r; i++)
+    for (j = 0; j < 4; j++)
+      for (k = 0; k < 4; k++) s[j][k] += a[j*LSQROWS+i] * b[k*LSQROWS+i];
+  for (j = 0; j < 4; j++)
+    for (k = 0; k < 4; k++) g[j*ldg+k] += s[j][k];
+}
+
+#ifdef LSQ_SIMD
+// two rows of the tile at a time: 8 accumulators cover the fma latency
+//  and leave registers for the loads
+__attribute__((target("avx2,fma")))
+static void tile_avx2(const double *a, const double *b, int r, double *g, int ldg)
+{
+  int i, j, k;
+  __m256d s0[4], s1[4], x0, x1, y;
+  double t[4];
+  for (j = 0; j < 4; j += 2) {
+    for (k = 0; k < 4; k++) s0[k] = s1[k] = _mm256_setzero_pd();
+    for (i = 0; i < r; i += 4) {
+      x0 = _mm256_loadu_pd(a + j*LSQROWS + i);
+      x1 = _mm256_loadu_pd(a + (j+1)*LSQROWS + i);
+      for (k = 0; k < 4; k++) {
+        y = _mm256_loadu_pd(b + k*LSQROWS + i);
+        s0[k] = _mm256_fmadd_pd(x0, y, s0[k]);
+        s1[k] = _mm256_fmadd_pd(x1, y, s1[k]);
+      }
+    }
+    for (k = 0; k < 4; k++) {
+      _mm256_storeu_pd(t, s0[k]);
+      g[j*ldg+k] += t[0] + t[1] + t[2] + t[3];
+      _mm256_storeu_pd(t, s1[k]);
+      g[(j+1)*ldg+k] += t[0] + t[1] + t[2] + t[3];
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+static void tile_avx512(const double *a, const double *b, int r, double *g, int ldg)
+{
+  int i, j, k;
+  __m512d s[4][4], x[4], y;
+  for (j = 0; j < 4; j++)
+    for (k = 0; k < 4; k++) s[j][k] = _mm512_setzero_pd();
+  for (i = 0; i < r; i += 8) {
+    for (j = 0; j < 4; j++) x[j] = _mm512_loadu_pd(a + j*LSQROWS + i);
+    for (k = 0; k < 4; k++) {
+      y = _mm512_loadu_pd(b + k*LSQROWS + i);
+      for (j = 0; j < 4; j++) s[j][k] = _mm512_fmadd_pd(x[j], y, s[j][k]);
+    }
+  }
+  for (j = 0; j < 4; j++)
+    for (k = 0; k < 4; k++) g[j*ldg+k] += _mm512_reduce_add_pd(s[j][k]);
+}
+#endif
+
+// Fold a block of r points, a[i + j*r] for terms j < n and y as j = n,
+//  into R in g. Reflection k takes row k of R and column k of the block to
+//  R[k][k] and 0, and is applied to the columns after it
+static inline __attribute__((always_inline)) void foldbody(double *a, int r, double *g, int np, int n)
+{
+  int j, k, l;
+  double *x, alpha, sigma, dk, v0, vv, t, s[4];
+  for (k = 0; k < n; k++) {
+    x = a + k*r;
+    sigma = dot(x, x, r);
+    if (sigma == 0.0) continue;
+    alpha = g[k*np+k];
+    dk = sqrt(alpha * alpha + sigma);
+    if (alpha > 0.0) dk = -dk;
+    v0 = alpha - dk;
+    vv = v0 * v0 + sigma;
+    for (j = k + 1; j + 4 <= n + 1; j += 4) {
+      dot4(x, a + j*r, r, s);
+      for (l = 0; l < 4; l++) {
+        s[l] = -2.0 * (v0 * g[k*np+j+l] + s[l]) / vv;
+        g[k*np+j+l] += s[l] * v0;
+      }
+      axpy4(a + j*r, s, x, r);
+    }
+    for (; j <= n; j++) {
+      t = -2.0 * (v0 * g[k*np+j] + dot(x, a + j*r, r)) / vv;
+      g[k*np+j] += t * v0;
+      axpy(a + j*r, t, x, r);
+    }
+    g[k*np+k] = dk;
+  }
+}
+
+static void fold_scalar(double *a, int r, double *g, int np, int n)
+{
+  foldbody(a, r, g, np, n);
+}
+
+#ifdef LSQ_SIMD
+__attribute__((target("avx2,fma")))
+static void fold_avx2(double *a, int r, double *g, int np, int n)
+{
+  foldbody(a, r, g, np, n);
+}
+
+__attribute__((target("avx512f")))
+static void fold_avx512(double *a, int r, double *g, int np, int n)
+{
+  foldbody(a, r, g, np, n);
+}
+#endif
+
+// pick the kernels for the cpu, returns their name
+static const char *kernels(lsqws *ws)
+{
+  const char *name;
+  ws->tile = tile_scalar;
+  ws->fold = fold_scalar;
+  name = "scalar";
+#ifdef LSQ_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    ws->tile = tile_avx2;
+    ws->fold = fold_avx2;
+    name = "avx2";
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    ws->tile = tile_avx512;
+    ws->fold = fold_avx512;
+    name = "avx512";
+  }
+#endif
+  return name;
+}
+
+const char *lsq_simd(void)
+{
+  lsqws ws;
+  return kernels(&ws);
+}
+
+// m points, n terms
+lsqws *lsq_alloc(int m, int n)
+{
+  lsqws *ws;
+  void *p[5];
+  int np, i;
+
+  if (m < 1 || n < 1) return NULL;
+  if ((ws = (lsqws *) calloc(1, sizeof(lsqws))) == NULL) return NULL;
+  np = (n + 1 + 3) & ~3;
+  p[0] = p[1] = p[2] = p[3] = p[4] = NULL;
+  if (posix_memalign(&p[0], 64, (size_t) LSQROWS * np * sizeof(double))
+   || posix_memalign(&p[1], 64, (size_t) LSQROWS * np * sizeof(double))
+   || posix_memalign(&p[2], 64, (size_t) np * np * sizeof(double))
+   || posix_memalign(&p[3], 64, (size_t) np * sizeof(double))
+   || posix_memalign(&p[4], 64, LSQROWS * sizeof(double))) {
+    for (i = 0; i < 5; i++) free(p[i]);
+    free(ws);
+    return NULL;
+  }
+  ws->pa = (double *) p[0];
+  ws->pw = (double *) p[1];
+  ws->g = (double *) p[2];
+  ws->s = (double *) p[3];
+  ws->wt = (double *) p[4];
+  ws->m = m;
+  ws->n = n;
+  ws->np = np;
+  kernels(ws);
+  return ws;
+}
+
+void lsq_free(lsqws *ws)
+{
+  if (ws == NULL) return;
+  free(ws->pa);
+  free(ws->pw);
+  free(ws->g);
+  free(ws->s);
+  free(ws->wt);
+  free(ws);
+}
+
+// weighted sum of squares of the residual of the last fit
+double lsq_chi2(const lsqws *ws)
+{
+  return ws->chi2;
+}
+
+// rough condition of the normal matrix from the diagonal of its factor,
+//  after scaling it to a unit diagonal, so lsq_chol() and lsq_qr() agree
+double lsq_cond(const lsqws *ws)
+{
+  return ws->cond;
+}
+
+// wt[i] for points i0..i0+r-1: w, 0 where w <= 0, all 1 for no w. With sq
+//  the square root, for scaling the points themselves
+static void weights(const double *w, int i0, int r, int sq, double *wt)
+{
+  int i;
+  for (i = 0; i < r; i++) {
+    wt[i] = w == NULL ? 1.0 : w[i0+i] > 0.0 ? w[i0+i] : 0.0;
+    if (sq) wt[i] = sqrt(wt[i]);
+  }
+}
+
+// One panel column: a[i] = src[i], 0 where the weight is 0 (src may be
+//  NaN there) or for no src, and aw[i] = wt[i] * a[i] if aw is not NULL.
+//  aw may be a. Rows r..rp-1 are zero
+static void column(const double *src, const double *wt, int r, int rp, double *a, double *aw)
+{
+  int i;
+  if (src == NULL) r = 0;
+  for (i = 0; i < r; i++) {
+    a[i] = wt[i] > 0.0 ? src[i] : 0.0;
+    if (aw) aw[i] = wt[i] * a[i];
+  }
+  for (; i < rp; i++) {
+    a[i] = 0.0;
+    if (aw) aw[i] = 0.0;
+  }
+}
+
+// Points i0..i0+r-1 of the basis, and y as column n, into ncol columns
+//  ld apart
+static void panel(const lsqws *ws, const double *f, const double *y, const double *wt,
+                  int i0, int r, int rp, int ld, int ncol, double *pa, double *pw)
+{
+  int j;
+  const double *src;
+  for (j = 0; j < ncol; j++) {
+    if (j < ws->n) src = f + i0 + (size_t) j * ws->m;
+    else if (j == ws->n && y) src = y + i0;
+    else src = NULL;
+    column(src, wt, r, rp, pa + j*ld, pw ? pw + j*ld : NULL);
+  }
+}
+
+// Cholesky of the lower triangle of the n x n matrix g, by row, in place.
+//  Within a block of LSQNB columns the terms are done one at a time, then
+//  the rest of the matrix is updated with the whole block
+static int chol(double *g, int ld, int n)
+{
+  int kb, nb, i, j;
+  double d;
+  for (kb = 0; kb < n; kb += LSQNB) {
+    nb = n - kb < LSQNB ? n - kb : LSQNB;
+    for (j = kb; j < kb + nb; j++) {
+      d = g[j*ld+j] - dot(g + j*ld + kb, g + j*ld + kb, j - kb);
+      if (!(d > 0.0)) return -1;
+      g[j*ld+j] = d = sqrt(d);
+      for (i = j + 1; i < n; i++)
+        g[i*ld+j] = (g[i*ld+j] - dot(g + i*ld + kb, g + j*ld + kb, j - kb)) / d;
+    }
+    for (i = kb + nb; i < n; i++)
+      for (j = kb + nb; j <= i; j++)
+        g[i*ld+j] -= dot(g + i*ld + kb, g + j*ld + kb, nb);
+  }
+  return 0;
+}
+
+// Normal matrix of the basis and y into g, lower triangle by row, with
+//  F'Wy in row n and y'Wy at g[n][n]. No y gives zeros there
+static void gram(lsqws *ws, const double *f, const double *w, const double *y)
+{
+  int jt, kt, i0, r, rp, np;
+  np = ws->np;
+  memset(ws->g, 0, (size_t) np * np * sizeof(double));
+  for (i0 = 0; i0 < ws->m; i0 += LSQROWS) {
+    r = ws->m - i0 < LSQROWS ? ws->m - i0 : LSQROWS;
+    rp = (r + 7) & ~7;
+    weights(w, i0, r, 0, ws->wt);
+    panel(ws, f, y, ws->wt, i0, r, rp, LSQROWS, np, ws->pa, ws->pw);
+    for (jt = 0; jt < np; jt += 4)
+      for (kt = 0; kt <= jt; kt += 4)
+        ws->tile(ws->pw + jt*LSQROWS, ws->pa + kt*LSQROWS, rp, ws->g + jt*np + kt, np);
+  }
+}
+
+// Scale the normal matrix and row n to a unit diagonal, factor it
+static int factor(lsqws *ws)
+{
+  int i, j, n, np;
+  double *g, *s, d, min, max;
+
+  n = ws->n;
+  np = ws->np;
+  g = ws->g;
+  s = ws->s;
+  for (j = 0; j < n; j++) s[j] = g[j*np+j] > 0.0 ? 1.0 / sqrt(g[j*np+j]) : 1.0;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j <= i; j++) g[i*np+j] *= s[i] * s[j];
+    g[n*np+i] *= s[i];
+  }
+  ws->cond = 0.0;
+  if (chol(g, np, n)) return -1;
+  min = max = g[0];
+  for (j = 0; j < n; j++) {
+    d = g[j*np+j];
+    if (d < min) min = d;
+    if (d > max) max = d;
+  }
+  ws->cond = (max / min) * (max / min);
+  return 0;
+}
+
+// L u = b, then L' c = u, both scaled
+static void trisolve(const lsqws *ws, const double *b, double *c)
+{
+  int i, j, n, np;
+  const double *g;
+  double d;
+  n = ws->n;
+  np = ws->np;
+  g = ws->g;
+  for (j = 0; j < n; j++) c[j] = (b[j] - dot(g + j*np, c, j)) / g[j*np+j];
+  for (j = n - 1; j >= 0; j--) {
+    d = c[j];
+    for (i = j + 1; i < n; i++) d -= g[i*np+j] * c[i];
+    c[j] = d / g[j*np+j];
+  }
+}
+
+// f[i + j*m] basis, w[i] weights or NULL, y[i] data; the n coefficients
+//  go to c. 0 when done, -1 if the normal matrix is not positive definite
+int lsq_chol(lsqws *ws, const double *f, const double *w, const double *y, double *c)
+{
+  int j, n, np;
+  double *b;
+
+  n = ws->n;
+  np = ws->np;
+  ws->fact = 0;
+  gram(ws, f, w, y);
+  ws->chi2 = ws->g[n*np+n];
+  if (factor(ws)) return -1;
+  b = ws->g + n*np;
+  trisolve(ws, b, c);
+  ws->chi2 -= dot(b, c, n);
+  if (ws->chi2 < 0.0) ws->chi2 = 0.0;
+  for (j = 0; j < n; j++) c[j] *= ws->s[j];
+  return 0;
+}
+
+// Factor the normal matrix once for fits of many spectra with lsq_solve().
+//  f and w are used again there so must stay put until then
+int lsq_factor(lsqws *ws, const double *f, const double *w)
+{
+  ws->fact = 0;
+  gram(ws, f, w, NULL);
+  if (factor(ws)) return -1;
+  ws->f = f;
+  ws->w = w;
+  ws->fact = 1;
+  return 0;
+}
+
+typedef struct
+{
+ const lsqws *ws;
+ const double *y;
+ double *c, *chi2;
+ int ny;
+ volatile int next;    // next group of LSQNY spectra
+} lsqjob;
+
+// Solve groups of LSQNY spectra until there are none left. F'WY for a group
+//  is built like the normal matrix, the basis panel against the spectra
+static void *lsqworker(void *arg)
+{
+  lsqjob *job;
+  const lsqws *ws;
+  void *p[5];
+  double *fw, *py, *b, *wt, *u, yy[LSQNY], d;
+  int i, j, k, k0, nk, nkp, jt, kt, i0, r, rp, n, np, m;
+
+  job = (lsqjob *) arg;
+  ws = job->ws;
+  n = ws->n;
+  np = ws->np;
+  m = ws->m;
+  p[0] = p[1] = p[2] = p[3] = p[4] = NULL;
+  if (posix_memalign(&p[0], 64, (size_t) LSQROWS * np * sizeof(double))
+   || posix_memalign(&p[1], 64, (size_t) LSQROWS * LSQNY * sizeof(double))
+   || posix_memalign(&p[2], 64, (size_t) np * LSQNY * sizeof(double))
+   || posix_memalign(&p[3], 64, LSQROWS * sizeof(double))
+   || posix_memalign(&p[4], 64, (size_t) 2 * np * sizeof(double))) {
+    for (i = 0; i < 5; i++) free(p[i]);
+    return (void *) -1;
+  }
+  fw = (double *) p[0];
+  py = (double *) p[1];
+  b = (double *) p[2];
+  wt = (double *) p[3];
+  u = (double *) p[4];
+  while ((k0 = __sync_fetch_and_add(&job->next, 1) * LSQNY) < job->ny) {
+    nk = job->ny - k0 < LSQNY ? job->ny - k0 : LSQNY;
+    nkp = (nk + 3) & ~3;
+    memset(b, 0, (size_t) np * LSQNY * sizeof(double));
+    for (k = 0; k < nk; k++) yy[k] = 0.0;
+    for (i0 = 0; i0 < m; i0 += LSQROWS) {
+      r = m - i0 < LSQROWS ? m - i0 : LSQROWS;
+      rp = (r + 7) & ~7;
+      weights(ws->w, i0, r, 0, wt);
+      panel(ws, ws->f, NULL, wt, i0, r, rp, LSQROWS, np, fw, fw);
+      for (k = 0; k < nkp; k++) {
+        column(k < nk ? job->y + (size_t) (k0 + k) * m + i0 : NULL, wt, r, rp, py + k*LSQROWS, NULL);
+        if (k < nk)
+          for (i = 0; i < r; i++) yy[k] += wt[i] * py[k*LSQROWS+i] * py[k*LSQROWS+i];
+      }
+      for (jt = 0; jt < n; jt += 4)
+        for (kt = 0; kt < nkp; kt += 4)
+          ws->tile(fw + jt*LSQROWS, py + kt*LSQROWS, rp, b + jt*LSQNY + kt, LSQNY);
+    }
+    for (k = 0; k < nk; k++) {
+      for (j = 0; j < n; j++) u[j] = b[j*LSQNY+k] * ws->s[j];
+      trisolve(ws, u, u + np);
+      d = yy[k] - dot(u, u + np, n);
+      if (job->chi2) job->chi2[k0+k] = d > 0.0 ? d : 0.0;
+      for (j = 0; j < n; j++) job->c[(size_t) (k0 + k) * n + j] = u[np+j] * ws->s[j];
+    }
+  }
+  for (i = 0; i < 5; i++) free(p[i]);
+  return NULL;
+}
+
+// Fits of ny spectra y[i + k*m] against the basis of the last lsq_factor(),
+//  coefficients to c[j + k*n] and chi2[k] if not NULL, on nthr threads, or
+//  one per cpu for 0. The workspace is only read, so solves can overlap
+int lsq_solve(const lsqws *ws, const double *y, int ny, double *c, double *chi2, int nthr)
+{
+  lsqjob job;
+  pthread_t thr[LSQMAXTHR];
+  int i, nt, err;
+  void *ret;
+
+  if (!ws->fact) return -1;
+  if (nthr <= 0) nthr = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthr > LSQMAXTHR) nthr = LSQMAXTHR;
+  if (nthr > (ny + LSQNY - 1) / LSQNY) nthr = (ny + LSQNY - 1) / LSQNY;
+  if (nthr < 1) nthr = 1;
+  job.ws = ws;
+  job.y = y;
+  job.c = c;
+  job.chi2 = chi2;
+  job.ny = ny;
+  job.next = 0;
+  // this thread is one of the workers
+  for (nt = 0; nt < nthr - 1; nt++)
+    if (pthread_create(&thr[nt], NULL, lsqworker, &job)) break;
+  err = lsqworker(&job) != NULL;
+  for (i = 0; i < nt; i++) {
+    pthread_join(thr[i], &ret);
+    if (ret != NULL) err = 1;
+  }
+  // a worker that could not allocate leaves its groups to the others
+  return err && job.next * LSQNY < ny ? -1 : 0;
+}
+
+// The same fit by Householder QR of the sqrt(w) scaled points, for when the
+//  normal matrix loses too much. g holds R by row with Q'y in column n; each
+//  block of points is folded in with n reflections that touch only the
+//  block and row k of R
+int lsq_qr(lsqws *ws, const double *f, const double *w, const double *y, double *c)
+{
+  int i, i0, r, k, n, np;
+  double *g, *x, t, min, max;
+
+  n = ws->n;
+  np = ws->np;
+  g = ws->g;
+  memset(g, 0, (size_t) np * np * sizeof(double));
+  ws->chi2 = 0.0;
+  ws->cond = 0.0;
+  ws->fact = 0;
+  for (i0 = 0; i0 < ws->m; i0 += LSQQR) {
+    r = ws->m - i0 < LSQQR ? ws->m - i0 : LSQQR;
+    weights(w, i0, r, 1, ws->wt);
+    panel(ws, f, y, ws->wt, i0, r, r, r, n + 1, ws->pa, ws->pa);
+    ws->fold(ws->pa, r, g, np, n);
+    x = ws->pa + n*r;
+    ws->chi2 += dot(x, x, r);
+  }
+  min = max = fabs(g[0]);
+  for (k = 0; k < n; k++) {
+    t = fabs(g[k*np+k]);
+    if (t < min) min = t;
+    if (t > max) max = t;
+  }
+  if (!(min > max * 1e-15)) return -1;
+  // the diagonal of R with its columns scaled to unit length is that of
+  //  the factor of the scaled normal matrix, as factor() has it
+  for (k = 0; k < n; k++) {
+    for (t = 0.0, i = 0; i <= k; i++) t += g[i*np+k] * g[i*np+k];
+    t = fabs(g[k*np+k]) / sqrt(t);
+    if (k == 0 || t < min) min = t;
+    if (k == 0 || t > max) max = t;
+  }
+  ws->cond = (max / min) * (max / min);
+  for (k = n - 1; k >= 0; k--)
+    c[k] = (g[k*np+n] - dot(g + k*np + k + 1, c + k + 1, n - k - 1)) / g[k*np+k];
+  return 0;
+}
@@ -0,0 +1,20 @@
+/* Weighted linear least squares (lsq.c)
+ *
+ * Fits y ~ sum_j c[j] f[i + j*m] over i = 0..m-1 with weights w[i], the
+ * basis stored by column as in edgestest's fitfn. A weight <= 0 leaves the
+ * point out, and w may be NULL for all 1. A workspace holds everything a
+ * fit needs, so fits on different workspaces can run at the same time.
+ * lsq_factor() then lsq_solve() fit many spectra that share the basis and
+ * weights with one factorization */
+
+typedef struct lsqws lsqws;
+
+lsqws *lsq_alloc (int, int);
+void lsq_free (lsqws *);
+int lsq_chol (lsqws *, const double *, const double *, const double *, double *);
+int lsq_qr (lsqws *, const double *, const double *, const double *, double *);
+int lsq_factor (lsqws *, const double *, const double *);
+int lsq_solve (const lsqws *, const double *, int, double *, double *, int);
+double lsq_chi2 (const lsqws *);
+double lsq_cond (const lsqws *);
+const char *lsq_simd (void);
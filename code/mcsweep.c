@@ -0,0 +1,342 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "mcsweep.h"
+
+// Runs nsamp samples of a model over the cpus. Each worker owns a range of
+//  sample numbers and takes them from the bottom; a worker that runs out
+//  steals the top half of the largest range left, so the load evens out
+//  however uneven the samples are. The parameters of sample i come from a
+//  generator seeded with i, so a sweep gives the same numbers on any number
+//  of threads. Results go out through a per worker buffer, and each worker
+//  keeps its own statistics, merged at the end
+
+#define MCMAXTHR 64
+#define MCBUF 256      // records per worker between writes
+
+#define MCFIXED 0
+#define MCNORMAL 1
+#define MCUNIFORM 2
+
+typedef struct
+{
+ int type;
+ double a, b;
+} mcdist;
+
+typedef struct
+{
+ pthread_mutex_t lock;
+ int lo, hi;           // samples lo..hi-1 still to do, stored atomically under lock
+} mcrange;
+
+typedef struct
+{
+ double n, s, s2, min, max;
+} mcstat;
+
+typedef struct
+{
+ mcdist dist[MCMAXPAR];
+ int npar, nres, nthr, nsamp;
+ uint64_t seed;
+ mcrange range[MCMAXTHR];
+ mcstat stat[MCMAXTHR][MCMAXRES];
+ int nfail[MCMAXTHR], nsteal[MCMAXTHR];
+ FILE *out;
+ pthread_mutex_t outlock;
+ mcfn fn;
+ void *ctx;
+} mcjob;
+
+typedef struct
+{
+ mcjob *job;
+ int id;
+} mcarg;
+
+// splitmix64
+static uint64_t mcrand(uint64_t *s)
+{
+  uint64_t z;
+  z = (*s += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// uniform in (0, 1)
+static double mcunif(uint64_t *s)
+{
+  return ((mcrand(s) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static void mcparams(const mcjob *job, int i, double *par)
+{
+  int k;
+  uint64_t s;
+  s = job->seed ^ ((uint64_t) i * 0xd1b54a32d192ed03ULL);
+  for (k = 0; k < job->npar; k++) {
+    if (job->dist[k].type == MCNORMAL)
+      par[k] = job->dist[k].a + job->dist[k].b * sqrt(-2.0 * log(mcunif(&s))) * cos(2.0 * M_PI * mcunif(&s));
+    else if (job->dist[k].type == MCUNIFORM)
+      par[k] = job->dist[k].a + (job->dist[k].b - job->dist[k].a) * mcunif(&s);
+    else par[k] = job->dist[k].a;
+  }
+}
+
+// samples left in r, read without its lock for choosing a victim
+static int mcleft(mcrange *r)
+{
+  return __atomic_load_n(&r->hi, __ATOMIC_RELAXED) - __atomic_load_n(&r->lo, __ATOMIC_RELAXED);
+}
+
+// next sample for worker id: its own, else stolen, -1 when there are none
+static int mcnext(mcjob *job, int id)
+{
+  mcrange *r, *v;
+  int i, k, best, left, mid;
+
+  r = &job->range[id];
+  pthread_mutex_lock(&r->lock);
+  i = r->lo < r->hi ? r->lo : -1;
+  if (i >= 0) __atomic_store_n(&r->lo, i + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&r->lock);
+  if (i >= 0) return i;
+  for (;;) {
+    best = -1;
+    left = 1;
+    for (k = 0; k < job->nthr; k++)
+      if (k != id && mcleft(&job->range[k]) > left) {
+        left = mcleft(&job->range[k]);
+        best = k;
+      }
+    if (best < 0) {
+      // only single samples left, take one if there is any
+      for (k = 0; k < job->nthr; k++) {
+        v = &job->range[k];
+        pthread_mutex_lock(&v->lock);
+        i = v->lo < v->hi ? v->hi - 1 : -1;
+        if (i >= 0) __atomic_store_n(&v->hi, i, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&v->lock);
+        if (i >= 0) return i;
+      }
+      return -1;
+    }
+    v = &job->range[best];
+    pthread_mutex_lock(&v->lock);
+    left = v->hi - v->lo;
+    if (left < 2) {
+      pthread_mutex_unlock(&v->lock);
+      continue;
+    }
+    mid = v->lo + left / 2;
+    i = v->hi;
+    __atomic_store_n(&v->hi, mid, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&v->lock);
+    job->nsteal[id]++;
+    pthread_mutex_lock(&r->lock);
+    __atomic_store_n(&r->lo, mid + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->hi, i, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&r->lock);
+    return mid;
+  }
+}
+
+static void mcflush(mcjob *job, const char *buf, size_t len)
+{
+  if (job->out == NULL || len == 0) return;
+  pthread_mutex_lock(&job->outlock);
+  fwrite(buf, 1, len, job->out);
+  pthread_mutex_unlock(&job->outlock);
+}
+
+static void *mcworker(void *arg)
+{
+  mcjob *job;
+  mcstat *st;
+  char *buf;
+  size_t rec, len;
+  int id, i, k;
+  int32_t hd[2];
+  double par[MCMAXPAR], res[MCMAXRES];
+
+  job = ((mcarg *) arg)->job;
+  id = ((mcarg *) arg)->id;
+  rec = 2 * sizeof(int32_t) + (job->npar + job->nres) * sizeof(double);
+  buf = (char *) malloc(MCBUF * rec);
+  len = 0;
+  while ((i = mcnext(job, id)) >= 0) {
+    mcparams(job, i, par);
+    for (k = 0; k < job->nres; k++) res[k] = 0.0;
+    if (job->fn(par, res, job->ctx, id)) {
+      job->nfail[id]++;
+      continue;
+    }
+    for (k = 0; k < job->nres; k++) {
+      st = &job->stat[id][k];
+      if (st->n == 0 || res[k] < st->min) st->min = res[k];
+      if (st->n == 0 || res[k] > st->max) st->max = res[k];
+      st->n += 1;
+      st->s += res[k];
+      st->s2 += res[k] * res[k];
+    }
+    if (buf == NULL) continue;
+    hd[0] = i;
+    hd[1] = 0;
+    memcpy(buf + len, hd, sizeof(hd));
+    memcpy(buf + len + sizeof(hd), par, job->npar * sizeof(double));
+    memcpy(buf + len + sizeof(hd) + job->npar * sizeof(double), res, job->nres * sizeof(double));
+    len += rec;
+    if (len == MCBUF * rec) {
+      mcflush(job, buf, len);
+      len = 0;
+    }
+  }
+  if (buf) mcflush(job, buf, len);
+  free(buf);
+  return NULL;
+}
+
+static int mcread(mcjob *job, const char *parfile, const char **names)
+{
+  FILE *file;
+  char buf[256], name[64], type[64];
+  double a, b;
+  int k, n;
+
+  if ((file = fopen(parfile, "r")) == NULL) {
+    printf("cannot open sweep parameters %s\n", parfile);
+    return -1;
+  }
+  while (fgets(buf, sizeof(buf), file)) {
+    if (buf[0] == '#') continue;
+    b = 0;
+    if ((n = sscanf(buf, "%63s %63s %lf %lf", name, type, &a, &b)) < 3) continue;
+    for (k = 0; k < job->npar; k++) if (strcmp(name, names[k]) == 0) break;
+    if (k == job->npar) {
+      printf("sweep parameter %s unknown\n", name);
+      continue;
+    }
+    if (strcmp(type, "normal") == 0 && n == 4) job->dist[k].type = MCNORMAL;
+    else if (strcmp(type, "uniform") == 0 && n == 4) job->dist[k].type = MCUNIFORM;
+    else if (strcmp(type, "fixed") == 0) job->dist[k].type = MCFIXED;
+    else {
+      printf("sweep parameter %s: %s not known\n", name, type);
+      continue;
+    }
+    job->dist[k].a = a;
+    job->dist[k].b = b;
+  }
+  fclose(file);
+  return 0;
+}
+
+int mc_threads(int nthr)
+{
+  if (nthr <= 0) nthr = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthr < 1) nthr = 1;
+  if (nthr > MCMAXTHR) nthr = MCMAXTHR;
+  return nthr;
+}
+
+// nsamp samples of fn on nthr threads, after mc_threads(). The parameters
+//  start at nominal and are varied as the parameter file says. Prints the
+//  statistics of each result and the rate; returns the samples done
+int mc_run(const char *parfile, const char **parnames, const double *nominal, int npar,
+           const char **resnames, int nres, int nsamp, uint64_t seed, int nthr,
+           const char *outfile, mcfn fn, void *ctx)
+{
+  mcjob *job;
+  mcarg arg[MCMAXTHR];
+  pthread_t thr[MCMAXTHR];
+  mchead hd;
+  mcstat st;
+  char name[MCNAME];
+  struct timespec t0, t1;
+  double secs;
+  int i, k, nt, ndone, nfail, nsteal;
+
+  if (npar > MCMAXPAR || nres > MCMAXRES || nsamp < 1) return 0;
+  if ((job = (mcjob *) calloc(1, sizeof(mcjob))) == NULL) return 0;
+  job->npar = npar;
+  job->nres = nres;
+  job->nsamp = nsamp;
+  job->seed = seed;
+  job->nthr = nthr = mc_threads(nthr);
+  job->fn = fn;
+  job->ctx = ctx;
+  for (k = 0; k < npar; k++) {
+    job->dist[k].type = MCFIXED;
+    job->dist[k].a = nominal[k];
+  }
+  if (mcread(job, parfile, parnames)) {
+    free(job);
+    return 0;
+  }
+  if (outfile && outfile[0]) {
+    if ((job->out = fopen(outfile, "wb")) == NULL) printf("cannot write %s\n", outfile);
+    else {
+      hd.magic = MCMAGIC;
+      hd.npar = npar;
+      hd.nres = nres;
+      hd.nsamp = nsamp;
+      hd.seed = seed;
+      fwrite(&hd, sizeof(hd), 1, job->out);
+      for (k = 0; k < npar; k++) {
+        memset(name, 0, MCNAME);
+        strncpy(name, parnames[k], MCNAME - 1);
+        fwrite(name, MCNAME, 1, job->out);
+      }
+    }
+  }
+  pthread_mutex_init(&job->outlock, NULL);
+  for (i = 0; i < nthr; i++) {
+    pthread_mutex_init(&job->range[i].lock, NULL);
+    job->range[i].lo = (int) ((long long) nsamp * i / nthr);
+    job->range[i].hi = (int) ((long long) nsamp * (i + 1) / nthr);
+    arg[i].job = job;
+    arg[i].id = i;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (nt = 1; nt < nthr; nt++)
+    if (pthread_create(&thr[nt], NULL, mcworker, &arg[nt])) break;
+  // a worker that did not start leaves its range to be stolen
+  mcworker(&arg[0]);
+  for (i = 1; i < nt; i++) pthread_join(thr[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+  if (job->out) fclose(job->out);
+
+  nfail = nsteal = 0;
+  for (i = 0; i < nthr; i++) {
+    nfail += job->nfail[i];
+    nsteal += job->nsteal[i];
+  }
+  ndone = 0;
+  for (k = 0; k < nres; k++) {
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < nthr; i++) {
+      if (job->stat[i][k].n == 0) continue;
+      if (st.n == 0 || job->stat[i][k].min < st.min) st.min = job->stat[i][k].min;
+      if (st.n == 0 || job->stat[i][k].max > st.max) st.max = job->stat[i][k].max;
+      st.n += job->stat[i][k].n;
+      st.s += job->stat[i][k].s;
+      st.s2 += job->stat[i][k].s2;
+    }
+    ndone = (int) st.n;
+    if (st.n > 0)
+      printf("%-10s mean %12.6g sd %12.6g min %12.6g max %12.6g\n", resnames[k], st.s / st.n,
+             sqrt(fmax(st.s2 / st.n - (st.s / st.n) * (st.s / st.n), 0.0)), st.min, st.max);
+  }
+  printf("sweep %d samples (%d failed) %d threads %d steals %.3f s %.0f samples/s %.0f per thread\n",
+         ndone, nfail, nt, nsteal, secs, secs > 0 ? ndone / secs : 0, secs > 0 ? ndone / secs / nt : 0);
+  for (i = 0; i < nthr; i++) pthread_mutex_destroy(&job->range[i].lock);
+  pthread_mutex_destroy(&job->outlock);
+  free(job);
+  return ndone;
+}
@@ -0,0 +1,31 @@
+/* Monte-Carlo parameter sweeps (mcsweep.c)
+ *
+ * The parameter file has one line per parameter to vary, any other keeps
+ * its nominal value:
+ *   name normal mean sigma
+ *   name uniform lo hi
+ *   name fixed value
+ * Lines starting with # are comments. The results file is an mchead, the
+ * parameter names in MCNAME chars each, then for every sample in the order
+ * they finish an int32 sample number, an int32 0 and npar + nres doubles */
+#include <stdint.h>
+
+#define MCMAGIC 0x3153434d    // "MCS1"
+#define MCMAXPAR 16
+#define MCMAXRES 8
+#define MCNAME 16
+
+typedef struct
+{
+ uint32_t magic;
+ int32_t npar, nres, nsamp;
+ uint64_t seed;
+} mchead;
+
+// one sample: parameters in, results out, thread number for scratch.
+//  Returns 0, or -1 for a sample with no result
+typedef int (*mcfn)(const double *, double *, void *, int);
+
+int mc_threads (int);
+int mc_run (const char *, const char **, const double *, int, const char **, int,
+            int, uint64_t, int, const char *, mcfn, void *);
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+extern d1type d1;
+
+// Polyphase filter bank front end. Each output block of n samples is
+//  out[j] = sum over taps t of h[t*n + j] * x[off - (ntap-1-t)*n + j]
+//  with h a sinc of width n times the selected window over ntap*n points,
+//  so the FFT that follows sees a flat-topped channel response with much
+//  lower leakage than the window alone. Blocks at the start of a DMA buffer
+//  reach back into the tail of the previous one, kept in pfbhist.
+
+static float *pfbh;
+static unsigned short *pfbhist;
+static int pfbn, pfbtap, pfbok;
+
+void pfb_init(int n, int ntap)
+{
+  int i, t;
+  double x;
+  const float *w;
+
+  pfb_free();
+  w = window_get(d1.wtype, n * ntap, 0.5/32768.0);    // 0.5 for px14400
+  if (posix_memalign((void **) &pfbh, 64, sizeof(float) * n * ntap)) {
+    printf("cannot allocate pfb\n");
+    exit(1);
+  }
+  pfbhist = (unsigned short *) malloc(sizeof(unsigned short) * n * ntap);
+  for (t = 0; t < ntap; t++)
+    for (i = 0; i < n; i++) {
+      x = (t * n + i - (n * ntap - 1) / 2.0) / n;
+      pfbh[t * n + i] = w[t * n + i] * (fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x));
+    }
+  pfbn = n;
+  pfbtap = ntap;
+  pfbok = 0;
+  printf("pfb %d taps n %d\n", ntap, n);
+}
+
+void pfb_free(void)
+{
+  free(pfbh);
+  free(pfbhist);
+  pfbh = NULL;
+  pfbhist = NULL;
+  pfbn = pfbtap = pfbok = 0;
+}
+
+// Keep the last (ntap-1)*n samples of a DMA buffer of nbr samples for the
+//  next one. Only valid while the stream runs without a gap
+void pfb_save(const unsigned short *wave, int nbr)
+{
+  int nh;
+  nh = (pfbtap - 1) * pfbn;
+  if (nh <= 0 || nbr < nh) return;
+  memcpy(pfbhist, wave + nbr - nh, sizeof(unsigned short) * nh);
+  pfbok = 1;
+}
+
+// stream restarted - the history no longer joins on to the next buffer
+void pfb_reset(void)
+{
+  pfbok = 0;
+}
+
+// FIR for the block starting at sample off of wave into out[0..n-1].
+//  Returns 0 if the block needs history that is not there
+int pfb_fir(const unsigned short *wave, int off, float *out)
+{
+  int j, t, n, nh, s;
+  const unsigned short *x;
+  const float *h;
+
+  n = pfbn;
+  nh = (pfbtap - 1) * n;
+  if (off < nh && !pfbok) return 0;
+  for (t = 0; t < pfbtap; t++) {
+    s = off - (pfbtap - 1 - t) * n;    // off is a multiple of n
+    x = s >= 0 ? wave + s : pfbhist + nh + s;
+    h = pfbh + t * n;
+    if (t == 0)
+      for (j = 0; j < n; j++) out[j] = (x[j] - 32768) * h[j];
+    else
+      for (j = 0; j < n; j++) out[j] += (x[j] - 32768) * h[j];
+  }
+  return 1;
+}
@@ -8,18 +8,50 @@
 #include "d1glob6.h"
 
 
-gint Repaint(double mfreq)
+#define NCOLMAX 4096    // widest plot in pixels
+
+// Min and max of sp[] over the bins of each of ncol pixel columns, as the
+//  dB values Repaint plots. The log is taken once per column rather than
+//  per bin since it does not change the order. Bins 0 and 1 are left out
+//  as before
+static void decimate(const float *sp, int nspec, double aa, int ncol, float *lo, float *hi)
+{
+    int c, i, i0, i1;
+    float a, b;
+
+    for (c = 0; c < ncol; c++) {
+        i0 = (int) ((double) c * nspec / ncol);
+        i1 = (int) ((double) (c + 1) * nspec / ncol);
+        if (i0 < 2) i0 = 2;
+        if (i1 <= i0) i1 = i0 + 1;
+        if (i1 > nspec) i1 = nspec;
+        a = b = i0 < nspec ? sp[i0] : 0.0f;
+        for (i = i0 + 1; i < i1; i++) {
+            a = sp[i] < a ? sp[i] : a;
+            b = sp[i] > b ? sp[i] : b;
+        }
+        lo[c] = 10.0 * log10(aa * a + 1e-99);
+        hi[c] = 10.0 * log10(aa * b + 1e-99);
+    }
+}
+
+// Draw the spectrum sp[0..nspec-1] of the integration d, in the units of
+//  px14run() before the dBm conversion, as one vertical segment per pixel
+//  column spanning its min and max and joined to the next
+gint Repaint(const d1type *d, const float *sp)
 {
     GdkRectangle update_rect;
+    GdkSegment seg[NCOLMAX];
+    static float lo[NCOLMAX], hi[NCOLMAX];
     char txt[80];
-    int i, j, x, y, yr, da, hr, mn, sc, ix, iy;
-    int x1, y1, x2, y2, iax, iay, scaledb, nspec;
-    double secs, c, max;
+    int i, x, y, yr, da, hr, mn, sc, ix, iy;
+    int ylo, yhi, iax, iay, scaledb, nspec, ncol;
+    double secs, mfreq, max, aa;
 
-    nspec = d1.nspec;
+    nspec = d->nspec;
+    mfreq = d->mfreq;
     scaledb = 100;
     iax = 20; iay = 4;
-    x1 = y1 = 0;
     midx = drawing_area->allocation.width / 2;
     midy = drawing_area->allocation.height / 2;
     gdk_draw_line(pixmap, drawing_area->style->black_gc, iax, midy * 2 - iay, midx * 2 - iax, midy * 2 - iay);
@@ -44,37 +76,39 @@ gint Repaint(double mfreq)
         }
     }
 
-    secs = d1.secs;
+    secs = d->secs;
     toyrday(secs, &yr, &da, &hr, &mn, &sc);
     sprintf(txt, "%4d:%03d:%02d:%02d:%02d", yr, da, hr, mn, sc);
     ix = (int)(midx * 1.65);
     iy = (int)(midy * 0.15);
     gdk_draw_text(pixmap, fixed_font, drawing_area->style->black_gc, ix, iy, txt, strlen(txt));
-            max = scaledb;
-            for (i = 0; i < nspec; i++) {
-                    j = i;
-                    x2 = iax + i * (midx - iax) * 2 / nspec;
-
-                     c = avspec[j]+40.0;
-
-                    y2 = (int)(midy * 2 - c * midy * 1.8 / max  - iax);
-
-                if (i > 1)
-                    gdk_draw_line(pixmap, drawing_area->style->black_gc, x1, y1, x2, y2);
-                x1 = x2;
-                y1 = y2;
-            }
+    max = scaledb;
+    ncol = (midx - iax) * 2;
+    if (ncol > NCOLMAX) ncol = NCOLMAX;
+    if (ncol > 0 && d->numblk > 0) {
+        aa = 100.0 / ((double) d->numblk * nspec * 2.0);  // for compatibility with acml FFT
+        decimate(sp, nspec, aa, ncol, lo, hi);
+        for (i = 0; i < ncol; i++) {
+            // take in the neighbour's range so the trace has no gaps
+            ylo = (int)(midy * 2 - ((i > 0 && hi[i-1] < lo[i] ? hi[i-1] : lo[i]) + 40.0) * midy * 1.8 / max - iax);
+            yhi = (int)(midy * 2 - ((i > 0 && lo[i-1] > hi[i] ? lo[i-1] : hi[i]) + 40.0) * midy * 1.8 / max - iax);
+            seg[i].x1 = seg[i].x2 = iax + i;
+            seg[i].y1 = ylo;
+            seg[i].y2 = yhi;
+        }
+        gdk_draw_segments(pixmap, drawing_area->style->black_gc, seg, ncol);
+    }
 
-    sprintf(txt, "temp %3.0f C", d1.temp);
+    sprintf(txt, "temp %3.0f C", d->temp);
     iy = (int)(midy * 0.20);
     gdk_draw_text(pixmap, fixed_font, drawing_area->style->black_gc, ix, iy, txt, strlen(txt));
-    sprintf(txt, "mode %d max %6.4f", d1.mode,d1.adcmax);
+    sprintf(txt, "mode %d max %6.4f", d->mode,d->adcmax);
     iy = (int)(midy * 0.25);
     gdk_draw_text(pixmap, fixed_font, drawing_area->style->black_gc, ix, iy, txt, strlen(txt));
-    sprintf(txt, "totpwr %5.1e", d1.totp);
+    sprintf(txt, "totpwr %5.1e", d->totp);
     iy = (int)(midy * 0.30);
     gdk_draw_text(pixmap, fixed_font, drawing_area->style->black_gc, ix, iy, txt, strlen(txt));
-    sprintf(txt, "file: %s", d1.filname);
+    snprintf(txt, sizeof txt, "file: %s", d->filname);
     iy = (int)(midy * 0.35);
         gdk_draw_text(pixmap, fixed_font, drawing_area->style->black_gc,
                       midx, iy, txt, strlen(txt));
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+// Persistent worker pool for the spectrometer. The workers are created
+// once, pinned to cores 1..n and fed through a bounded lock-free queue
+// (single producer, multiple consumers). pool_wait() is the per-block
+// barrier: it returns when every task submitted since the last call is done.
+
+#define NPOOLQ 64    // queue length - power of 2
+
+typedef struct
+{
+ void (*fn)(int);
+ int arg;
+ volatile unsigned seq;
+} pooltask;
+
+static pooltask poolq[NPOOLQ];
+static volatile unsigned poolhead, pooltail;
+static volatile int poolpend;
+static int poolnthr, poolnsub;
+static sem_t poolsem, pooldone;
+static pthread_t poolthr[NQMAX];
+static int poolid[NQMAX];
+static struct timespec pooltic;
+static volatile long long pooltoc;    // ns of the last task completion
+static double latn, lats, lats2, latmin, latmax, waitmax;
+
+static void *poolworker(void *);
+
+int pool_init(int nthr)
+{
+  int i, ncpu;
+  cpu_set_t cpus;
+
+  if (nthr > NQMAX) nthr = NQMAX;
+  for (i = 0; i < NPOOLQ; i++) poolq[i].seq = i;
+  poolhead = pooltail = 0;
+  poolpend = poolnsub = 0;
+  sem_init(&poolsem, 0, 0);
+  sem_init(&pooldone, 0, 0);
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1) ncpu = 1;
+  for (i = 0; i < nthr; i++) {
+    poolid[i] = i;
+    if (pthread_create(&poolthr[i], NULL, poolworker, &poolid[i])) {
+      printf("error creating thread\n");
+      break;
+    }
+    // core 0 is left to the acquisition thread
+    CPU_ZERO(&cpus);
+    CPU_SET((i + 1) % ncpu, &cpus);
+    if (pthread_setaffinity_np(poolthr[i], sizeof(cpus), &cpus))
+      printf("cannot pin worker %d\n", i);
+  }
+  poolnthr = i;
+  pool_stats(1);
+  return poolnthr;
+}
+
+void pool_free(void)
+{
+  int i;
+  for (i = 0; i < poolnthr; i++) pool_submit(NULL, 0);
+  for (i = 0; i < poolnthr; i++) pthread_join(poolthr[i], NULL);
+  poolnsub = poolpend = poolnthr = 0;
+  sem_destroy(&poolsem);
+  sem_destroy(&pooldone);
+}
+
+void pool_submit(void (*fn)(int), int arg)
+{
+  pooltask *t;
+  if (poolnthr == 0 && fn) {    // no workers - run inline
+    fn(arg);
+    return;
+  }
+  // the first submit of a block also takes a count held until pool_wait(),
+  //  so the workers cannot see the block complete while it is being filled
+  if (poolnsub == 0) {
+    clock_gettime(CLOCK_MONOTONIC, &pooltic);
+    __sync_fetch_and_add(&poolpend, 1);
+  }
+  __sync_fetch_and_add(&poolpend, 1);
+  poolnsub++;
+  t = &poolq[poolhead & (NPOOLQ - 1)];
+  while (t->seq != poolhead) sched_yield();   // full - never expected
+  t->fn = fn;
+  t->arg = arg;
+  __sync_synchronize();
+  t->seq = poolhead + 1;
+  poolhead++;
+  sem_post(&poolsem);
+}
+
+static int pool_take(void (**fn)(int), int *arg)
+{
+  pooltask *t;
+  unsigned pos;
+  int dif;
+  for (;;) {
+    pos = pooltail;
+    t = &poolq[pos & (NPOOLQ - 1)];
+    dif = (int)(t->seq - (pos + 1));
+    if (dif == 0) {
+      if (__sync_bool_compare_and_swap(&pooltail, pos, pos + 1)) {
+        *fn = t->fn;
+        *arg = t->arg;
+        __sync_synchronize();
+        t->seq = pos + NPOOLQ;
+        return 1;
+      }
+    }
+    else if (dif < 0) return 0;
+  }
+}
+
+static void *poolworker(void *ii)
+{
+  void (*fn)(int);
+  int arg;
+  long long t, old;
+  struct timespec toc;
+  (void)ii;
+  for (;;) {
+    sem_wait(&poolsem);
+    if (!pool_take(&fn, &arg)) continue;
+    if (fn == NULL) break;
+    fn(arg);
+    clock_gettime(CLOCK_MONOTONIC, &toc);
+    t = toc.tv_sec * 1000000000LL + toc.tv_nsec;
+    do old = pooltoc;
+    while (t > old && !__sync_bool_compare_and_swap(&pooltoc, old, t));
+    if (__sync_sub_and_fetch(&poolpend, 1) == 0)
+      sem_post(&pooldone);
+  }
+  pthread_exit(NULL);
+}
+
+void pool_wait(void)
+{
+  struct timespec tic, toc;
+  double lat, w;
+  if (poolnsub == 0) return;
+  clock_gettime(CLOCK_MONOTONIC, &tic);
+  if (__sync_sub_and_fetch(&poolpend, 1) != 0)
+    while (sem_wait(&pooldone) && errno == EINTR) ;
+  clock_gettime(CLOCK_MONOTONIC, &toc);
+  poolnsub = 0;
+  // latency from first submit to last task done, and time spent blocked
+  lat = (pooltoc - (pooltic.tv_sec * 1000000000LL + pooltic.tv_nsec)) / 1e9;
+  w = (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1e9;
+  latn++;
+  lats += lat;
+  lats2 += lat * lat;
+  if (lat < latmin) latmin = lat;
+  if (lat > latmax) latmax = lat;
+  if (w > waitmax) waitmax = w;
+}
+
+void pool_stats(int reset)
+{
+  double m, sd;
+  if (!reset && latn > 0) {
+    m = lats / latn;
+    sd = lats2 / latn - m * m;
+    sd = sd > 0 ? sqrt(sd) : 0;
+    printf("pool %d workers blocks %1.0f latency mean %6.3f min %6.3f max %6.3f jitter %6.3f ms maxwait %6.3f ms\n",
+           poolnthr, latn, m * 1e3, latmin * 1e3, latmax * 1e3, sd * 1e3, waitmax * 1e3);
+  }
+  latn = lats = lats2 = latmax = waitmax = 0;
+  latmin = 1e99;
+}
@@ -20,6 +20,9 @@
 #define DMA_XFER_SAMPLES		(NBR)
 //#define DMA_XFER_SAMPLES		(2 * 1048576)
 #define DMA_BUFFER_SAMPLES		(1 * DMA_XFER_SAMPLES)
+// number of DMA buffers in the streaming ring, more are added for raw capture
+#define NDMABUF 4
+#define NDMAMAX 32
 /// PX14400 board number (serial or 1-based index) to use
 #define MY_PX14400_BRD_NUM		1
 
@@ -28,20 +31,51 @@
 
 //typedef struct timeval TV ;
 //typedef struct timezone TZ;
-unsigned short waveFormArray[NBR];
-unsigned short LastwaveForm[NBR];
-int corestat[5],corerr[5];
-int numblk0,numblk1,numblk2,numblk3;
+// ownership of the ring buffers: free, DMA transfer in flight, or held
+//  by the FFT workers until released with pxrelease()
+#define DMA_FREE 0
+#define DMA_XFER 1
+#define DMA_HELD 2
+int numblkq[NQMAX];
+int nquart;     // number of procspec quarters run on the worker pool
+px14_sample_t *dma_ring[NDMAMAX];
+int dma_own[NDMAMAX];
+int ndmabuf = NDMABUF;
+int dma_head;   // ring index of the transfer in flight
+int dma_idle;   // no transfer in flight because the ring was full
+int dma_armed;
+const px14_sample_t *procbufp;   // block being processed by procspec
+const float *pxwin;      // shared read-only window from the cache
+float *xspq[NQMAX];      // dual channel partial sums [ch1 | ch2 | cross re, im]
+double *xspec;           // dual channel result, same layout
+struct timespec dma_tic;
+int dma_nxfer;        // transfers completed since the stream was armed
+double dma_rate;      // samples per second into the ring
+double dma_start;     // CLOCK_MONOTONIC time of the first sample in dma_bufp
 extern HPX14 hBrd;
-extern fftwf_plan p0,p1,p2,p3;
+extern fftwf_plan pq[];
 extern px14_sample_t *dma_bufp;
-extern float *reamin0,*reamin1,*reamin2,*reamin3,*reamout0,*reamout1,*reamout2,*reamout3;
+extern float *reamin[],*reamout[];
+extern float specq[NQMAX][NSIZ];
 
 void procspec(int);
-void *runspec(void *);
+void procxspec(int);
+void pxrelease(const px14_sample_t *);
+static int pxnextxfer(int);
+static void rfistep(void);
+static int sumblk(void);
 void fft_init(int, int, fftwf_plan *);
 void fft_free(int, fftwf_plan *);
 void cfft(fftwf_plan *);
+void cfft_power(const float *, int, float *);
+void rfft_init(int, int, int);
+void fft_tune(int, int);
+void fft_wisdom(void);
+void rfft_free(int);
+void rfft(int, int);
+void rfft_power(int, int, float *);
+void rfft_cross(int, int, float *);
+extern float *rfin[];
 
 
 
@@ -50,6 +84,7 @@ int pxrun(int mode)
   double dAcqRate;
   int res,i;
   u_int brd_rev,sn;
+  struct timespec tic;
 
   if(mode == -1){
   dma_bufp = NULL;
@@ -58,6 +93,8 @@ int pxrun(int mode)
 	  "Recording Utility\n\n");
 
   dAcqRate = 400.0; 
+  if (d1.dual) dAcqRate = 2.0 * d1.mfreq;   // per channel, 200 max
+  dma_rate = dAcqRate * 1e6 * (d1.dual ? 2 : 1);
   // -- Connect to and initialize the PX14400 device
   printf ("Connecting to and initializing PX14400 device...\n");
   res = ConnectToDevicePX14(&hBrd, MY_PX14400_BRD_NUM);
@@ -81,6 +118,8 @@ int pxrun(int mode)
   }
 
   printf("Setting active channel\n");
+  if (d1.dual) SetActiveChannelsPX14(hBrd, PX14CHANNEL_DUAL);   // interleaved ch1, ch2
+  else
   SetActiveChannelsPX14(hBrd, PX14CHANNEL_ONE); /*JDB*/  // changed from channel ONE to TWO (hamdi 12/20/2012) 
   SetTriggerSourcePX14(hBrd,PX14TRIGSRC_INT_CH1); // changed by Hamdi on 12/20/2012 
   res = SetInternalAdcClockRatePX14(hBrd, dAcqRate);
@@ -92,6 +131,7 @@ int pxrun(int mode)
 
   printf("Setting input voltage range\n");
   res = SetInputVoltRangeCh1PX14(hBrd,0);   // was zero
+  if (SIG_SUCCESS == res && d1.dual) res = SetInputVoltRangeCh2PX14(hBrd,0);
   if (SIG_SUCCESS != res)
     {
       DumpLibErrorPX14(res, "Failed to set input voltage: ", hBrd,0);
@@ -99,116 +139,223 @@ int pxrun(int mode)
     }
 
 
-  // Allocate a DMA buffer that will receive PCI acquisition data. By 
-  //  allocating a DMA buffer, we can use the "fast" PX14400 library
-  //  transfer routines for highest performance
-  printf("Allocating DMA buffer\n");
-  res = AllocateDmaBufferPX14(hBrd, DMA_BUFFER_SAMPLES, &dma_bufp);
-  if (SIG_SUCCESS != res)
-    {
-      DumpLibErrorPX14(res, "Failed to allocate DMA buffer: ", hBrd,0);
-      return -1;
-    }
+  // Allocate a ring of DMA buffers that will receive PCI acquisition data.
+  //  While one buffer is being filled by an asynchronous transfer the
+  //  previous one is processed, so the board RAM FIFO is kept drained
+  printf("Allocating DMA buffers\n");
+  for (i = 0; i < ndmabuf; i++) {
+    res = AllocateDmaBufferPX14(hBrd, DMA_BUFFER_SAMPLES, &dma_ring[i]);
+    if (SIG_SUCCESS != res)
+      {
+        DumpLibErrorPX14(res, "Failed to allocate DMA buffer: ", hBrd,0);
+        return -1;
+      }
+  }
+  for (i = 0; i < ndmabuf; i++) dma_own[i] = DMA_FREE;
+  dma_bufp = dma_ring[0];
+  dma_head = 0;
      return 0;
    }
   
   if(mode == 0){
+  // Arm a free running buffered acquisition that stays armed until
+  //  pxrun(3) and start the first asynchronous transfer into the ring
   res = BeginBufferedPciAcquisitionPX14(hBrd,0);
   if (SIG_SUCCESS != res)
     {
       DumpLibErrorPX14(res, "Failed to arm recording: ", hBrd,0);
       return -1;
     }
-	
-  // Main recording loop
+  clock_gettime(CLOCK_MONOTONIC, &dma_tic);
+  dma_armed = 1;
+  dma_nxfer = 0;
+  if (pxnextxfer(dma_head))
     {
-      // Determine where new data transfer data will go. We alternate
-      //  between two halves of our DMA buffer
-
-      // Start asynchronous DMA transfer of new data; the transfer will be
-      //  started and the function will return immediately without waiting
-      //  for the transfer to complete. This allows our code to continue on
-      //  while the transfer occurs in parallel. We'll then wait for the
-      //  transfer to complete after we've done our processing.
-      res = GetPciAcquisitionDataFastPX14(hBrd, DMA_XFER_SAMPLES, 
-					  dma_bufp, PX14_TRUE);
-      if (SIG_SUCCESS != res)
-	{
-	  static const char* msgp =
-	    "\nFailed to obtain PCI acquisition data: ";
-	  DumpLibErrorPX14 (res, msgp, hBrd,0);
-          return -1;
-	}
-
-      // Wait for the asynchronous DMA transfer to complete so we can loop 
-      //  back around to start a new one. Calling thread will sleep until
-      //  the transfer completes or is cancelled. When we're in buffered
-      //  PCI acquisition mode, this function will also check the state of
-      //  the RAM FIFO and return an error if the RAM FIFO overflowed at
-      //  any point during the transfer.
-      res = WaitForTransferCompletePX14(hBrd,0);
+      EndBufferedPciAcquisitionPX14(hBrd);
+      dma_armed = 0;
+      return -1;
+    }
+  return 0;
+  }
 
-      if (SIG_SUCCESS != res)
+  if(mode == 1){
+  // Wait for the transfer in flight, then immediately start the next one
+  //  into the following free ring buffer so the board never stops
+  //  streaming while the completed buffer is processed. The completed
+  //  buffer is left in dma_bufp, held until pxrelease()
+  if (dma_idle)
+    {
+      printf("DMA ring full - no transfer in flight\n");
+      return -1;
+    }
+  res = WaitForTransferCompletePX14(hBrd,0);
+  if (SIG_SUCCESS != res)
+    {
+      if (SIG_CANCELLED == res)
+	printf ("\nAcquisition cancelled");
+      else if (SIG_PX14_FIFO_OVERFLOW == res) {
+	printf ("\nRAM FIFO overflow: ");
+	printf ("Could not keep up with acquisition rate\n");
+      }
+      else
 	{
-	  if (SIG_CANCELLED == res)
-	    printf ("\nAcquisition cancelled");
-	  else if (SIG_PX14_FIFO_OVERFLOW == res) {
-	    printf ("\nRAM FIFO overflow: ");
-	    printf ("Could not keep up with acquisition rate\n");
-	  }
-	  else
-	    {
-	      static const char* msgp = 
-		"\nAn error occurred waiting for transfer to complete: ";
-	      DumpLibErrorPX14(res, msgp, hBrd,0);
-	    }
-            return -1;
+	  static const char* msgp =
+	    "\nAn error occurred waiting for transfer to complete: ";
+	  DumpLibErrorPX14(res, msgp, hBrd,0);
 	}
-
+      // The contents of the FIFO are lost; count the transfer and the
+      //  time taken to re-arm as dropped samples. A board that cannot be
+      //  re-armed stops the run
+      d1.novfl++;
+      d1.dropped += DMA_XFER_SAMPLES;
+      dma_own[dma_head] = DMA_FREE;
+      EndBufferedPciAcquisitionPX14(hBrd);
+      dma_armed = 0;
+      clock_gettime(CLOCK_MONOTONIC, &tic);
+      if (pxrun(0))
+        {
+          printf ("cannot re-arm the acquisition - run stopped\n");
+          d1.run = 0;
+          return -2;
+        }
+      d1.dropped += ((dma_tic.tv_sec - tic.tv_sec) + (dma_tic.tv_nsec - tic.tv_nsec) / 1e9) * dma_rate;
+      return -1;
     }
-  // End the acquisition. Always do this since in ensures the board is 
-  //  cleaned up properly
-  EndBufferedPciAcquisitionPX14(hBrd);
-  }
-  if(mode == 1){
-  for(i=0;i<NBR;i++) waveFormArray[i] = dma_bufp[i];
-//  for(i=0;i<NBR;i++)  waveFormArray[i] = 32768.0 + sin(i*10e6*2.0*PI/400e6)*32000.0;
-//  printf("waveFormArray\n");
-//  for(j=0;j<8;j++){
-//  for(i=0;i<16;i++)printf(" %d",waveFormArray[i+(NBR/8)*j]);
-//  printf("\n");
-//  }
+  dma_own[dma_head] = DMA_HELD;
+  dma_bufp = dma_ring[dma_head];
+  // the stream is continuous from the arm, so the sample count dates it
+  dma_start = dma_tic.tv_sec + dma_tic.tv_nsec / 1e9 + (double) dma_nxfer * DMA_XFER_SAMPLES / dma_rate;
+  dma_nxfer++;
+//  for(i=0;i<NBR;i++)  dma_bufp[i] = 32768.0 + sin(i*10e6*2.0*PI/400e6)*32000.0;
+  pxnextxfer(dma_head + 1);
   return 0;
   }
   if(mode == 2){
   // -- Cleanup
-  if (dma_bufp)
-    FreeDmaBufferPX14(hBrd, dma_bufp);
+  for (i = 0; i < ndmabuf; i++)
+    if (dma_ring[i])
+      FreeDmaBufferPX14(hBrd, dma_ring[i]);
+  dma_bufp = NULL;
   DisconnectFromDevicePX14(hBrd);
    }
+  if(mode == 3){
+  // Let the transfer in flight finish before ending the acquisition.
+  //  Always end it since this ensures the board is cleaned up properly
+  if (!dma_idle) {
+    WaitForTransferCompletePX14(hBrd,0);
+    dma_own[dma_head] = DMA_FREE;
+    }
+  EndBufferedPciAcquisitionPX14(hBrd);
+  dma_armed = dma_idle = 0;
+  }
+  return 0;
+}
+
+// Start an asynchronous transfer into the first free ring buffer at or
+//  after index i. If every buffer is still held the stream idles in the
+//  board RAM FIFO until pxrelease() frees one
+static int pxnextxfer(int i)
+{
+  int n, res;
+  for (n = 0; n < ndmabuf; n++, i++)
+    if (dma_own[i % ndmabuf] == DMA_FREE) break;
+  if (n == ndmabuf) {
+    dma_idle = 1;
+    return 0;
+    }
+  dma_head = i % ndmabuf;
+  dma_idle = 0;
+  dma_own[dma_head] = DMA_XFER;
+  res = GetPciAcquisitionDataFastPX14(hBrd, DMA_XFER_SAMPLES,
+				      dma_ring[dma_head], PX14_TRUE);
+  if (SIG_SUCCESS != res)
+    {
+      static const char* msgp =
+	"\nFailed to obtain PCI acquisition data: ";
+      DumpLibErrorPX14 (res, msgp, hBrd,0);
+      dma_own[dma_head] = DMA_FREE;
+      dma_idle = 1;
+      return -1;
+    }
   return 0;
 }
 
-int px14run(float spec[], int numacq)
+// Hand a buffer obtained from pxrun(1) back to the DMA ring
+void pxrelease(const px14_sample_t *bufp)
 {
+  int i;
+  for (i = 0; i < ndmabuf; i++)
+    if (dma_ring[i] == bufp && dma_own[i] == DMA_HELD) {
+      dma_own[i] = DMA_FREE;
+      if (dma_armed && dma_idle) pxnextxfer(i);
+      return;
+      }
+  printf("pxrelease: buffer %p not held\n", (const void *)bufp);
+}
 
-    int i, num;
-    int blsiz, blsiz2;
+int px14run(double spec[], int numacq)
+{
 
-    int ithr[5];
-    int ii,statok;
-    double  a0, a1, a2, a3;
-    pthread_t threads[5];
+    int i, q, num;
+    int blsiz, blsiz2, npair;
+    int res, kept;
+    const px14_sample_t *lastp, *rawp;
+    float *rfsp[NQMAX];
+    void (*proc)(int);
+    struct timespec tic, toc;
+    double t;
 
 
       if(numacq == -1){
+        ndmabuf = NDMABUF + rawcap_init(DMA_XFER_SAMPLES);
+        if (ndmabuf > NDMAMAX) ndmabuf = NDMAMAX;
         pxrun(-1);
        blsiz2 = d1.nspec;
        blsiz = blsiz2 * 2;
-       fft_init(blsiz,0, &p0);
-       fft_init(blsiz,1, &p1);
-       fft_init(blsiz,2, &p2);
-       fft_init(blsiz,3, &p3);
+       // one quarter per core, the first core is left for acquisition
+       nquart = d1.nquart;
+       if (nquart <= 0) nquart = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+       npair = NBR / (2 * blsiz);
+       if (nquart > npair) nquart = npair;
+       if (nquart > NQMAX) nquart = NQMAX;
+       if (nquart < 1) nquart = 1;
+       if (d1.tune) fft_tune(blsiz, nquart);
+       winconv_init(d1.simd);
+       printf("window kernel %s\n", winconv_name());
+       if (d1.pfb > 1) {
+         if (!d1.rfft) printf("pfb needs the real input FFT - -rfft ignored\n");
+         if (d1.dwin) printf("pfb replaces the overlapped window - -dwin ignored\n");
+         d1.rfft = 1;
+         d1.dwin = 0;
+         pfb_init(blsiz, d1.pfb);
+         }
+       if (d1.dual) {
+         if (d1.pfb > 1 || d1.dwin || !d1.rfft) printf("dual channel - -pfb -dwin -rfft ignored\n");
+         d1.pfb = d1.dwin = 0;
+         d1.rfft = 1;
+         for (q = 0; q < nquart; q++) xspq[q] = (float *) calloc(4 * blsiz2, sizeof(float));
+         xspec = (double *) calloc(4 * blsiz2, sizeof(double));
+         }
+       if (d1.rfi > 0 && d1.dual) {
+         printf("dual channel - -rfi ignored\n");
+         d1.rfi = 0;
+         }
+       if (d1.rfi > 0 && !d1.rfft) {
+         printf("rfi needs the real input FFT - -rfft ignored\n");
+         d1.rfft = 1;
+         }
+       for (q = 0; q < nquart; q++) {
+         if (d1.rfft) rfft_init(blsiz, RBATCH, q);
+         else fft_init(blsiz, q, &pq[q]);
+         }
+       if (d1.tune) fft_wisdom();
+       accum_init(d1.dual ? 4 * blsiz2 : blsiz2, nquart, d1.accum);
+       if (d1.rfi > 0) {
+         for (q = 0; q < nquart; q++) rfsp[q] = specq[q];
+         rfi_init(blsiz2, nquart, rfsp, 2 * NBR / blsiz + RBATCH);
+         }
+       subint_init(blsiz2, nquart);
+       printf("%d quarters on %d pool workers, %s accumulation\n", nquart, pool_init(nquart), accum_name(d1.accum));
         return 0;
       }
 
@@ -217,117 +364,135 @@ int px14run(float spec[], int numacq)
         }
 
       if(numacq == -3){
+        if (dma_armed) pxrun(3);   // the stream stays armed between positions
+        rawcap_free();
+        while ((rawp = rawcap_done())) pxrelease(rawp);
+        subint_free();
         pxrun(2);    // clean-up pci
-        fft_free(0,&p0);
-        fft_free(1,&p1);
-        fft_free(2,&p2);
-        fft_free(3,&p3);
+        pool_free();
+        for (q = 0; q < nquart; q++) {
+          if (d1.rfft) rfft_free(q);
+          else fft_free(q, &pq[q]);
+          }
+        if (d1.pfb > 1) pfb_free();
+        if (d1.rfi > 0) rfi_free();
+        window_free();
+        accum_free();
+        if (d1.dual) {
+          for (q = 0; q < nquart; q++) free(xspq[q]);
+          free(xspec);
+          }
         return 0;
         }
 
     blsiz2 = d1.nspec;
     blsiz = blsiz2 * 2;
 
-       a0=0.35875; a1=0.48829; a2=0.14128; a3=0.01168;
-     for(i=0;i<blsiz;i++) win0[i]=win1[i]=win2[i]=win3[i]=0.5*(a0-a1*cos(2.0*PI*i/(blsiz-1))+a2*cos(4.0*PI*i/(blsiz-1))-a3*cos(6.0*PI*i/(blsiz-1)))/32768.0;
-     // 0.5 for px14400
+     pxwin = window_get(d1.wtype, blsiz, 0.5/32768.0);   // 0.5 for px14400
 
 //       usleep(100000);  // sleep for 0.1 sec
      if(numacq > 0) {
-        for (i = 0; i < blsiz2; i++) spec0[i] = spec1[i] = spec2[i] = spec3[i] = 0.0;
-        numblk0 = numblk1 = numblk2= numblk3 = 0;
-
-        for(num=0;num<numacq;num++){
-
-        if(num == 0) {
-
-	pxrun(0); // ### Perform an acquisition ###
-	pxrun(1); // ### Readout the waveform ###
-        for (i = 0; i < NBR; i++)  LastwaveForm[i] = waveFormArray[i];
-
-        }
-
-        else {
-
-//        ii = 3;
-        ii = 5;
-        for(i=0;i<ii;i++) corestat[i] = corerr[i] = 0;
-          for (i = 0; i < ii; i++) {
-            if (corestat[i] >= 0) {
-               ithr[i] = i;
-               if (pthread_create(&threads[i], NULL, runspec, &ithr[i])) {
-                    printf("error creating thread\n");
-                      return 0;
-                     }
-                  }
-             }
-        for (i = 0; i < ii; i++) {
-          if (corestat[i] >= 0) {
-              if (pthread_join(threads[i], NULL)) {
-                  printf("error joining thread\n");
-                     return 0;
-                    }
-                  }
-             }
-         statok = 1;
-         for (i = 0; i < ii; i++) {
-             if (corestat[i] != 1) {
-                 statok = 0;
-                 corerr[i]++;
-                   }
-           }
-         if (statok == 0) {
-             printf("statok  error %d\n", statok);
-             }
-
-            for (i = 0; i < NBR; i++)  LastwaveForm[i] = waveFormArray[i];
+        for (q = 0; q < nquart; q++) {
+          for (i = 0; i < blsiz2; i++) specq[q][i] = 0.0;
+          numblkq[q] = 0;
+          }
+        if (d1.dual)
+          for (q = 0; q < nquart; q++) memset(xspq[q], 0, sizeof(float) * 4 * blsiz2);
+        accum_clear();
+        if (d1.rfi > 0) rfi_clear();
+        subint_clear();
+        proc = d1.dual ? procxspec : procspec;
+
+        if (!dma_armed && pxrun(0)) d1.run = 0; // ### Arm the streaming acquisition ###
+        clock_gettime(CLOCK_MONOTONIC, &tic);
+        lastp = NULL;
+        pfb_reset();
+        // until numacq are in, or the board is lost
+        for(num=0;num<numacq && dma_armed;){
+
+        // FFT the last DMA buffer in place on the pool while this thread
+        //  waits for the next one; the buffer goes back to the ring when
+        //  the workers are done with it
+        procbufp = lastp;
+        kept = 0;
+        if(lastp) {
+          for (q = 0; q < nquart; q++) pool_submit(proc, q);
+          kept = rawcap_keep(lastp);   // raw capture may hold on to it
+          }
+        res = pxrun(1); // ### Readout the next waveform ###
+        pool_wait();
+        if(lastp && d1.rfi > 0) rfistep();
+        if(lastp && d1.subint > 0) subint_buffer(sumblk(), 0);
+        if(lastp) {
+          if (d1.pfb > 1) pfb_save(lastp, NBR);
+          if (!kept) pxrelease(lastp);
           }
+        while ((rawp = rawcap_done())) pxrelease(rawp);
+        if (res == -2) break;    // not re-armed, d1.run is 0
+        if (res == 0 && dma_start < sw_valid()) {
+          pxrelease(dma_bufp);    // switch still settling - not counted
+          d1.nsettle++;
+          pfb_reset();
+          lastp = NULL;
+          continue;
+          }
+        if (res) pfb_reset();
+        lastp = (res == 0) ? dma_bufp : NULL;   // NULL - overflow, stream re-armed
+        num++;
 
          }
-
-        procspec(0);
-        procspec(1);
-        procspec(2);
-        procspec(3);
-        
-        for (i = 0; i < blsiz2; i++) spec[i] = spec0[i] + spec1[i] + spec2[i] + spec3[i];
-        d1.numblk += numblk0 + numblk1 + numblk2 + numblk3;
+        sw_end(); // ### Next switch position, settling while this one is finished ###
+
+        if(lastp) {
+          procbufp = lastp;
+          for (q = 0; q < nquart; q++) pool_submit(proc, q);
+          kept = rawcap_keep(lastp);
+          pool_wait();
+          if (d1.rfi > 0) rfistep();
+          if (!kept) pxrelease(lastp);
+          }
+        if (d1.subint > 0) subint_buffer(sumblk(), 1);
+        rawcap_flush();
+        while ((rawp = rawcap_done())) pxrelease(rawp);
+        clock_gettime(CLOCK_MONOTONIC, &toc);
+
+        for (q = 0; q < nquart; q++) d1.numblk += numblkq[q];
+        if (d1.dual) {
+          // ch1 goes on as the ordinary spectrum, ch2 and the cross
+          //  spectrum are left in xspec for the caller to write out
+          accum_get(xspec, 4 * blsiz2);
+          for (i = 0; i < blsiz2; i++) spec[i] = xspec[i];
+          t = (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1e9;
+          if (d1.printout)
+            printf("dual %d blocks per channel %6.1f MS/s per channel processed %6.1f MS/s total\n",
+                   d1.numblk, d1.numblk * (double) blsiz / t / 1e6, 2.0 * d1.numblk * (double) blsiz / t / 1e6);
+          }
+        else {
+          accum_get(spec, blsiz2);
+          if (d1.rfi > 0) rfi_end(spec, blsiz2, d1.numblk);
+          }
+        if (d1.printout) pool_stats(0);
+        else pool_stats(1);
      }
-//    fft_free(&p0);
-//    fft_free(&p1);
-//    fft_free(&p2);
-//    fft_free(&p3);
 	return 0;
 }
 
 
-void *runspec(void *ii)
-{
-    int icore; 
-    icore = *((int *) ii);
-    corestat[icore] = 0;
-    if(icore == 0) procspec(0);
-    if(icore == 1) procspec(1);
-    if(icore == 2) procspec(2);
-    if(icore == 3) procspec(3);
-    if(icore == 4) {
-	pxrun(0); // ### Perform an acquisition ###
-	pxrun(1); // ### Readout the waveform ###
-    }
-  corestat[icore] = 1;
-  pthread_exit(NULL);         // stops thread from executing again
-}
-
 void procspec(int mode)
   {
-    int i, j, kkk, nbr;
+    int j, kkk, nbr, base, npair, nb, st;
     int kk, blsiz, blsiz2, kn, blstep;
 //    double aam, rre, aam2, rre2;
-      float aam, rre, aam2, rre2;
+      float rre, mm[2];
+      const float *win = pxwin;
+      float *in, *sp;
+      const px14_sample_t *wave = procbufp;
         blsiz2 = d1.nspec;
         blsiz = blsiz2 * 2;
-//        nbr = NBR/2;
-        nbr = NBR/4;
+        // quarter "mode" takes a contiguous run of block pairs
+        npair = NBR / (2 * blsiz);
+        base = (mode * npair / nquart) * 2 * blsiz;
+        nbr = ((mode + 1) * npair / nquart) * 2 * blsiz - base;
         if (d1.dwin) {
             kn = 2 * nbr / blsiz - 2;
             blstep = blsiz2;
@@ -336,117 +501,154 @@ void procspec(int mode)
             kn = nbr/blsiz;
             blstep = blsiz;
         }
+        sp = specq[mode];
+        st = d1.rfft ? 1 : 2;
+        nb = 0;
         for (kk = 0; kk < kn; kk++){
-                i = kk % 2;
-                kkk = kk * blstep;
-        if(mode==0) {
-         for (j = 0; j < blsiz; j++) {
-                rre = (LastwaveForm[j+kkk]-32768)*win0[j];
-//                if(d1.sim) rre = 0.5*cos(j*2.0*PI*d1.sim*1e06/(2.0*d1.mfreq*1e06));
-                if (rre > d1.adcmax) {d1.adcmax = rre; d1.maxindex=j+kkk;}
-                if (rre < d1.adcmin) d1.adcmin = rre;
-                reamin0[2*j+i] = rre;
-                     }
+                kkk = kk * blstep + base;
+                // real input FFT - blocks go one after another in rfin,
+                //  the packed complex FFT takes pairs in re and im
+                if (d1.rfft) in = rfin[mode] + nb * blsiz;
+                else in = reamin[mode] + nb;
+        if (d1.pfb > 1) {
+          // polyphase FIR in place of the window
+          if (!pfb_fir(wave, kkk, in)) continue;
+          if(mode==0) {
+            for (j = 0; j < blsiz; j++) {
+              if (in[j] > d1.adcmax) {d1.adcmax = in[j]; d1.maxindex=j+kkk;}
+              if (in[j] < d1.adcmin) d1.adcmin = in[j];
+              }
+            }
           }
-        if(mode==1) {
-         for (j = 0; j < blsiz; j++) {
-                rre = (LastwaveForm[j+kkk+nbr]-32768)*win1[j];
-//                if(d1.sim) rre = 0.5*cos(j*2.0*PI*d1.sim*1e06/(2.0*d1.mfreq*1e06));
-                reamin1[2*j+i] = rre;
-                     }
+        else if (d1.rfft) {
+          // vector kernel straight into the FFT input
+          if(mode==0) {
+            mm[0] = d1.adcmax; mm[1] = d1.adcmin;
+            winconv(wave+kkk, win, in, blsiz, mm);
+            if (mm[0] > d1.adcmax) {
+              for (j = 0; j < blsiz && in[j] != mm[0]; j++) ;
+              d1.adcmax = mm[0]; d1.maxindex = j+kkk;
+              }
+            d1.adcmin = mm[1];
+            }
+          else winconv(wave+kkk, win, in, blsiz, NULL);
           }
-        if(mode==2) {
+        else if(mode==0) {
          for (j = 0; j < blsiz; j++) {
-                rre = (LastwaveForm[j+kkk+2*nbr]-32768)*win2[j];
+                rre = (wave[j+kkk]-32768)*win[j];
 //                if(d1.sim) rre = 0.5*cos(j*2.0*PI*d1.sim*1e06/(2.0*d1.mfreq*1e06));
-                reamin2[2*j+i] = rre;
+                if (rre > d1.adcmax) {d1.adcmax = rre; d1.maxindex=j+kkk;}
+                if (rre < d1.adcmin) d1.adcmin = rre;
+                in[j*st] = rre;
                      }
           }
-        if(mode==3) {
-         for (j = 0; j < blsiz; j++) {
-                rre = (LastwaveForm[j+kkk+3*nbr]-32768)*win3[j];
-//                if(d1.sim) rre = 0.5*cos(j*2.0*PI*d1.sim*1e06/(2.0*d1.mfreq*1e06));
-                reamin3[2*j+i] = rre;
-                     }
+        else {
+         for (j = 0; j < blsiz; j++) in[j*st] = (wave[j+kkk]-32768)*win[j];
           }
-                if (kk % 2) {
-
-                    if(mode==0) cfft(&p0);
-                    if(mode==1) cfft(&p1);
-                    if(mode==2) cfft(&p2);
-                    if(mode==3) cfft(&p3);
-                 
-                  if(mode==0) {
-                    for (i = 0; i < blsiz2; i++) {
-                        if (i >= 1) {
-                            rre = reamout0[2*i] + reamout0[2*(blsiz - i)];
-                            aam = reamout0[2*i+1] - reamout0[2*(blsiz - i)+1];
-                            aam2 = -reamout0[2*i] + reamout0[2*(blsiz - i)];
-                            rre2 = reamout0[2*i+1] + reamout0[2*(blsiz - i)+1];
-                        } else {
-                            rre = reamout0[2*i] + reamout0[0];
-                            aam = reamout0[2*i+1] - reamout0[1];
-                            aam2 = -reamout0[2*i] + reamout0[0];
-                            rre2 = reamout0[2*i+1] + reamout0[1];
-                        }
-                        spec0[i] += rre * rre + aam * aam + rre2 * rre2 + aam2 * aam2;
-                    }
-                          }
-                    if(mode==1) {
-                    for (i = 0; i < blsiz2; i++) {
-                        if (i >= 1) {
-                            rre = reamout1[2*i] + reamout1[2*(blsiz - i)];
-                            aam = reamout1[2*i+1] - reamout1[2*(blsiz - i)+1];
-                            aam2 = -reamout1[2*i] + reamout1[2*(blsiz - i)];
-                            rre2 = reamout1[2*i+1] + reamout1[2*(blsiz - i)+1];
-                        } else {
-                            rre = reamout1[2*i] + reamout1[0];
-                            aam = reamout1[2*i+1] - reamout1[1];
-                            aam2 = -reamout1[2*i] + reamout1[0];
-                            rre2 = reamout1[2*i+1] + reamout1[1];
-                        }
-                        spec1[i] += rre * rre + aam * aam + rre2 * rre2 + aam2 * aam2;
-                    }
-                     }
-                    if(mode==2) {
-                    for (i = 0; i < blsiz2; i++) {
-                        if (i >= 1) {
-                            rre = reamout2[2*i] + reamout2[2*(blsiz - i)];
-                            aam = reamout2[2*i+1] - reamout2[2*(blsiz - i)+1];
-                            aam2 = -reamout2[2*i] + reamout2[2*(blsiz - i)];
-                            rre2 = reamout2[2*i+1] + reamout2[2*(blsiz - i)+1];
-                        } else {
-                            rre = reamout2[2*i] + reamout2[0];
-                            aam = reamout2[2*i+1] - reamout2[1];
-                            aam2 = -reamout2[2*i] + reamout2[0];
-                            rre2 = reamout2[2*i+1] + reamout2[1];
-                        }
-                        spec2[i] += rre * rre + aam * aam + rre2 * rre2 + aam2 * aam2;
-                    }
-                     }
-                    if(mode==3) {
-                    for (i = 0; i < blsiz2; i++) {
-                        if (i >= 1) {
-                            rre = reamout3[2*i] + reamout3[2*(blsiz - i)];
-                            aam = reamout3[2*i+1] - reamout3[2*(blsiz - i)+1];
-                            aam2 = -reamout3[2*i] + reamout3[2*(blsiz - i)];
-                            rre2 = reamout3[2*i+1] + reamout3[2*(blsiz - i)+1];
-                        } else {
-                            rre = reamout3[2*i] + reamout3[0];
-                            aam = reamout3[2*i+1] - reamout3[1];
-                            aam2 = -reamout3[2*i] + reamout3[0];
-                            rre2 = reamout3[2*i+1] + reamout3[1];
-                        }
-                        spec3[i] += rre * rre + aam * aam + rre2 * rre2 + aam2 * aam2;
-                    }
-                     }
-                      if(mode==0) numblk0 += 2;
-                      if(mode==1) numblk1 += 2;
-                      if(mode==2) numblk2 += 2;
-                      if(mode==3) numblk3 += 2;
+                nb++;
+                if (d1.rfft && (nb == RBATCH || kk == kn - 1)) {
+                    rfft(mode, nb);
+                    if (d1.rfi > 0) rfi_power(mode, nb, sp);
+                    else rfft_power(mode, nb, sp);
+                    numblkq[mode] += nb;
+                    nb = 0;
+                 }
+                if (!d1.rfft && nb == 2) {
+                    cfft(&pq[mode]);
+                    cfft_power(reamout[mode], blsiz, sp);
+                    numblkq[mode] += 2;
+                    nb = 0;
                  }
                }
+        // fold this buffer's float partial sum into the long accumulator,
+        //  with -rfi done by rfi_fold() once all the quarters are in
+        if (d1.rfi <= 0) accum_add(mode, sp, blsiz2);
 
   }
 
 
+// RFI kurtosis test of the buffer just processed, one channel slice per
+//  quarter, before the partial sums are used again
+static void rfistep(void)
+{
+  int q;
+  for (q = 0; q < nquart; q++) pool_submit(rfi_fold, q);
+  pool_wait();
+  rfi_buffer();
+}
+
+// Blocks so far in this integration
+static int sumblk(void)
+{
+  int q, n;
+  n = 0;
+  for (q = 0; q < nquart; q++) n += numblkq[q];
+  return n;
+}
+
+// Dual channel: the DMA buffer holds interleaved ch1, ch2 samples, so a
+//  block of blsiz samples per channel takes 2*blsiz. Quarter "mode" takes
+//  a contiguous run of blocks; each is split and windowed in one pass into
+//  a ch1, ch2 pair of FFT inputs
+void procxspec(int mode)
+  {
+    int j, kkk, base, npair, nb, kk, kn, blsiz, blsiz2;
+    float *in;
+    const px14_sample_t *wave = procbufp;
+        blsiz2 = d1.nspec;
+        blsiz = blsiz2 * 2;
+        npair = NBR / (2 * blsiz);
+        base = (mode * npair / nquart) * 2 * blsiz;
+        kn = (mode + 1) * npair / nquart - mode * npair / nquart;
+        nb = 0;
+        for (kk = 0; kk < kn; kk++) {
+                kkk = kk * 2 * blsiz + base;
+                in = rfin[mode] + nb * blsiz;
+                winconv2(wave + kkk, pxwin, in, in + blsiz, blsiz);
+                if (mode == 0)
+                  for (j = 0; j < blsiz; j++) {
+                    if (in[j] > d1.adcmax) {d1.adcmax = in[j]; d1.maxindex = 2*j+kkk;}
+                    if (in[j] < d1.adcmin) d1.adcmin = in[j];
+                    }
+                nb += 2;
+                if (nb == RBATCH || kk == kn - 1) {
+                    rfft(mode, nb);
+                    rfft_cross(mode, nb, xspq[mode]);
+                    numblkq[mode] += nb / 2;
+                    nb = 0;
+                 }
+               }
+        accum_add(mode, xspq[mode], 4 * blsiz2);
+  }
+
+// Append ch2 and the cross spectrum of a dual channel px14run() to the
+//  .xsp file next to the current archive file d->filname. xs is the
+//  [ch2 | cross re, im] part of xspec. Each record is a header of 7
+//  doubles: secs, swpos, nspec, numblk, mfreq, adcmax, adcmin, followed by
+//  nspec floats of ch2 power and nspec re, im float pairs of ch1 * conj(ch2)
+void xspfile(const d1type *d, const double *xs, int swpos)
+{
+  FILE *file;
+  char name[96], *p;
+  double hd[7];
+  float *buf;
+  int i, n;
+  if (!d->dual || xs == NULL) return;
+  n = d->nspec;
+  strcpy(name, d->filname);
+  p = strrchr(name, '.');
+  if (p) strcpy(p, ".xsp");
+  else strcat(name, ".xsp");
+  if ((file = fopen(name, "ab")) == NULL) {
+    printf("cannot write %s\n", name);
+    return;
+    }
+  hd[0] = d->secs; hd[1] = swpos; hd[2] = n; hd[3] = d->numblk;
+  hd[4] = d->mfreq; hd[5] = d->adcmax; hd[6] = d->adcmin;
+  buf = (float *) malloc(sizeof(float) * 3 * n);
+  for (i = 0; i < 3 * n; i++) buf[i] = xs[i];
+  fwrite(hd, sizeof(double), 7, file);
+  fwrite(buf, sizeof(float), 3 * n, file);
+  free(buf);
+  fclose(file);
+}
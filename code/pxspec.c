@@ -14,6 +14,7 @@
 #include <signal.h>
 #include "d1typ6.h"
 #include "d1proto6.h"
+#include "statseg.h"
 #include "stdafx.h"
 #include <fftw3.h>
 
@@ -25,25 +26,22 @@ GdkFont *fixed_font;
 GtkWidget *table;
 GtkWidget *button_exit;
 GtkWidget *drawing_area;
-float avspec[NSIZ];
-float win0[NSIZ*2],win1[NSIZ*2];
-float win2[NSIZ*2],win3[NSIZ*2];
 //double reamin0[NSIZ*4],reamin1[NSIZ*4],reamout0[NSIZ*4],reamout1[NSIZ*4];
 //float reamin0[NSIZ*4],reamin1[NSIZ*4],reamout0[NSIZ*4],reamout1[NSIZ*4];
 //float reamin2[NSIZ*4],reamin3[NSIZ*4],reamout2[NSIZ*4],reamout3[NSIZ*4];
-float spec0[NSIZ],spec1[NSIZ];
-float spec2[NSIZ],spec3[NSIZ];
+float specq[NQMAX][NSIZ];
 int midx, midy;
 HPX14 hBrd;
 px14_sample_t *dma_bufp;
-fftwf_plan p0,p1,p2,p3;
-float *reamin0,*reamin1,*reamin2,*reamin3,*reamout0,*reamout1,*reamout2,*reamout3;
+fftwf_plan pq[NQMAX];
+float *reamin[NQMAX],*reamout[NQMAX];
+extern double *xspec;
 d1type d1;
 
 
-void outfile(double *,int,int);
-void *runspec(void *);
-void px14run(float*,int);
+void outfile(d1type *,double *,int,int);
+void specqueue(double *,int,int);
+void px14run(double*,int);
 int pxrun(int,px14_sample_t *);
 
 void parport(int pdata)
@@ -62,7 +60,7 @@ void parport(int pdata)
     if(pdata == 1) i = 2;  // load
     if(pdata == 2) i = 3;  // load + cal
     outb(i,DATA); /* Sends  to the Data Port */
-    usleep(100000); // sleep for 0.1 sec
+    // no sleep - the switch scheduler drops the blocks taken while it settles
   }
 }
 
@@ -157,11 +155,12 @@ static void handler(int signum) {
 int main(int argc, char **argv)
 {
         static double data[3*NSIZ];
-        static float spec[NSIZ];
+        static double spec[NSIZ];
         double max;
         int i,kk,maxi,run,nspec,nrun,nblock,pport;
-        double av,freq,aa;
-        int swmode,swmnext,test;
+        double av,freq,aa,nsamp,secs;
+        struct timespec tic,toc;
+        int swmode,swmnext,test,bench;
         char buf[256];
         struct sigaction sa;
 
@@ -178,11 +177,37 @@ int main(int argc, char **argv)
     d1.nspec = 32768;
     d1.dwin = 1;
   d1.dwin=0;
+    d1.nquart = 0;
+    d1.rfft = 1;
+    d1.tune = 1;
+    d1.simd = 2;
+    d1.wtype = 0;
+    d1.kbeta = 8.6;
+    d1.pfb = 0;
+    d1.accum = 1;
+    d1.dual = 0;
+    d1.afmt = 1;
+    d1.comp = 0;
+    d1.rawper = 0.0;
+    d1.rawtrig = 0;
+    d1.rawpre = 2;
+    d1.rawpost = 2;
+    d1.rawrate = 20.0;
+    d1.rawcomp = 0;
+    d1.rfi = 0.0;
+    d1.subint = 0;
+    d1.http = 0;
+    d1.settle = 100.0;
+    d1.dwell[0] = d1.dwell[1] = d1.dwell[2] = 1.0;
+    strcpy(d1.wisdir, "/home/loco/Desktop/DATA");
+    strcpy(d1.statname, STATNAME);
+    strcpy(d1.httpaddr, "127.0.0.1");
+    bench = 0;
     pport = 1;
     for(i=0;i<argc-1;i++){
     sscanf(argv[i], "%79s", buf);
     if (strstr(buf, "-disp")) { sscanf(argv[i+1], "%d",&d1.disp); }
-    if (strstr(buf, "-sim")) { sscanf(argv[i+1], "%d",&d1.sim); }
+    if (strcmp(buf, "-sim") == 0) { sscanf(argv[i+1], "%d",&d1.sim); }
     if (strstr(buf, "-print")) { sscanf(argv[i+1], "%d",&d1.printout); }
     if (strstr(buf, "-test")) { sscanf(argv[i+1], "%d",&test); }
     if (strstr(buf, "-nrun")) { sscanf(argv[i+1], "%d",&nrun); }
@@ -191,18 +216,43 @@ int main(int argc, char **argv)
     if (strstr(buf, "-pport")) { sscanf(argv[i+1], "%d",&pport); }
     if (strstr(buf, "-dwin")) { sscanf(argv[i+1], "%d",&d1.dwin); }
     if (strstr(buf, "-mfreq")) { sscanf(argv[i+1], "%lf",&d1.mfreq); }
+    if (strstr(buf, "-nquart")) { sscanf(argv[i+1], "%d",&d1.nquart); }
+    if (strstr(buf, "-rfft")) { sscanf(argv[i+1], "%d",&d1.rfft); }
+    if (strstr(buf, "-tune")) { sscanf(argv[i+1], "%d",&d1.tune); }
+    if (strstr(buf, "-wisdir")) { sscanf(argv[i+1], "%79s",d1.wisdir); }
+    if (strstr(buf, "-simd")) { sscanf(argv[i+1], "%d",&d1.simd); }
+    if (strstr(buf, "-wtype")) { sscanf(argv[i+1], "%d",&d1.wtype); }
+    if (strstr(buf, "-kbeta")) { sscanf(argv[i+1], "%lf",&d1.kbeta); }
+    if (strstr(buf, "-pfb")) { sscanf(argv[i+1], "%d",&d1.pfb); }
+    if (strstr(buf, "-accum")) { sscanf(argv[i+1], "%d",&d1.accum); }
+    if (strstr(buf, "-dual")) { sscanf(argv[i+1], "%d",&d1.dual); }
+    if (strstr(buf, "-afmt")) { sscanf(argv[i+1], "%d",&d1.afmt); }
+    if (strcmp(buf, "-comp") == 0) { sscanf(argv[i+1], "%d",&d1.comp); }
+    if (strstr(buf, "-rawper")) { sscanf(argv[i+1], "%lf",&d1.rawper); }
+    if (strstr(buf, "-rawtrig")) { sscanf(argv[i+1], "%d",&d1.rawtrig); }
+    if (strstr(buf, "-rawpre")) { sscanf(argv[i+1], "%d",&d1.rawpre); }
+    if (strstr(buf, "-rawpost")) { sscanf(argv[i+1], "%d",&d1.rawpost); }
+    if (strstr(buf, "-rawrate")) { sscanf(argv[i+1], "%lf",&d1.rawrate); }
+    if (strstr(buf, "-rawcomp")) { sscanf(argv[i+1], "%d",&d1.rawcomp); }
+    if (strstr(buf, "-rfi")) { sscanf(argv[i+1], "%lf",&d1.rfi); }
+    if (strstr(buf, "-subint")) { sscanf(argv[i+1], "%d",&d1.subint); }
+    if (strcmp(buf, "-http") == 0) { sscanf(argv[i+1], "%d",&d1.http); }
+    if (strstr(buf, "-httpaddr")) { sscanf(argv[i+1], "%79s",d1.httpaddr); }
+    if (strstr(buf, "-settle")) { sscanf(argv[i+1], "%lf",&d1.settle); }
+    if (strstr(buf, "-dwell")) { sscanf(argv[i+1], "%lf,%lf,%lf",&d1.dwell[0],&d1.dwell[1],&d1.dwell[2]); }
+    if (strstr(buf, "-statseg")) { sscanf(argv[i+1], "%79s",d1.statname); }
+    if (strstr(buf, "-bench")) { sscanf(argv[i+1], "%d",&bench); }
     }
 
+    if(bench) return pxbench(bench);
    if(pport)  parport(-1);
 //   setuid(0);
    setgid(getgid());
    setuid(getuid());
 //    if(nblock == 1) nrun = 1;
     if(!d1.disp) sleep(3);   // allow time for pci bus 
-    if(d1.disp){
-      gtk_init(&argc, &argv);
-      disp();
-    }
+    if(d1.disp && disp_init(&argc, &argv, d1.nspec)) d1.disp = 0;
+    if (d1.dual && d1.mfreq > 100.0) d1.mfreq = 100.0;   // 200 MS/s per channel
     d1.stim = 1e-6/(2.0*d1.mfreq);
         nspec = d1.nspec;
         d1.fstart = 0.0; d1.fstop = d1.mfreq; d1.fstep = d1.mfreq/nspec; 
@@ -210,31 +260,33 @@ int main(int argc, char **argv)
         d1.foutstatus = 0;
    run = 1; 
    px14run(spec,-1);   // init
-   if(pport) parport(0);  // set to antenna 
+   writer_init();
+   statseg_init(d1.statname, nspec, argc, argv, nrun, nblock, pport);
+   http_init(d1.http, d1.statname, d1.httpaddr);
+   sw_init(pport);
+   sw_set(0);  // set to antenna 
    while(run<=nrun && d1.run){
     if (run > 1 && (run % 120) == 1) {
 //      px14run(spec,-2); // recalibrate every 120 cycles
     }
+    clock_gettime(CLOCK_MONOTONIC, &tic);
+    nsamp = 0;
     for(swmode=0; swmode<3; swmode++) {
         d1.adcmax = -1e99;
         d1.adcmin = 1e99;
         d1.mode = swmode;
         d1.numblk = 0;
-        px14run(spec,nblock);
+        d1.dropped = 0;
+        d1.novfl = 0;
+        d1.nsettle = 0;
        if(swmode == 2 || test == 3) swmnext = 0;
            else swmnext = swmode + 1;
-        if(pport) parport(swmnext); // set switch for next cycle as it needs acquire to set
+        sw_queue(swmnext); // switched as soon as the last buffer is in
+        px14run(spec,sw_nblock(swmode,nblock));
+        if (!d1.run && d1.numblk == 0) break;   // board lost, nothing to write
+        nsamp += (double) d1.numblk * nspec;
         for(kk=0;kk<nspec;kk++) data[swmode*nspec+kk] = spec[kk];
-       if(d1.disp){
-        aa = 100.0/((double)d1.numblk*nspec*2.0);  // for compatibility with acml FFT 
-        for(kk=0;kk<nspec;kk++) avspec[kk]=10.0*log10(aa*spec[kk]+1e-99);
-        d1.totp = 0.0;
-        for(kk=(int)(80.0*nspec/210.0);kk<nspec;kk++) d1.totp += spec[kk];
-        d1.secs = readclock();
-        Repaint(d1.mfreq);
-        while (gtk_events_pending()) gtk_main_iteration();
-        clearpaint();
-        }
+       if(d1.disp) disp_post(&d1, spec, nspec);   // drawn on the display thread
         max = -1e99;
         maxi = 0;
         aa = 1.0/((double)d1.numblk*nspec*2.0);  // for compatibility with acml FFT 
@@ -246,9 +298,10 @@ int main(int argc, char **argv)
         data[swmode*nspec+kk]=av;
         }
         freq = d1.fstart + maxi*d1.mfreq/nspec;
-        if(d1.printout) printf("max %f dBm maxkk %d swmode %d freq %5.1f MHz adcmax %8.5f %d adcmin %8.5f temp %2.0f C\n",
-                max,maxi,swmode,freq,d1.adcmax,d1.maxindex,d1.adcmin,d1.temp);
-            if(!test) outfile(&data[swmode*nspec],nspec,swmode);
+        if(d1.printout) printf("max %f dBm maxkk %d swmode %d freq %5.1f MHz adcmax %8.5f %d adcmin %8.5f temp %2.0f C dropped %1.0f settle %d\n",
+                max,maxi,swmode,freq,d1.adcmax,d1.maxindex,d1.adcmin,d1.temp,d1.dropped,d1.nsettle);
+            if(!test) specqueue(&data[swmode*nspec],nspec,swmode);
+            statseg_spec(&d1, &data[swmode*nspec], swmode);
        }
        if(test==2){
          for(kk=0;kk<nspec;kk++) {
@@ -263,22 +316,87 @@ int main(int argc, char **argv)
                if(kk < 10) av = -199.0;
                data[2*nspec+kk]=av;
           }
-         for(swmode=0; swmode<3; swmode++)  outfile(&data[swmode*nspec],nspec,swmode); 
+         for(swmode=0; swmode<3; swmode++)  specqueue(&data[swmode*nspec],nspec,swmode); 
        }
+       // duty cycle of the 3 positions as hamdi_pxspec reports it
+       clock_gettime(CLOCK_MONOTONIC, &toc);
+       secs = (toc.tv_sec - tic.tv_sec) + (toc.tv_nsec - tic.tv_nsec) / 1e9;
+       statseg_cycle(run, secs > 0 ? 100.0 * nsamp / (d1.mfreq * 1e6) / secs : 0.0);
        run++;
        }
         px14run(spec,-3);  // clean-up pci
+        writer_free();
+        disp_free();
+        acqclose();
+        http_free();
+        statseg_free();
 	return 0;
 }
 
 
+// Spectrum record for the writer thread - a copy of d1 at the end of the
+//  integration and the dBm values, followed for dual channel by ch2 and
+//  the cross spectrum from xspec, or with -rfi by the flag mask bytes
+typedef struct
+{
+ d1type d;
+ int num, swpos;
+ double data[];
+} specjob;
+
+static d1type d1w;   // file fields of d1 as kept by the writer thread
+
+static void specout(void *p)
+{
+  specjob *j = (specjob *) p;
+  strcpy(j->d.filname, d1w.filname);
+  j->d.foutstatus = d1w.foutstatus;
+  j->d.rday = d1w.rday;
+  outfile(&j->d, j->data, j->num, j->swpos);
+  if (j->d.dual) xspfile(&j->d, j->data + j->num, j->swpos);
+  if (j->d.rfi > 0) rfifile(&j->d, (unsigned char *) (j->data + j->num), j->swpos);
+  if (strcmp(d1w.filname, j->d.filname)) disp_file(j->d.filname);
+  strcpy(d1w.filname, j->d.filname);
+  d1w.foutstatus = j->d.foutstatus;
+  d1w.rday = j->d.rday;
+}
+
+// Queue a spectrum for output; waits only when the writer queue of NWQ
+//  jobs is full
+void
+specqueue (double data[], int num, int swpos)
+{
+  static specjob *j;
+  static size_t len;
+  size_t n;
+  n = sizeof(specjob) + sizeof(double) * num * (d1.dual ? 4 : 1);
+  if (d1.rfi > 0) n += num;
+  if (n > len) {
+    free(j);
+    j = (specjob *) malloc(n);
+    len = n;
+  }
+  d1.secs = readclock();
+  j->d = d1;
+  j->num = num;
+  j->swpos = swpos;
+  memcpy(j->data, data, sizeof(double) * num);
+  if (d1.dual) memcpy(j->data + num, xspec + num, sizeof(double) * 3 * num);
+  if (d1.rfi > 0) memcpy(j->data + num, rfi_mask(), num);
+  writer_submit(specout, j, n, 1);
+}
+
 void
-outfile (double data[],int num, int swpos)
+outfile (d1type *d, double data[],int num, int swpos)
 {
   FILE *file1;
   int yr, da, hr, mn, sc, i,j,k;
   char txt[256];
   char b64[64];
+  if (d->afmt) {    // binary archive
+    acqwrite(d, data, num, swpos);
+    return;
+  }
   for (i = 0; i < 26; i++) {
            b64[i] = 'A' + i;
            b64[i + 26] = 'a' + i;
@@ -287,45 +405,44 @@ outfile (double data[],int num, int swpos)
         b64[i + 52] = '0' + i;
         b64[62] = '+';
         b64[63] = '/';
-      d1.secs = readclock();
-    if(d1.foutstatus==0) {
-      toyrday (d1.secs, &yr, &da, &hr, &mn, &sc);
-      d1.rday = da;
-      sprintf (d1.filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
+    if(d->foutstatus==0) {
+      toyrday (d->secs, &yr, &da, &hr, &mn, &sc);
+      d->rday = da;
+      sprintf (d->filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
       }
-  if ((file1 = fopen (d1.filname, "a")) == NULL)
+  if ((file1 = fopen (d->filname, "a")) == NULL)
     {
-      if ((file1 = fopen (d1.filname, "w")) == NULL)
+      if ((file1 = fopen (d->filname, "w")) == NULL)
 	{
-	  d1.foutstatus = -99;
-	  printf ("cannot write %s\n", d1.filname);
+	  d->foutstatus = -99;
+	  printf ("cannot write %s\n", d->filname);
 	  return;
 	}
-      d1.foutstatus = 1;
+      d->foutstatus = 1;
     }
   else
-    d1.foutstatus = 1;
-  if (d1.foutstatus == 1)
+    d->foutstatus = 1;
+  if (d->foutstatus == 1)
     {
-      toyrday (d1.secs, &yr, &da, &hr, &mn, &sc);
-      if (da != d1.rday && swpos == 0)
+      toyrday (d->secs, &yr, &da, &hr, &mn, &sc);
+      if (da != d->rday && swpos == 0)
 	{
 	  fclose (file1);
-	  d1.foutstatus = 0;
-	  toyrday (d1.secs, &yr, &da, &hr, &mn, &sc);
-	  sprintf (d1.filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
-	  if ((file1 = fopen (d1.filname, "w")) == NULL)
+	  d->foutstatus = 0;
+	  toyrday (d->secs, &yr, &da, &hr, &mn, &sc);
+	  sprintf (d->filname, "/home/loco/Desktop/DATA/%4d_%03d_%02d.acq", yr, da, hr);
+	  if ((file1 = fopen (d->filname, "w")) == NULL)
 	    {
-	      d1.foutstatus = -99;
+	      d->foutstatus = -99;
 	      return;
 	    }
-	  d1.foutstatus = 1;
+	  d->foutstatus = 1;
 	}
 	        fprintf (file1, "# swpos %d resolution %8.3f adcmax %8.5f adcmin %8.5f temp %2.0f C nblk %d nspec %d\n",
-                         swpos,d1.fres,d1.adcmax,d1.adcmin,d1.temp,d1.numblk,d1.nspec);
+                         swpos,d->fres,d->adcmax,d->adcmin,d->temp,d->numblk,d->nspec);
 		sprintf (txt,
 			 "%4d:%03d:%02d:%02d:%02d %1d %8.3f %8.6f %8.3f %4.1f spectrum ",
-                yr, da, hr, mn, sc, swpos, d1.fstart, d1.fstep, d1.fstop, d1.adcmax);
+                yr, da, hr, mn, sc, swpos, d->fstart, d->fstep, d->fstop, d->adcmax);
 	        fprintf (file1, "%s", txt);
 /*
        for(i=0; i<num; i++) {
@@ -343,7 +460,7 @@ outfile (double data[],int num, int swpos)
        }
       fprintf (file1,"\n");
       fclose (file1);
-      if(swpos == 0) d1.rday = da;
+      if(swpos == 0) d->rday = da;
     }
 }
 
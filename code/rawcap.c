@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+#include "compress.h"
+#include "rawcap.h"
+
+// Raw sample capture alongside the spectra. Each processed DMA block is
+//  offered to rawcap_keep(), which holds the last -rawpre blocks as the
+//  pre-trigger history. A capture starts every -rawper seconds or when a
+//  block peaks at -rawtrig counts from mid-scale, limited to -rawrate MB/s
+//  on average, and takes the history, the trigger block and -rawpost more.
+//  The capture thread writes them straight from the DMA buffers, so
+//  nothing is copied, and hands them back through rawcap_done() for the
+//  acquisition thread to release to the ring. The number of blocks held
+//  is bounded by what rawcap_init() asked to be added to the ring, so a
+//  slow disk drops captures rather than stalling the spectra
+
+#define NRAWQ 64
+
+extern d1type d1;
+
+typedef struct
+{
+ int kind;    // RAW_OPEN, RAW_BLOCK, RAW_CLOSE
+ const unsigned short *buf;
+ rawhdr h;
+} rawjob;
+
+#define RAW_OPEN 0
+#define RAW_BLOCK 1
+#define RAW_CLOSE 2
+
+static rawjob rawq[NRAWQ];
+static const unsigned short *rawdone[NRAWQ], *rawhist[NRAWQ];
+static int rawqh, rawqt, rawqn, rawdh, rawdt, rawdn, rawrun, rawon;
+static int nhist, nheld, maxheld, rawpost, rawsamp;
+static pthread_t rawthr;
+static pthread_mutex_t rawlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rawcond = PTHREAD_COND_INITIALIZER;
+static double rawlast, rawtokens, nevent, nwritten, nmissed, ncut, rawbytes, rawsecs;
+
+static void *rawthread(void *);
+
+static double rawclock(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Returns the number of DMA buffers to add to the ring for the captures,
+//  0 when raw capture is off
+int rawcap_init(int nsamp)
+{
+  if (d1.rawper <= 0 && d1.rawtrig <= 0) return 0;
+  if (d1.rawpre < 0) d1.rawpre = 0;
+  if (d1.rawpost < 0) d1.rawpost = 0;
+  // history refilling while the previous capture is still being written
+  maxheld = 2 * d1.rawpre + d1.rawpost + 1;
+  if (maxheld > NRAWQ / 4) {    // room in rawq for an open and close per block
+    printf("raw capture -rawpre %d -rawpost %d too long\n", d1.rawpre, d1.rawpost);
+    return 0;
+  }
+  rawsamp = nsamp;
+  rawqh = rawqt = rawqn = rawdh = rawdt = rawdn = 0;
+  nhist = nheld = rawpost = 0;
+  rawlast = rawclock();
+  rawtokens = 0;
+  rawrun = 1;
+  if (pthread_create(&rawthr, NULL, rawthread, NULL)) {
+    printf("cannot start raw capture thread\n");
+    return 0;
+  }
+  rawon = 1;
+  printf("raw capture %d+1+%d blocks every %g s or at %d counts, %g MB/s max, %s\n",
+         d1.rawpre, d1.rawpost, d1.rawper, d1.rawtrig, d1.rawrate, cz_name(d1.rawcomp));
+  return maxheld;
+}
+
+// called with rawlock held
+static void rawput(int kind, const unsigned short *buf, const rawhdr *h)
+{
+  rawq[rawqh].kind = kind;
+  rawq[rawqh].buf = buf;
+  if (h) rawq[rawqh].h = *h;
+  rawqh = (rawqh + 1) % NRAWQ;
+  rawqn++;
+  pthread_cond_signal(&rawcond);
+}
+
+static void rawrelease(const unsigned short *buf)
+{
+  rawdone[rawdh] = buf;
+  rawdh = (rawdh + 1) % NRAWQ;
+  rawdn++;
+}
+
+static int rawpeak(const unsigned short *buf, int n)
+{
+  int j;
+  unsigned short max, min;
+  max = 0;
+  min = 65535;
+  for (j = 0; j < n; j++) {
+    max = buf[j] > max ? buf[j] : max;
+    min = buf[j] < min ? buf[j] : min;
+  }
+  return max - 32768 > 32768 - min ? max - 32768 : 32768 - min;
+}
+
+// Offer a processed block. Returns 1 if the capture has taken it, in which
+//  case it comes back from rawcap_done() instead of being released now
+int rawcap_keep(const unsigned short *buf)
+{
+  int i, peak, reason, need;
+  double t;
+  rawhdr h;
+
+  if (!rawon) return 0;
+  pthread_mutex_lock(&rawlock);
+  if (rawpost > 0) {    // capture in progress
+    if (nheld < maxheld) {
+      nheld++;
+      rawput(RAW_BLOCK, buf, NULL);
+      if (--rawpost == 0) rawput(RAW_CLOSE, NULL, NULL);
+      pthread_mutex_unlock(&rawlock);
+      return 1;
+    }
+    ncut++;    // writer behind - cut the capture short
+    rawpost = 0;
+    rawput(RAW_CLOSE, NULL, NULL);
+  }
+  pthread_mutex_unlock(&rawlock);
+
+  peak = d1.rawtrig > 0 ? rawpeak(buf, rawsamp) : 0;
+  t = rawclock();
+  need = (d1.rawpre + 1 + d1.rawpost) * rawsamp * 2;
+  if (d1.rawrate > 0) {
+    rawtokens += (t - rawlast) * d1.rawrate * 1e6;
+    if (rawtokens > need) rawtokens = need;
+  }
+  else rawtokens = need;
+  reason = 0;
+  if (d1.rawtrig > 0 && peak >= d1.rawtrig) reason = RAWLEVEL;
+  else if (d1.rawper > 0 && t - rawlast >= d1.rawper) reason = RAWPERIOD;
+  rawlast = t;
+
+  pthread_mutex_lock(&rawlock);
+  if (reason && rawtokens >= need && nheld + 1 + d1.rawpost <= maxheld) {
+    rawtokens -= need;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RAWMAGIC, 8);
+    h.hdrsize = sizeof(h);
+    h.nsamp = rawsamp;
+    h.pre = nhist;
+    h.dual = d1.dual;
+    h.codec = d1.rawcomp;
+    h.reason = reason;
+    h.peak = reason == RAWLEVEL ? peak : rawpeak(buf, rawsamp);
+    h.secs = readclock();
+    h.mfreq = d1.mfreq;
+    h.dropped = d1.dropped;
+    rawput(RAW_OPEN, NULL, &h);
+    for (i = 0; i < nhist; i++) rawput(RAW_BLOCK, rawhist[i], NULL);
+    nhist = 0;
+    nheld++;
+    rawput(RAW_BLOCK, buf, NULL);
+    rawpost = d1.rawpost;
+    if (rawpost == 0) rawput(RAW_CLOSE, NULL, NULL);
+    nevent++;
+    pthread_mutex_unlock(&rawlock);
+    return 1;
+  }
+  if (reason && rawtokens >= need) nmissed++;    // still writing the last ones
+  if (d1.rawpre == 0 || nheld >= maxheld) {
+    pthread_mutex_unlock(&rawlock);
+    return 0;
+  }
+  // into the history, pushing out the oldest. Blocks stay counted in nheld
+  //  until they are taken from rawcap_done()
+  if (nhist == d1.rawpre) {
+    rawrelease(rawhist[0]);
+    memmove(rawhist, rawhist + 1, sizeof(rawhist[0]) * (nhist - 1));
+    nhist--;
+  }
+  rawhist[nhist++] = buf;
+  nheld++;
+  pthread_mutex_unlock(&rawlock);
+  return 1;
+}
+
+// Next block to hand back to the DMA ring, NULL when there are none
+const unsigned short *rawcap_done(void)
+{
+  const unsigned short *p;
+  pthread_mutex_lock(&rawlock);
+  p = NULL;
+  if (rawdn > 0) {
+    p = rawdone[rawdt];
+    rawdt = (rawdt + 1) % NRAWQ;
+    rawdn--;
+    nheld--;
+  }
+  pthread_mutex_unlock(&rawlock);
+  return p;
+}
+
+// End of an acquisition run: close any capture and let go of the history,
+//  which would not run on into the next switch position
+void rawcap_flush(void)
+{
+  int i;
+  if (!rawon) return;
+  pthread_mutex_lock(&rawlock);
+  if (rawpost > 0) {
+    rawpost = 0;
+    rawput(RAW_CLOSE, NULL, NULL);
+  }
+  for (i = 0; i < nhist; i++) rawrelease(rawhist[i]);
+  nhist = 0;
+  pthread_mutex_unlock(&rawlock);
+}
+
+// Stop the thread once everything is written. The held blocks are then
+//  all waiting in rawcap_done()
+void rawcap_free(void)
+{
+  if (!rawon) return;
+  rawcap_flush();
+  pthread_mutex_lock(&rawlock);
+  rawrun = 0;
+  pthread_cond_signal(&rawcond);
+  pthread_mutex_unlock(&rawlock);
+  pthread_join(rawthr, NULL);
+  printf("raw capture %1.0f captures %1.0f blocks %1.0f MB written at %6.1f MB/s, %1.0f missed %1.0f cut short\n",
+         nevent, nwritten, rawbytes / 1e6, rawsecs > 0 ? rawbytes / rawsecs / 1e6 : 0, nmissed, ncut);
+  rawon = 0;
+}
+
+static void *rawthread(void *arg)
+{
+  rawjob j;
+  FILE *f;
+  rawhdr h;
+  czframe fr;
+  void *z;
+  size_t zn;
+  int yr, da, hr, mn, sc, ok;
+  char name[128];
+  double t;
+
+  (void) arg;
+  f = NULL;
+  ok = 0;
+  memset(&h, 0, sizeof(h));
+  z = malloc(cz_bound(2 * rawsamp));
+  pthread_mutex_lock(&rawlock);
+  for (;;) {
+    while (rawqn == 0 && rawrun) pthread_cond_wait(&rawcond, &rawlock);
+    if (rawqn == 0) break;
+    j = rawq[rawqt];
+    rawqt = (rawqt + 1) % NRAWQ;
+    rawqn--;
+    pthread_mutex_unlock(&rawlock);
+    t = rawclock();
+    if (j.kind == RAW_OPEN) {
+      h = j.h;
+      toyrday(h.secs, &yr, &da, &hr, &mn, &sc);
+      sprintf(name, "/home/loco/Desktop/DATA/%4d_%03d_%02d%02d%02d.raw", yr, da, hr, mn, sc);
+      if ((f = fopen(name, "wb")) == NULL) printf("cannot write %s\n", name);
+      ok = f && fwrite(&h, sizeof(h), 1, f) == 1;
+    }
+    else if (j.kind == RAW_BLOCK) {
+      if (ok) {
+        if (h.codec) {
+          zn = cz_encode(h.codec, 2, j.buf, 2 * rawsamp, z);
+          ok = fwrite(z, 1, zn, f) == zn;
+        }
+        else {
+          // frame header only, the samples go straight from the DMA buffer
+          memset(&fr, 0, sizeof(fr));
+          fr.magic = CZMAGIC;
+          fr.codec = CZ_NONE;
+          fr.elsize = 2;
+          fr.rawlen = fr.zlen = zn = 2 * rawsamp;
+          ok = fwrite(&fr, sizeof(fr), 1, f) == 1 && fwrite(j.buf, 2, rawsamp, f) == (size_t) rawsamp;
+        }
+        if (ok) h.nblk++;
+        rawbytes += ok ? 2.0 * rawsamp : 0;
+      }
+      nwritten += ok;
+    }
+    else if (f) {
+      fseek(f, 0, SEEK_SET);
+      fwrite(&h, sizeof(h), 1, f);
+      if (fclose(f) || !ok) printf("raw capture write error\n");
+      f = NULL;
+    }
+    rawsecs += rawclock() - t;
+    pthread_mutex_lock(&rawlock);
+    if (j.kind == RAW_BLOCK) rawrelease(j.buf);
+  }
+  pthread_mutex_unlock(&rawlock);
+  if (f) fclose(f);
+  free(z);
+  return NULL;
+}
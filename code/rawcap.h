@@ -0,0 +1,26 @@
+/* Raw sample captures, written by rawcap.c and listed with rawcat
+ *
+ * One file per capture: a rawhdr, then nblk DMA blocks of nsamp 16-bit
+ * samples, each stored as a compress.c frame (codec CZ_NONE when not
+ * compressed). Dual channel blocks hold interleaved ch1, ch2 samples.
+ * Block pre is the one that triggered the capture */
+#include <stdint.h>
+
+#define RAWMAGIC "PXRAW001"
+#define RAWPERIOD 1
+#define RAWLEVEL 2
+
+typedef struct
+{
+ char magic[8];       // RAWMAGIC
+ uint32_t hdrsize;    // sizeof(rawhdr)
+ int32_t nblk;        // blocks in the file, set when the capture is closed
+ int32_t nsamp;       // samples per block
+ int32_t pre;         // blocks before the trigger block
+ int32_t dual, codec;
+ int32_t reason;      // RAWPERIOD or RAWLEVEL
+ int32_t peak;        // largest |sample - 32768| of the trigger block
+ double secs;         // when the trigger block was processed
+ double mfreq, dropped;
+ int32_t spare[4];
+} rawhdr;
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "compress.h"
+#include "rawcap.h"
+
+// List a raw sample capture written by pxspec -rawper or -rawtrig: the
+//  header, one line per block, and with -v the samples as signed counts
+//  rawcat file.raw [-b block] [-n count] [-v] [-o out.bin]
+//   -b  only this block (block pre is the trigger block)
+//   -n  print at most count samples per block with -v
+//   -v  print the samples, ch1 ch2 pairs for dual channel captures
+//   -o  write the decoded samples of all blocks as raw 16-bit words
+
+int main(int argc, char **argv)
+{
+  FILE *f, *fo;
+  rawhdr h;
+  czframe fr;
+  unsigned short *s;
+  unsigned char *z;
+  int i, j, b, blk, nmax, verbose, max, min;
+  char *oname;
+  struct tm *tm;
+  time_t tt;
+
+  if (argc < 2) {
+    printf("usage: rawcat file.raw [-b block] [-n count] [-v] [-o out.bin]\n");
+    return 1;
+  }
+  blk = -1;
+  nmax = 0x7fffffff;
+  verbose = 0;
+  oname = NULL;
+  for (i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) blk = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc) nmax = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-v")) verbose = 1;
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) oname = argv[++i];
+  }
+  if ((f = fopen(argv[1], "rb")) == NULL || fread(&h, sizeof(h), 1, f) != 1 ||
+      memcmp(h.magic, RAWMAGIC, 8) || h.hdrsize != sizeof(h) || h.nsamp <= 0) {
+    printf("cannot read %s\n", argv[1]);
+    return 1;
+  }
+  tt = h.secs;
+  tm = gmtime(&tt);
+  printf("%4d:%03d:%02d:%02d:%02d %s peak %d blocks %d of %d samples, %d before the trigger, %s%s %1.1f MHz\n",
+         tm->tm_year + 1900, tm->tm_yday + 1, tm->tm_hour, tm->tm_min, tm->tm_sec,
+         h.reason == RAWLEVEL ? "level" : "periodic", h.peak, h.nblk, h.nsamp, h.pre,
+         cz_name(h.codec), h.dual ? " dual" : "", h.mfreq);
+  fo = NULL;
+  if (oname && (fo = fopen(oname, "wb")) == NULL) printf("cannot write %s\n", oname);
+  s = (unsigned short *) malloc(2 * (size_t) h.nsamp);
+  z = (unsigned char *) malloc(cz_bound(2 * (size_t) h.nsamp));
+  for (b = 0; b < h.nblk; b++) {
+    if (fread(&fr, sizeof(fr), 1, f) != 1 || fr.magic != CZMAGIC || fr.zlen > cz_bound(2 * (size_t) h.nsamp)) break;
+    memcpy(z, &fr, sizeof(fr));
+    if (fread(z + sizeof(fr), 1, fr.zlen, f) != fr.zlen ||
+        cz_decode(z, sizeof(fr) + fr.zlen, s, 2 * (size_t) h.nsamp) != 2 * (size_t) h.nsamp) break;
+    if (fo) fwrite(s, 2, h.nsamp, fo);
+    if (blk >= 0 && b != blk) continue;
+    max = 0;
+    min = 65535;
+    for (j = 0; j < h.nsamp; j++) {
+      if (s[j] > max) max = s[j];
+      if (s[j] < min) min = s[j];
+    }
+    printf("block %3d%s max %6d min %6d stored %5.1f%%\n", b, b == h.pre ? " trigger" : "",
+           max - 32768, min - 32768, 100.0 * fr.zlen / (2.0 * h.nsamp));
+    if (verbose)
+      for (j = 0; j < h.nsamp && j < nmax; j += 1 + h.dual) {
+        if (h.dual) printf(" %6d %6d", s[j] - 32768, s[j+1] - 32768);
+        else printf(" %6d", s[j] - 32768);
+        if ((j / (1 + h.dual)) % 8 == 7) printf("\n");
+      }
+    if (verbose) printf("\n");
+  }
+  if (b < h.nblk) printf("%s: block %d unreadable\n", argv[1], b);
+  if (fo) fclose(fo);
+  fclose(f);
+  free(s);
+  free(z);
+  return 0;
+}
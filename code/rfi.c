@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+// RFI excision for procspec with -rfi thr, in two steps per DMA buffer:
+//  - In the power pass rfi_power() also sums the squared power per channel
+//    and the total power of each block. A block whose total is more than
+//    thr sigma above the median of the previous buffer's blocks, with sigma
+//    from their MAD, is a broadband burst and is taken back out.
+//  - rfi_fold(), run on the pool after the buffer, combines the quarters and
+//    computes the spectral kurtosis of each channel over the M blocks kept,
+//    SK = (M+1)/(M-1) (M S2/S1^2 - 1), which is 1 for Gaussian noise. Bursty
+//    RFI pushes it up and CW down. Channels outside the limits are left out
+//    of the buffer's sum; the rest go to the accumulator.
+//  rfi_end() scales each channel of the integrated spectrum by the blocks
+//  it actually got, so the usual division by numblk stays right, repeats
+//  the SK test over the whole integration to catch weak steady RFI, and
+//  makes the flag mask: the fraction of blocks left out per channel from
+//  0 to 254, or 255 for a channel flagged over the whole integration
+//  The blocks are assumed independent, which -dwin overlap is not quite
+
+#define RFIMINM 8    // fewest blocks in a buffer for the SK test
+
+void rfft_power2(int, int, float *, float *, float *);
+void rfft_unpower(int, int, float *, float *);
+extern d1type d1;
+
+static float *rfisp[NQMAX], *rfisq[NQMAX], *rfitot[NQMAX];
+static int rfintot[NQMAX], rfim[NQMAX], rfiblk[NQMAX];
+static float *rfiall;
+static double *rfiex;    // blocks left out per channel in this run
+static double *rfis1, *rfis2, *rfiraw;    // kept and left out power sums
+static unsigned char *rfimask;
+static int rfin, rfinq, rfimaxblk, rfiref;
+static float rfimed, rfisig;
+static double rfinblk, rfinchan;
+
+// sp are the quarters' float partial sums, maxblk the most blocks per
+//  quarter in one DMA buffer
+void rfi_init(int n, int nq, float **sp, int maxblk)
+{
+  int q;
+  rfi_free();
+  for (q = 0; q < nq; q++) {
+    rfisp[q] = sp[q];
+    rfisq[q] = (float *) calloc(n, sizeof(float));
+    rfitot[q] = (float *) malloc(sizeof(float) * maxblk);
+  }
+  rfiall = (float *) malloc(sizeof(float) * maxblk * nq);
+  rfiex = (double *) calloc(n, sizeof(double));
+  rfis1 = (double *) calloc(n, sizeof(double));
+  rfis2 = (double *) calloc(n, sizeof(double));
+  rfiraw = (double *) calloc(n, sizeof(double));
+  rfimask = (unsigned char *) calloc(n, 1);
+  rfin = n;
+  rfinq = nq;
+  rfimaxblk = maxblk;
+  rfi_clear();
+}
+
+void rfi_free(void)
+{
+  int q;
+  for (q = 0; q < rfinq; q++) {
+    free(rfisq[q]);
+    free(rfitot[q]);
+    rfisq[q] = rfitot[q] = NULL;
+  }
+  free(rfiall); free(rfiex); free(rfimask);
+  free(rfis1); free(rfis2); free(rfiraw);
+  rfiall = NULL;
+  rfiex = rfis1 = rfis2 = rfiraw = NULL;
+  rfimask = NULL;
+  rfinq = 0;
+}
+
+// Start of an integration. The block reference is not carried over since
+//  the next switch position has a different power level
+void rfi_clear(void)
+{
+  int q;
+  for (q = 0; q < rfinq; q++) {
+    memset(rfisq[q], 0, sizeof(float) * rfin);
+    rfintot[q] = rfim[q] = rfiblk[q] = 0;
+  }
+  memset(rfiex, 0, sizeof(double) * rfin);
+  memset(rfis1, 0, sizeof(double) * rfin);
+  memset(rfis2, 0, sizeof(double) * rfin);
+  memset(rfiraw, 0, sizeof(double) * rfin);
+  rfiref = 0;
+  rfinblk = rfinchan = 0;
+}
+
+// In place of rfft_power for quarter q
+void rfi_power(int q, int nb, float *sp)
+{
+  int b;
+  float *tot;
+  if (rfintot[q] + nb > rfimaxblk) nb = rfimaxblk - rfintot[q];    // not expected
+  tot = rfitot[q] + rfintot[q];
+  rfft_power2(q, nb, sp, rfisq[q], tot);
+  for (b = 0; b < nb; b++)
+    if (rfiref && tot[b] > rfimed + d1.rfi * rfisig) {
+      rfft_unpower(q, b, sp, rfisq[q]);
+      rfiblk[q]++;
+    }
+    else rfim[q]++;
+  rfintot[q] += nb;
+}
+
+// SK limits for M blocks at thr sigma. SK itself is skewed, but
+//  y = (SK^-1/3 - 1) / -1/3 is close to normal with mean -2/3 var and
+//  standard deviation sqrt(var), var = 4M^2/((M-1)(M+2)(M+3)), which gives
+//  tail fractions within a factor of 3 of the normal ones for M >= 32
+static void rfi_limits(int m, double thr, float *lo, float *hi)
+{
+  double v, y;
+  v = 4.0 * m * m / ((m - 1.0) * (m + 2.0) * (m + 3.0));
+  y = -2.0 / 3.0 * v + thr * sqrt(v);
+  *hi = y < 3.0 ? pow(1.0 - y / 3.0, -3.0) : 1e30;
+  y = -2.0 / 3.0 * v - thr * sqrt(v);
+  *lo = pow(1.0 - y / 3.0, -3.0);
+}
+
+// Channel slice q of the buffer: kurtosis test, then into the accumulator
+void rfi_fold(int q)
+{
+  int i, r, i0, i1, m;
+  float s1, s2, sk, a, lo, hi;
+  float *sp0;
+
+  i0 = q * rfin / rfinq;
+  i1 = (q + 1) * rfin / rfinq;
+  m = 0;
+  for (r = 0; r < rfinq; r++) m += rfim[r];
+  a = (m + 1.0f) / (m - 1.0f);
+  lo = -1e30f;
+  hi = 1e30f;
+  if (m >= RFIMINM) rfi_limits(m, d1.rfi, &lo, &hi);
+  sp0 = rfisp[0];
+  for (i = i0; i < i1; i++) {
+    s1 = sp0[i];
+    s2 = rfisq[0][i];
+    for (r = 1; r < rfinq; r++) {
+      s1 += rfisp[r][i];
+      s2 += rfisq[r][i];
+      rfisp[r][i] = 0.0f;
+      rfisq[r][i] = 0.0f;
+    }
+    rfisq[0][i] = 0.0f;
+    sk = s1 > 0.0f ? a * (m * s2 / (s1 * s1) - 1.0f) : 1.0f;
+    if (sk < lo || sk > hi) {
+      rfiraw[i] += s1;
+      rfiex[i] += m;
+      s1 = 0.0f;
+    }
+    else {
+      rfis1[i] += s1;
+      rfis2[i] += s2;
+    }
+    sp0[i] = s1;
+  }
+  accum_addr(q, sp0, i0, i1);
+}
+
+// After the pool has run rfi_fold: the block reference for the next buffer
+//  from the median and MAD of this buffer's block totals
+static int rficmp(const void *a, const void *b)
+{
+  float x = *(const float *) a, y = *(const float *) b;
+  return x < y ? -1 : x > y;
+}
+
+void rfi_buffer(void)
+{
+  int q, n, i;
+  float med, floor;
+  n = 0;
+  for (q = 0; q < rfinq; q++) {
+    memcpy(rfiall + n, rfitot[q], sizeof(float) * rfintot[q]);
+    n += rfintot[q];
+    rfinblk += rfiblk[q];
+    rfintot[q] = rfim[q] = rfiblk[q] = 0;
+  }
+  if (n < 3) return;
+  qsort(rfiall, n, sizeof(float), rficmp);
+  med = rfiall[n / 2];
+  for (i = 0; i < n; i++) rfiall[i] = fabsf(rfiall[i] - med);
+  qsort(rfiall, n, sizeof(float), rficmp);
+  rfimed = med;
+  rfisig = 1.4826f * rfiall[n / 2];
+  // noise alone varies the total by about 1/sqrt(nspec)
+  floor = med / sqrt((double) rfin);
+  if (rfisig < floor) rfisig = floor;
+  rfiref = 1;
+}
+
+// End of the integration of numblk blocks: scale spec and make the mask
+void rfi_end(double spec[], int n, int numblk)
+{
+  int i, nall;
+  double ex, m, sk;
+  float lo, hi;
+  if (n > rfin) n = rfin;
+  rfinchan = 0;
+  nall = 0;
+  for (i = 0; i < n; i++) {
+    ex = rfiex[i] + rfinblk;
+    m = numblk - ex;
+    rfinchan += rfiex[i];
+    if (m < RFIMINM) {
+      // nothing much left - give the measured power, flagged
+      spec[i] = numblk > rfinblk ? rfiraw[i] * numblk / (numblk - rfinblk) : 0.0;
+      rfimask[i] = 255;
+      nall++;
+      continue;
+    }
+    if (ex > 0) spec[i] *= numblk / m;
+    rfimask[i] = (unsigned char) (254.0 * ex / numblk + 0.5);
+    sk = rfis1[i] > 0 ? (m + 1) / (m - 1) * (m * rfis2[i] / (rfis1[i] * rfis1[i]) - 1) : 1.0;
+    rfi_limits((int) m, d1.rfi, &lo, &hi);
+    if (sk < lo || sk > hi) {
+      rfimask[i] = 255;
+      nall++;
+    }
+  }
+  if (d1.printout)
+    printf("rfi %1.0f of %d blocks flagged, %5.3f%% of channels left out, %d channels flagged throughout\n",
+           rfinblk, numblk, numblk > 0 ? 100.0 * rfinchan / ((double) numblk * n) : 0.0, nall);
+}
+
+// flag mask of the last rfi_end()
+const unsigned char *rfi_mask(void)
+{
+  return rfimask;
+}
+
+// Append the mask of a spectrum to the .rfi file next to the archive
+//  file d->filname: a header of 5 doubles secs, swpos, nspec, numblk,
+//  mfreq then the nspec mask bytes of rfi_mask()
+void rfifile(const d1type *d, const unsigned char *mask, int swpos)
+{
+  FILE *file;
+  char name[96], *p;
+  double hd[5];
+  strcpy(name, d->filname);
+  p = strrchr(name, '.');
+  if (p) strcpy(p, ".rfi");
+  else strcat(name, ".rfi");
+  if ((file = fopen(name, "ab")) == NULL) {
+    printf("cannot write %s\n", name);
+    return;
+  }
+  hd[0] = d->secs; hd[1] = swpos; hd[2] = d->nspec; hd[3] = d->numblk; hd[4] = d->mfreq;
+  fwrite(hd, sizeof(double), 5, file);
+  fwrite(mask, 1, d->nspec, file);
+  fclose(file);
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "statseg.h"
+
+// Print the live spectrometer status from the status segment
+//  statcat [-f segment] [-s] [-w secs]
+//   -f  segment file, default STATNAME
+//   -s  also print the spectra as freq, p0, p1, p2 like the status file
+//   -w  repeat every secs seconds whenever the segment has changed
+
+int main(int argc, char **argv)
+{
+  statmap *m;
+  stathdr h;
+  float *spec;
+  const char *name;
+  int i, n, k, all, seq, last;
+  double wait;
+  time_t t;
+
+  name = STATNAME;
+  all = 0;
+  wait = 0;
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-f") && i + 1 < argc) name = argv[++i];
+    else if (!strcmp(argv[i], "-s")) all = 1;
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc) wait = atof(argv[++i]);
+  }
+  if ((m = stat_open(name)) == NULL) {
+    printf("cannot map %s\n", name);
+    return 1;
+  }
+  n = m->hdr->nsw * m->hdr->nspec;
+  spec = all ? (float *) malloc(sizeof(float) * n) : NULL;
+  last = -1;
+  for (;;) {
+    seq = stat_snapshot(m, &h, spec, n);
+    if (seq != last) {
+      t = (time_t) h.secs;
+      printf("Status: run %d of %d swpos %d at %s", h.run, h.nrun, h.swpos, asctime(gmtime(&t)));
+      printf("Process: command = %s\n", h.cmd);
+      printf("Parameter: nblock = %d pport = %d duty_cycle = %6.3f mfreq = %6.3f fres = %6.3f output dropped = %d\n",
+             h.nblock, h.pport, h.duty_cycle, h.mfreq, h.fres, h.wdrop);
+      for (k = 0; k < h.nsw; k++)
+        printf("Switch %d: numblk %d adcmax %8.5f adcmin %8.5f temp %4.1f dropped %.0f overflows %d\n",
+               k, h.sw[k].numblk, h.sw[k].adcmax, h.sw[k].adcmin, h.sw[k].temp, h.sw[k].dropped, h.sw[k].novfl);
+      if (all) {
+        printf("Data [freq (MHz), p0, p1, p2]:\n");
+        for (i = 0; i < h.nspec; i++) {
+          printf("%8.3f", i * (h.mfreq / h.nspec));
+          for (k = 0; k < h.nsw; k++) printf(", %8.3f", spec[k * h.nspec + i]);
+          printf("\n");
+        }
+      }
+      fflush(stdout);
+      last = seq;
+    }
+    if (wait <= 0) break;
+    usleep((useconds_t) (wait * 1e6));
+  }
+  free(spec);
+  stat_close(m);
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "statseg.h"
+
+// Reader side of the live status segment
+
+statmap *stat_open(const char *name)
+{
+  statmap *m;
+  struct stat st;
+  if ((m = (statmap *) calloc(1, sizeof(statmap))) == NULL) return NULL;
+  if ((m->fd = open(name, O_RDONLY)) < 0 || fstat(m->fd, &st) ||
+      st.st_size < (off_t) sizeof(stathdr)) {
+    if (m->fd >= 0) close(m->fd);
+    free(m);
+    return NULL;
+  }
+  m->len = st.st_size;
+  m->hdr = (stathdr *) mmap(NULL, m->len, PROT_READ, MAP_SHARED, m->fd, 0);
+  if (m->hdr == MAP_FAILED || m->hdr->magic != STATMAGIC ||
+      m->hdr->hdrsize + sizeof(float) * m->hdr->nsw * m->hdr->nspec > m->len) {
+    stat_close(m);
+    return NULL;
+  }
+  m->spec = (float *) ((char *) m->hdr + m->hdr->hdrsize);
+  return m;
+}
+
+void stat_close(statmap *m)
+{
+  if (m == NULL) return;
+  if (m->hdr && m->hdr != MAP_FAILED) munmap(m->hdr, m->len);
+  if (m->fd >= 0) close(m->fd);
+  free(m);
+}
+
+// Consistent copy of the header, and of up to n floats of the spectra
+//  (nsw * nspec for all of them) if spec is not NULL. Returns the sequence
+//  number of the copy, which changes whenever the writer updates
+int stat_snapshot(statmap *m, stathdr *h, float *spec, int n)
+{
+  uint32_t s1, s2;
+  int tries;
+  for (tries = 0; ; tries++) {
+    s1 = m->hdr->seq;
+    if (s1 & 1) {
+      if (tries > 100) sched_yield();
+      continue;
+    }
+    __sync_synchronize();
+    memcpy(h, m->hdr, sizeof(stathdr));
+    if (spec) {
+      if (n > h->nsw * h->nspec) n = h->nsw * h->nspec;
+      if ((size_t) h->hdrsize + sizeof(float) * n > m->len) n = 0;
+      memcpy(spec, m->spec, sizeof(float) * n);
+    }
+    __sync_synchronize();
+    s2 = m->hdr->seq;
+    if (s1 == s2) return (int) (s1 >> 1);
+  }
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+#include "statseg.h"
+
+// Writer side of the live status segment (layout in statseg.h). The file
+//  is created at full size and mapped shared, so updating it is a memory
+//  copy and monitoring programs see each spectrum as soon as it is done
+
+static stathdr *seg;
+static float *segspec;
+static size_t seglen;
+static int segn;
+
+int statseg_init(const char *name, int nspec, int argc, char **argv, int nrun, int nblock, int pport)
+{
+  int fd, i;
+  size_t n;
+  statseg_free();
+  seglen = sizeof(stathdr) + sizeof(float) * STATNSW * nspec;
+  if ((fd = open(name, O_RDWR | O_CREAT, 0644)) < 0 || ftruncate(fd, seglen)) {
+    printf("cannot create status segment %s\n", name);
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  seg = (stathdr *) mmap(NULL, seglen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED) {
+    printf("cannot map status segment %s\n", name);
+    seg = NULL;
+    return -1;
+  }
+  segn = nspec;
+  segspec = (float *) (seg + 1);
+  seg->seq |= 1;    // odd while the header is rebuilt, even if a crash left it odd
+  __sync_synchronize();
+  seg->magic = STATMAGIC;
+  seg->version = STATVERSION;
+  seg->hdrsize = sizeof(stathdr);
+  seg->nspec = nspec;
+  seg->nsw = STATNSW;
+  seg->swpos = -1;
+  seg->run = 0;
+  seg->nrun = nrun;
+  seg->nblock = nblock;
+  seg->pport = pport;
+  seg->wdrop = 0;
+  seg->starttime = time(NULL);
+  seg->cmd[0] = 0;
+  for (i = 0, n = 0; i < argc && n + strlen(argv[i]) + 2 < sizeof(seg->cmd); i++) {
+    strcpy(seg->cmd + n, argv[i]);
+    n += strlen(argv[i]);
+    seg->cmd[n++] = ' ';
+    seg->cmd[n] = 0;
+  }
+  memset(seg->sw, 0, sizeof(seg->sw));
+  memset(segspec, 0, sizeof(float) * STATNSW * nspec);
+  __sync_synchronize();
+  seg->seq++;    // even
+  return 0;
+}
+
+void statseg_free(void)
+{
+  if (seg) munmap(seg, seglen);
+  seg = NULL;
+}
+
+// New dBm spectrum for switch position swpos
+void statseg_spec(const d1type *d, const double data[], int swpos)
+{
+  int i;
+  float *sp;
+  if (seg == NULL || swpos < 0 || swpos >= STATNSW) return;
+  sp = segspec + swpos * segn;
+  seg->seq++;
+  __sync_synchronize();
+  for (i = 0; i < segn && i < d->nspec; i++) sp[i] = data[i];
+  seg->swpos = swpos;
+  seg->secs = d->secs;
+  seg->mfreq = d->mfreq;
+  seg->fres = d->fres;
+  seg->adcmax = d->adcmax;
+  seg->adcmin = d->adcmin;
+  seg->temp = d->temp;
+  seg->dropped = d->dropped;
+  seg->wdrop = d->wdrop;
+  seg->sw[swpos].secs = d->secs;
+  seg->sw[swpos].adcmax = d->adcmax;
+  seg->sw[swpos].adcmin = d->adcmin;
+  seg->sw[swpos].temp = d->temp;
+  seg->sw[swpos].dropped = d->dropped;
+  seg->sw[swpos].numblk = d->numblk;
+  seg->sw[swpos].novfl = d->novfl;
+  seg->sw[swpos].maxindex = d->maxindex;
+  __sync_synchronize();
+  seg->seq++;
+}
+
+// end of a 3 position cycle
+void statseg_cycle(int run, double duty_cycle)
+{
+  if (seg == NULL) return;
+  seg->seq++;
+  __sync_synchronize();
+  seg->run = run;
+  seg->duty_cycle = duty_cycle;
+  __sync_synchronize();
+  seg->seq++;
+}
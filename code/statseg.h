@@ -0,0 +1,44 @@
+/* Live status segment, written in place by pxspec and mapped read-only by
+ * monitoring programs (statread.c, statcat). A header followed by the
+ * latest dBm spectrum of each switch position as float[nsw][nspec]
+ *
+ * Seqlock: the writer makes seq odd, updates, then makes it even again.
+ * A reader copies while seq is even and unchanged across the copy */
+#include <stdint.h>
+
+#define STATMAGIC 0x54415453    // "STAT"
+#define STATVERSION 1
+#define STATNSW 3
+#define STATNAME "/dev/shm/pxspec_status"
+
+typedef struct
+{
+ double secs;        // end of the integration
+ double adcmax, adcmin, temp, dropped;
+ int32_t numblk, novfl, maxindex, spare;
+} statsw;
+
+typedef struct
+{
+ uint32_t magic, version;
+ volatile uint32_t seq;
+ uint32_t hdrsize;   // offset of the spectra
+ int32_t nspec, nsw, swpos, run;    // swpos last updated
+ int32_t nrun, nblock, pport, wdrop;    // wdrop: output jobs dropped
+ double starttime, secs, duty_cycle, mfreq, fres;
+ double adcmax, adcmin, temp, dropped;
+ statsw sw[STATNSW];
+ char cmd[256];
+} stathdr;
+
+typedef struct
+{
+ int fd;
+ size_t len;
+ stathdr *hdr;
+ float *spec;
+} statmap;
+
+statmap *stat_open (const char *);
+void stat_close (statmap *);
+int stat_snapshot (statmap *, stathdr *, float *, int);
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+// Time-resolved output with -subint n. Besides the long integration, every
+//  n blocks the spectrum of just those blocks goes into a ring of spectra
+//  and on to the writer thread, which appends it to a waterfall file. The
+//  rows end on DMA buffer boundaries since that is when the partial sums
+//  are folded in, so a row can be a little longer than n blocks.
+//  accum_addr() adds each buffer's partial sum into a float sum per quarter
+//  as well as the long accumulator, so the extra cost is one add per
+//  channel per buffer plus one fold over the quarters per row - the blocks
+//  are never summed again. A row whose ring slot is still waiting for the
+//  disk is dropped and counted. With -rfi the channels excluded in a
+//  buffer are missing from that row, which is not rescaled
+//  The file has per row 5 doubles: secs at the end of the row, swpos,
+//  nspec, numblk, mfreq, followed by nspec floats in dBm as in the archive
+
+#define NSUBR 32    // ring of spectra
+
+extern d1type d1;
+
+typedef struct
+{
+ int slot;
+} subjob;
+
+static float *subring;
+static double subhd[NSUBR][5];
+static volatile int subfull[NSUBR];
+static int subn, subnq, subhead, sublast, subrows, subdrop;
+static float *subrow;    // slot being filled by subint_fold()
+static FILE *subf;
+static int subday;
+
+static void subint_fold(int q)
+{
+  accum_subget(subrow, q * subn / subnq, (q + 1) * subn / subnq);
+}
+
+// writer thread - append one row and give the slot back
+static void subint_write(void *p)
+{
+  int s, i, yr, da, hr, mn, sc;
+  char name[96];
+  double aa, *hd;
+  float *row;
+
+  s = ((subjob *) p)->slot;
+  hd = subhd[s];
+  row = subring + (size_t) s * subn;
+  toyrday(hd[0], &yr, &da, &hr, &mn, &sc);
+  if (subf && da != subday) {
+    fclose(subf);
+    subf = NULL;
+  }
+  if (subf == NULL) {
+    sprintf(name, "/home/loco/Desktop/DATA/%4d_%03d.wfl", yr, da);    // one file a day
+    if ((subf = fopen(name, "ab")) == NULL) printf("cannot write %s\n", name);
+    subday = da;
+  }
+  aa = 1.0 / (hd[3] * subn * 2.0);
+  for (i = 0; i < subn; i++) row[i] = 10.0 * log10(aa * row[i] + 1e-99) - 38.3;
+  if (subf && (fwrite(hd, sizeof(double), 5, subf) != 5 ||
+               fwrite(row, sizeof(float), subn, subf) != (size_t) subn || fflush(subf)))
+    printf("waterfall write error\n");
+  http_row(hd[0], (int) hd[1], row, subn);
+  __sync_synchronize();
+  subfull[s] = 0;
+}
+
+static void subint_close(void *p)
+{
+  (void) p;
+  if (subf) fclose(subf);
+  subf = NULL;
+}
+
+// n channels in the rows, nq quarters
+void subint_init(int n, int nq)
+{
+  subint_free();
+  if (d1.subint <= 0) return;
+  if ((subring = (float *) malloc(sizeof(float) * n * NSUBR)) == NULL) {
+    printf("cannot allocate subint ring\n");
+    d1.subint = 0;
+    return;
+  }
+  accum_sub(1);
+  memset((void *) subfull, 0, sizeof(subfull));
+  subn = n;
+  subnq = nq;
+  subhead = subrows = subdrop = 0;
+  subint_clear();
+}
+
+void subint_free(void)
+{
+  int z = 0;
+  if (subring == NULL) return;
+  writer_submit(subint_close, &z, sizeof(z), 1);
+  writer_flush();
+  printf("subint %d rows %d dropped\n", subrows, subdrop);
+  accum_sub(0);
+  free(subring);
+  subring = NULL;
+}
+
+// Start of an integration
+void subint_clear(void)
+{
+  sublast = 0;
+}
+
+// After each DMA buffer with nblk blocks so far in the integration, and
+//  with final set at its end to write out what is left
+void subint_buffer(int nblk, int final)
+{
+  subjob j;
+  int q, s;
+
+  if (subring == NULL || nblk <= sublast) return;
+  if (nblk - sublast < d1.subint && !final) return;
+  s = subhead;
+  subrow = subfull[s] ? NULL : subring + (size_t) s * subn;   // NULL just restarts the sums
+  for (q = 0; q < subnq; q++) pool_submit(subint_fold, q);
+  pool_wait();
+  if (subrow == NULL) subdrop++;
+  else {
+    subhd[s][0] = readclock();
+    subhd[s][1] = d1.mode;
+    subhd[s][2] = subn;
+    subhd[s][3] = nblk - sublast;
+    subhd[s][4] = d1.mfreq;
+    subfull[s] = 1;
+    j.slot = s;
+    if (writer_submit(subint_write, &j, sizeof(j), 0)) {
+      subfull[s] = 0;
+      subdrop++;
+    }
+    else {
+      subhead = (s + 1) % NSUBR;
+      subrows++;
+    }
+  }
+  sublast = nblk;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+// Switch scheduler for the antenna, load, load + cal cycle. The ADC keeps
+//  streaming across the positions: px14run() calls sw_end() as soon as the
+//  last DMA buffer of a position is in, which drives the switch to the
+//  position queued with sw_queue() without waiting, and then drops the
+//  buffers that started less than -settle ms after the switch, counting
+//  them in d1.nsettle, rather than sleeping. The settling so overlaps the
+//  processing of the last buffer and the output of the spectrum.
+//  -dwell a,b,c scales the number of DMA buffers of each position
+
+#define NSWPOS 3
+
+extern d1type d1;
+
+static int swpport, swnext = -1;
+static double swvalid;
+
+static double swclock(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void sw_init(int pport)
+{
+  int i;
+  swpport = pport;
+  swnext = -1;
+  swvalid = 0;
+  for (i = 0; i < NSWPOS; i++)
+    if (d1.dwell[i] <= 0) d1.dwell[i] = 1.0;
+  if (d1.settle < 0) d1.settle = 0;
+}
+
+// DMA buffers to take at position pos for a nominal nblock
+int sw_nblock(int pos, int nblock)
+{
+  int n;
+  if (pos < 0 || pos >= NSWPOS) return nblock;
+  n = (int) (nblock * d1.dwell[pos] + 0.5);
+  return n < 1 ? 1 : n;
+}
+
+// Drive the switch now. Without the parallel port nothing moves, so
+//  there is nothing to settle
+void sw_set(int pos)
+{
+  if (!swpport) return;
+  parport(pos);
+  swvalid = swclock() + d1.settle * 1e-3;
+}
+
+// Position to switch to at the end of the next px14run()
+void sw_queue(int pos)
+{
+  swnext = pos;
+}
+
+void sw_end(void)
+{
+  if (swnext >= 0) sw_set(swnext);
+  swnext = -1;
+}
+
+// CLOCK_MONOTONIC time from which samples are valid
+double sw_valid(void)
+{
+  return swvalid;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+// Window and convert kernel: out[j] = (in[j] - 32768) * win[j] for 16-bit
+//  ADC samples, with the max and min of out in mm[0], mm[1] when mm is not
+//  NULL. The vector versions give the same result as the scalar loop since
+//  the int to float conversion is exact and there is no fused multiply-add.
+//  winconv_init() picks the widest one the cpu supports. winconv2() does the
+//  same for dual channel data, splitting the interleaved ch1/ch2 samples
+//  into two windowed blocks in the same pass
+
+#if defined(__x86_64__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define WINCONV_SIMD
+#include <immintrin.h>
+#endif
+
+static void winconv_scalar(const unsigned short *, const float *, float *, int, float *);
+static void (*winconvp)(const unsigned short *, const float *, float *, int, float *) = winconv_scalar;
+static void winconv2_scalar(const unsigned short *, const float *, float *, float *, int);
+static void (*winconv2p)(const unsigned short *, const float *, float *, float *, int) = winconv2_scalar;
+static const char *winconvname = "scalar";
+
+static void winconv_scalar(const unsigned short *in, const float *win, float *out, int n, float *mm)
+{
+  int j;
+  float rre, max, min;
+  if (mm == NULL) {
+    for (j = 0; j < n; j++) out[j] = (in[j] - 32768) * win[j];
+    return;
+  }
+  max = mm[0]; min = mm[1];
+  for (j = 0; j < n; j++) {
+    rre = (in[j] - 32768) * win[j];
+    max = rre > max ? rre : max;
+    min = rre < min ? rre : min;
+    out[j] = rre;
+  }
+  mm[0] = max; mm[1] = min;
+}
+
+static void winconv2_scalar(const unsigned short *in, const float *win, float *outa, float *outb, int n)
+{
+  int j;
+  for (j = 0; j < n; j++) {
+    outa[j] = (in[2*j] - 32768) * win[j];
+    outb[j] = (in[2*j+1] - 32768) * win[j];
+  }
+}
+
+#ifdef WINCONV_SIMD
+// each 32-bit lane holds one ch1, ch2 pair - ch1 in the low half
+__attribute__((target("avx2")))
+static void winconv2_avx2(const unsigned short *in, const float *win, float *outa, float *outb, int n)
+{
+  int j;
+  __m256i off, lo, s;
+  __m256 w;
+  off = _mm256_set1_epi32(32768);
+  lo = _mm256_set1_epi32(0xffff);
+  for (j = 0; j + 8 <= n; j += 8) {
+    s = _mm256_loadu_si256((const __m256i *) (in + 2*j));
+    w = _mm256_loadu_ps(win + j);
+    _mm256_storeu_ps(outa + j, _mm256_mul_ps(w,
+      _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_and_si256(s, lo), off))));
+    _mm256_storeu_ps(outb + j, _mm256_mul_ps(w,
+      _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(s, 16), off))));
+  }
+  if (j < n) winconv2_scalar(in + 2*j, win + j, outa + j, outb + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+static void winconv2_avx512(const unsigned short *in, const float *win, float *outa, float *outb, int n)
+{
+  int j;
+  __m512i off, lo, s;
+  __m512 w;
+  off = _mm512_set1_epi32(32768);
+  lo = _mm512_set1_epi32(0xffff);
+  for (j = 0; j + 16 <= n; j += 16) {
+    s = _mm512_loadu_si512((const void *) (in + 2*j));
+    w = _mm512_loadu_ps(win + j);
+    _mm512_storeu_ps(outa + j, _mm512_mul_ps(w,
+      _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_and_si512(s, lo), off))));
+    _mm512_storeu_ps(outb + j, _mm512_mul_ps(w,
+      _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(s, 16), off))));
+  }
+  if (j < n) winconv2_scalar(in + 2*j, win + j, outa + j, outb + j, n - j);
+}
+
+__attribute__((target("avx2")))
+static void winconv_avx2(const unsigned short *in, const float *win, float *out, int n, float *mm)
+{
+  int j;
+  __m256i off, s;
+  __m256 v0, v1, max, min;
+  __m128 h;
+  float x;
+  off = _mm256_set1_epi32(32768);
+  max = _mm256_set1_ps(-1e30f);
+  min = _mm256_set1_ps(1e30f);
+  for (j = 0; j + 16 <= n; j += 16) {
+    s = _mm256_loadu_si256((const __m256i *) (in + j));
+    v0 = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(s)), off));
+    v1 = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(s, 1)), off));
+    v0 = _mm256_mul_ps(v0, _mm256_loadu_ps(win + j));
+    v1 = _mm256_mul_ps(v1, _mm256_loadu_ps(win + j + 8));
+    _mm256_storeu_ps(out + j, v0);
+    _mm256_storeu_ps(out + j + 8, v1);
+    if (mm) {
+      max = _mm256_max_ps(max, _mm256_max_ps(v0, v1));
+      min = _mm256_min_ps(min, _mm256_min_ps(v0, v1));
+    }
+  }
+  if (mm) {
+    h = _mm_max_ps(_mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+    h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+    x = _mm_cvtss_f32(h);
+    if (x > mm[0]) mm[0] = x;
+    h = _mm_min_ps(_mm256_castps256_ps128(min), _mm256_extractf128_ps(min, 1));
+    h = _mm_min_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_min_ss(h, _mm_shuffle_ps(h, h, 1));
+    x = _mm_cvtss_f32(h);
+    if (x < mm[1]) mm[1] = x;
+  }
+  if (j < n) winconv_scalar(in + j, win + j, out + j, n - j, mm);
+}
+
+__attribute__((target("avx512f")))
+static void winconv_avx512(const unsigned short *in, const float *win, float *out, int n, float *mm)
+{
+  int j;
+  __m512i off;
+  __m512 v, max, min;
+  float x;
+  off = _mm512_set1_epi32(32768);
+  max = _mm512_set1_ps(-1e30f);
+  min = _mm512_set1_ps(1e30f);
+  for (j = 0; j + 16 <= n; j += 16) {
+    v = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_cvtepu16_epi32(
+          _mm256_loadu_si256((const __m256i *) (in + j))), off));
+    v = _mm512_mul_ps(v, _mm512_loadu_ps(win + j));
+    _mm512_storeu_ps(out + j, v);
+    if (mm) {
+      max = _mm512_max_ps(max, v);
+      min = _mm512_min_ps(min, v);
+    }
+  }
+  if (mm) {
+    x = _mm512_reduce_max_ps(max);
+    if (x > mm[0]) mm[0] = x;
+    x = _mm512_reduce_min_ps(min);
+    if (x < mm[1]) mm[1] = x;
+  }
+  if (j < n) winconv_scalar(in + j, win + j, out + j, n - j, mm);
+}
+#endif
+
+void winconv_init(int simd)
+{
+  winconvp = winconv_scalar;
+  winconv2p = winconv2_scalar;
+  winconvname = "scalar";
+#ifdef WINCONV_SIMD
+  __builtin_cpu_init();
+  if (simd >= 1 && __builtin_cpu_supports("avx2")) {
+    winconvp = winconv_avx2;
+    winconv2p = winconv2_avx2;
+    winconvname = "avx2";
+  }
+  if (simd >= 2 && __builtin_cpu_supports("avx512f")) {
+    winconvp = winconv_avx512;
+    winconv2p = winconv2_avx512;
+    winconvname = "avx512";
+  }
+#endif
+}
+
+const char *winconv_name(void)
+{
+  return winconvname;
+}
+
+void winconv(const unsigned short *in, const float *win, float *out, int n, float *mm)
+{
+  winconvp(in, win, out, n, mm);
+}
+
+void winconv2(const unsigned short *in, const float *win, float *outa, float *outb, int n)
+{
+  winconv2p(in, win, outa, outb, n);
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/mman.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+extern d1type d1;
+
+// Window cache. Each (type, length, scale) window is computed once into
+//  page aligned memory which is then made read-only, so all the quarters
+//  share one copy and a stray write faults instead of corrupting spectra.
+//  Types: 0 Blackman-Harris 4-term, 1 Hann, 2 flat-top, 3 Kaiser (beta d1.kbeta)
+
+#define NWIN 8
+
+typedef struct
+{
+ int type, n;
+ double scale, beta;
+ size_t len;
+ float *w;
+} wincache;
+
+static wincache wins[NWIN];
+static int nwins;
+static const char *winnames[] = {"blackman-harris", "hann", "flat-top", "kaiser"};
+
+// zeroth order modified Bessel function of the first kind
+static double besseli0(double x)
+{
+  double s, t;
+  int k;
+  s = t = 1.0;
+  for (k = 1; k < 100 && t > 1e-12 * s; k++) {
+    t *= (x / (2.0 * k)) * (x / (2.0 * k));
+    s += t;
+  }
+  return s;
+}
+
+static void window_calc(float *w, int type, int n, double scale, double beta)
+{
+  int i;
+  double x, r, m;
+  m = n - 1;
+  for (i = 0; i < n; i++) {
+    x = 2.0 * M_PI * i / m;
+    switch (type) {
+    case 1:
+      w[i] = scale * 0.5 * (1.0 - cos(x));
+      break;
+    case 2:
+      w[i] = scale * (0.21557895 - 0.41663158 * cos(x) + 0.277263158 * cos(2.0 * x)
+                      - 0.083578947 * cos(3.0 * x) + 0.006947368 * cos(4.0 * x));
+      break;
+    case 3:
+      r = 2.0 * i / m - 1.0;
+      w[i] = scale * besseli0(beta * sqrt(1.0 - r * r)) / besseli0(beta);
+      break;
+    default:
+      w[i] = scale * (0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x));
+      break;
+    }
+  }
+}
+
+const float *window_get(int type, int n, double scale)
+{
+  int i;
+  long pg;
+  double beta;
+  wincache *c;
+
+  if (type < 0 || type > 3) type = 0;
+  beta = type == 3 ? d1.kbeta : 0.0;
+  for (i = 0; i < nwins; i++) {
+    c = &wins[i];
+    if (c->type == type && c->n == n && c->scale == scale && c->beta == beta) return c->w;
+  }
+  if (nwins == NWIN) window_free();    // only expected if the settings keep changing
+  c = &wins[nwins];
+  pg = sysconf(_SC_PAGESIZE);
+  if (pg <= 0) pg = 4096;
+  c->len = ((sizeof(float) * n + pg - 1) / pg) * pg;
+  if (posix_memalign((void **) &c->w, pg, c->len)) {
+    printf("cannot allocate window\n");
+    exit(1);
+  }
+  window_calc(c->w, type, n, scale, beta);
+  mprotect(c->w, c->len, PROT_READ);
+  c->type = type;
+  c->n = n;
+  c->scale = scale;
+  c->beta = beta;
+  nwins++;
+  printf("window %s n %d\n", window_name(type), n);
+  return c->w;
+}
+
+const char *window_name(int type)
+{
+  if (type < 0 || type > 3) type = 0;
+  return winnames[type];
+}
+
+void window_free(void)
+{
+  int i;
+  for (i = 0; i < nwins; i++) {
+    mprotect(wins[i].w, wins[i].len, PROT_READ | PROT_WRITE);
+    free(wins[i].w);
+  }
+  nwins = 0;
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "d1typ6.h"
+#include "d1proto6.h"
+
+// Output thread. The acquisition loop hands each output job (a function and
+//  a private copy of everything it needs) to writer_submit(). With the
+//  bounded queue full a job that must be written (spectra, closing files)
+//  waits for room, so a disk stall holds up acquisition rather than losing
+//  data; a best-effort job (waterfall rows, status) is dropped and counted
+//  in d1.wdrop, which the status segment shows. The thread runs the jobs
+//  in order
+
+#define NWQ 16    // queue length
+
+typedef struct
+{
+ void (*fn)(void *);
+ void *arg;
+} wjob;
+
+static wjob wq[NWQ];
+static int wqhead, wqtail, wqn, wrun, wbusy;
+static int wdrop, wdone;
+static pthread_t wthr;
+static pthread_mutex_t wlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wcond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t widle = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t wspace = PTHREAD_COND_INITIALIZER;
+extern d1type d1;
+
+static void *writer(void *);
+
+int writer_init(void)
+{
+  wqhead = wqtail = wqn = wdrop = wdone = wbusy = 0;
+  wrun = 1;
+  if (pthread_create(&wthr, NULL, writer, NULL)) {
+    printf("error creating writer thread - output inline\n");
+    wrun = 0;
+    return -1;
+  }
+  return 0;
+}
+
+// Queue fn with a copy of the len bytes at arg. With the queue full, wait
+//  for room if block is set, else drop the job. Returns -1 if dropped
+int writer_submit(void (*fn)(void *), const void *arg, size_t len, int block)
+{
+  void *p;
+  if (!wrun) {    // no thread - run inline
+    fn((void *) arg);
+    return 0;
+  }
+  if ((p = malloc(len)) == NULL) {
+    if (!block) d1.wdrop++;
+    else fn((void *) arg);   // cannot queue it, write it here
+    return block ? 0 : -1;
+  }
+  memcpy(p, arg, len);
+  pthread_mutex_lock(&wlock);
+  if (wqn == NWQ && !block) {
+    wdrop++;
+    d1.wdrop++;
+    pthread_mutex_unlock(&wlock);
+    free(p);
+    printf("writer queue full - output dropped (%d)\n", wdrop);
+    return -1;
+  }
+  while (wqn == NWQ) pthread_cond_wait(&wspace, &wlock);
+  wq[wqhead].fn = fn;
+  wq[wqhead].arg = p;
+  wqhead = (wqhead + 1) % NWQ;
+  wqn++;
+  pthread_cond_signal(&wcond);
+  pthread_mutex_unlock(&wlock);
+  return 0;
+}
+
+static void *writer(void *ii)
+{
+  wjob j;
+  (void)ii;
+  pthread_mutex_lock(&wlock);
+  for (;;) {
+    while (wqn == 0 && wrun) pthread_cond_wait(&wcond, &wlock);
+    if (wqn == 0) break;
+    j = wq[wqtail];
+    wqtail = (wqtail + 1) % NWQ;
+    wqn--;
+    pthread_cond_signal(&wspace);
+    wbusy = 1;
+    pthread_mutex_unlock(&wlock);
+    j.fn(j.arg);
+    free(j.arg);
+    pthread_mutex_lock(&wlock);
+    wbusy = 0;
+    wdone++;
+    if (wqn == 0) pthread_cond_broadcast(&widle);
+  }
+  pthread_mutex_unlock(&wlock);
+  pthread_exit(NULL);
+}
+
+// wait until everything queued so far is written
+void writer_flush(void)
+{
+  pthread_mutex_lock(&wlock);
+  while (wrun && (wqn > 0 || wbusy)) pthread_cond_wait(&widle, &wlock);
+  pthread_mutex_unlock(&wlock);
+}
+
+// finish the queue and stop the thread
+void writer_free(void)
+{
+  if (!wrun) return;
+  pthread_mutex_lock(&wlock);
+  wrun = 0;
+  pthread_cond_signal(&wcond);
+  pthread_mutex_unlock(&wlock);
+  pthread_join(wthr, NULL);
+  printf("writer %d jobs done %d dropped\n", wdone, wdrop);
+}
+
+int writer_pending(void)
+{
+  return wqn;
+}